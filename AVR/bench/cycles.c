@@ -0,0 +1,253 @@
+//
+//  cycles.c
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+// Cycle Benchmark
+// ---------------
+// Built for the AVR and run under simavr, this measures the number of cycles
+// spent by the DCC decoder for each edge of a recorded trace, and by the
+// booster's edge ISR, and reports the minimum, average and maximum of each.
+//
+// The booster firmware is included directly, with its main() renamed, so
+// that the ISR measured is exactly the one that would be flashed. TIMER1 is
+// reconfigured with no prescale so that TCNT1 counts cycles; the cost of the
+// measurement itself is calibrated out.
+//
+// Each edge must be handled within the shortest permitted half-bit period,
+// 52µs, so the maximum of the decoder and ISR together is checked against
+// that budget.
+//
+// The latency from a THERMAL fault edge to the output pins changing is also
+// measured, using a hook in output_set() to record TCNT1 at the write; the
+// worst case adds the edge ISR, which may be running when the fault occurs.
+//
+// The trace is compiled in from `trace.h`, which the Makefile generates from
+// a text trace in the same format as used by the replay benchmark.
+
+#include <stdint.h>
+
+// Timestamp of the last output pin write.
+static volatile uint16_t output_timestamp;
+#define OUTPUT_SET_HOOK() (output_timestamp = TCNT1)
+
+#define main booster_main
+#include "../booster.c"
+#undef main
+
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+
+static const uint16_t trace[] PROGMEM = {
+#include "trace.h"
+};
+
+#define TRACE_LENGTH (sizeof trace / sizeof trace[0])
+
+// Budget in cycles for handling a single edge.
+#define EDGE_BUDGET ((F_CPU / 1000000UL) * 52)
+
+struct stats {
+    uint16_t min, max;
+    uint32_t total, count;
+};
+
+static void
+stats_add(struct stats *stats, uint16_t cycles)
+{
+    if (!stats->count || (cycles < stats->min))
+        stats->min = cycles;
+    if (cycles > stats->max)
+        stats->max = cycles;
+    stats->total += cycles;
+    ++stats->count;
+}
+
+
+// MARK: Output
+
+// Output is written directly to the USART by polling, since the UART module
+// is only present in debug builds; simavr echoes each line to the console.
+
+static void
+bench_putc(char ch)
+{
+    loop_until_bit_is_set(UCSR0A, UDRE0);
+    UDR0 = ch;
+}
+
+static void
+bench_puts(const char *str)
+{
+    while (*str)
+        bench_putc(*str++);
+}
+
+static void
+bench_putu(uint32_t value)
+{
+    char digits[10];
+    uint8_t length = 0;
+
+    do {
+        digits[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (length)
+        bench_putc(digits[--length]);
+}
+
+static void
+bench_report(const char *name, const struct stats *stats)
+{
+    bench_puts(name);
+    bench_puts(": min ");
+    bench_putu(stats->min);
+    bench_puts(" avg ");
+    bench_putu(stats->count ? stats->total / stats->count : 0);
+    bench_puts(" max ");
+    bench_putu(stats->max);
+    bench_puts(" cycles\r\n");
+}
+
+
+// MARK: Measurement
+
+// Cost in cycles of an empty measurement.
+static uint16_t overhead;
+
+static inline uint16_t
+cycles_since(uint16_t start)
+{
+    return TCNT1 - start - overhead;
+}
+
+int
+main()
+{
+    cli();
+    UCSR0B = _BV(TXEN0);
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+    UBRR0H = 0;
+    UBRR0L = 0x03;
+
+    dcc_init();
+    dcc_decoder_init();
+
+    // Count cycles, and don't let the loss of signal timeout interfere.
+    TIMSK1 &= ~_BV(OCIE1A);
+    TCCR1B |= _BV(CS10);
+
+    uint16_t start = TCNT1;
+    overhead = TCNT1 - start;
+
+    // Decoder cost per edge, over the whole trace.
+    struct stats decode = { 0 };
+    uint16_t packets = 0;
+    for (uint16_t i = 0; i < TRACE_LENGTH; ++i) {
+        uint16_t length = pgm_read_word(&trace[i]);
+
+        start = TCNT1;
+        enum dcc_result result = dcc_decode(length);
+        stats_add(&decode, cycles_since(start));
+
+        if (result == DCC_PACKET)
+            ++packets;
+    }
+
+    // ISR cost per edge, including entry and return, triggered by toggling the
+    // input pin as an output; AVR external and capture interrupts also fire for
+    // changes made to the pin by software.
+#if DCC_ICP
+#define DCC_PIN PINB
+    DDRB |= _BV(DCC);
+#else
+#define DCC_PIN PIND
+    DDRD |= _BV(DCC);
+#endif
+
+    // Calibrate the cost of the toggle with interrupts disabled.
+    start = TCNT1;
+    DCC_PIN = _BV(DCC);
+    __asm__ __volatile__ ("nop");
+    uint16_t toggle = cycles_since(start);
+#if DCC_ICP
+    TIFR1 = _BV(ICF1);
+#else
+    EIFR = _BV(INTF0);
+#endif
+
+    // The first edge clears NO_SIGNAL, which only happens once, so take it
+    // before measuring; and keep the UDRE interrupt disabled after each edge,
+    // in case the ISR sent telemetry such as a late cutout, so that draining
+    // the UART isn't counted as part of the ISR.
+    sei();
+    DCC_PIN = _BV(DCC);
+    __asm__ __volatile__ ("nop");
+    cli();
+    UCSR0B &= ~_BV(UDRIE0);
+
+    struct stats isr = { 0 };
+    for (uint16_t i = 0; i < 1000; ++i) {
+#if DCC_DECODE_IN_ISR
+        packet_tail = packet_head;
+#else
+        edge_tail = edge_head;
+#endif
+
+        sei();
+        start = TCNT1;
+        DCC_PIN = _BV(DCC);
+        __asm__ __volatile__ ("nop");
+        uint16_t cycles = cycles_since(start) - toggle;
+        cli();
+        UCSR0B &= ~_BV(UDRIE0);
+
+        stats_add(&isr, cycles);
+    }
+
+    // Fault latency, from toggling THERMAL to the output write, triggered in the
+    // same way. The condition report is left for the main loop, which never
+    // runs, so the UART is left alone.
+    input_init();
+    DDRD |= _BV(THERMAL);
+    EIFR = _BV(INTF1);
+
+    struct stats fault = { 0 };
+    for (uint16_t i = 0; i < 1000; ++i) {
+        sei();
+        start = TCNT1;
+        PIND = _BV(THERMAL);
+        __asm__ __volatile__ ("nop");
+        cli();
+        UCSR0B &= ~_BV(UDRIE0);
+
+        stats_add(&fault, output_timestamp - start - overhead - toggle);
+    }
+
+    bench_puts("packets: ");
+    bench_putu(packets);
+    bench_puts("\r\n");
+    bench_report("decode", &decode);
+    bench_report("isr", &isr);
+    bench_report("fault", &fault);
+
+    bench_puts("fault worst case: ");
+    bench_putu(fault.max + isr.max);
+    bench_puts(" cycles\r\n");
+
+    bench_puts("budget: ");
+    bench_putu(EDGE_BUDGET);
+    bench_puts(decode.max + isr.max > EDGE_BUDGET ? " cycles EXCEEDED\r\n" : " cycles ok\r\n");
+
+    // Sleeping with interrupts disabled causes simavr to exit.
+    loop_until_bit_is_set(UCSR0A, TXC0);
+    sleep_enable();
+    sleep_cpu();
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+//
+//  replay.c
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+// Replay Benchmark
+// ----------------
+// Built natively on the host, this feeds recorded edge-length traces through
+// the same DCC decoder that's linked into the firmware, and reports the
+// packet rate and the breakdown of errors.
+//
+// Traces are text files with one period length per line, in the same timer
+// ticks the firmware measures; those in traces/ are 0.5µs ticks, so only
+// replay correctly with the default dcc_timing.h. Blank lines, and lines
+// beginning with `#`, are ignored.
+//
+// Traces of real signals can be recorded from a detector built with
+// DCC_CAPTURE by the Sniffer tool, which replays each captured packet at the
+// extremes of its timing.
+//
+//     $ ./replay traces/sample.trace
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../dcc_decoder.h"
+
+
+static const char *result_names[] = {
+    [DCC_CONTINUE] = NULL,
+    [DCC_PACKET] = "packets",
+    [DCC_BAD_LEN] = "BAD LEN",
+    [DCC_BAD_MATCH] = "BAD MATCH",
+    [DCC_BAD_DELTA] = "BAD DELTA",
+    [DCC_TOO_LONG] = "TOO LONG",
+    [DCC_ERR] = "ERR",
+};
+
+#define RESULT_COUNT (sizeof result_names / sizeof result_names[0])
+
+static int
+replay(const char *path)
+{
+    FILE *trace = fopen(path, "r");
+    if (!trace) {
+        perror(path);
+        return 1;
+    }
+
+    dcc_decoder_init();
+
+    unsigned long counts[RESULT_COUNT] = { 0 };
+    unsigned long edges = 0;
+    unsigned long long ticks = 0;
+
+    char line[64];
+    while (fgets(line, sizeof line, trace)) {
+        char *end;
+        unsigned long length = strtoul(line, &end, 10);
+        if ((end == line) || (line[0] == '#'))
+            continue;
+
+        ticks += length;
+        ++edges;
+        ++counts[dcc_decode(length > 0xffff ? 0xffff : length)];
+    }
+    fclose(trace);
+
+    double seconds = ticks / ((double)F_CPU / DCC_TIMER_PRESCALE);
+    printf("%s: %lu edges, %.3fs of signal\n", path, edges, seconds);
+    for (unsigned i = 0; i < RESULT_COUNT; ++i) {
+        if (!result_names[i])
+            continue;
+
+        printf("  %-10s %8lu", result_names[i], counts[i]);
+        if ((i == DCC_PACKET) && (seconds > 0))
+            printf("  (%.1f/s)", counts[i] / seconds);
+        printf("\n");
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s TRACE...\n", argv[0]);
+        return 2;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+        ret |= replay(argv[i]);
+
+    return ret;
+}
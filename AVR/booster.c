@@ -5,14 +5,58 @@
 //  Created by Scott James Remnant on 6/1/20.
 //
 
+#include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "command.h"
+#include "dcc_decoder.h"
+#include "log.h"
+#include "telemetry.h"
 #include "uart.h"
 
 
+// MARK: Settings
+
+// Settings
+// --------
+// The thresholds and timings below can be changed at runtime through the
+// command channel, and saved to the EEPROM; see Command Channel at the end.
+// Each setting has an identifier, type and field in `struct settings`, the
+// default defined in its own section, and the permitted range; all are
+// 16-bit or smaller.
+//
+// The matching table for the Pi is `BoosterSetting` in the DCC module, and
+// the two must be kept in sync.
+
+#define SETTINGS(_) \
+    _(SETTING_HARD_OVERLOAD,         0x01, uint8_t,  hard_overload,         HARD_OVERLOAD,         1, 255) \
+    _(SETTING_CURRENT_RATING,        0x02, uint8_t,  current_rating,        CURRENT_RATING,        1, 254) \
+    _(SETTING_INRUSH_OVERLOAD,       0x03, uint8_t,  inrush_overload,       INRUSH_OVERLOAD,       1, 255) \
+    _(SETTING_RECOVERY_OFF_MS,       0x10, uint16_t, recovery_off_ms,       RECOVERY_OFF_MS,       RECOVERY_OFF_MIN_MS, 2000) \
+    _(SETTING_RECOVERY_PROBATION_MS, 0x11, uint16_t, recovery_probation_ms, RECOVERY_PROBATION_MS, 1, 60000) \
+    _(SETTING_RECOVERY_MAX_FAILURES, 0x12, uint8_t,  recovery_max_failures, RECOVERY_MAX_FAILURES, 1, 8) \
+    _(SETTING_RAILCOM_START,         0x20, uint16_t, railcom_start,         RAILCOM_START,         0, DCC_TICKS(32)) \
+    _(SETTING_RAILCOM_END,           0x21, uint16_t, railcom_end,           RAILCOM_END,           0, DCC_TICKS(488)) \
+    _(SETTING_DCC_ONE_DELTA,         0x30, uint8_t,  dcc_one_delta,         DCC_ONE_DELTA,         0, DCC_TICKS(12)) \
+    _(SETTING_TELEMETRY,             0x40, uint8_t,  telemetry,             TELEMETRY_SEND_ALL,    0, 255)
+
+struct settings {
+#define _(name, id, type, field, value, min, max) type field;
+    SETTINGS(_)
+#undef _
+};
+
+extern struct settings settings;
+
+
 // MARK: H-Bridge Outputs
 
 // Outputs
@@ -35,10 +79,31 @@
 // conditions active on the pins rather than just toggling the pins directly.
 // For example a loss of signal can occur during a RailCom cutout, and we don't
 // want the end of cutout timer turning the power back on while we don't have a signal.
+//
+// The conditions are an 8-bit mask, and the pins are updated with two writes
+// of the whole of PORTC, so that the time taken is constant: first with both
+// pins low, releasing whichever was high first, and then with the value for
+// the condition taken from a table. The rest of PORTC is only pull-ups, which
+// the table values preserve.
+//
+// Latency
+// -------
+// The time from a fault edge, such as THERMAL, to the pin change is the
+// interrupt response (4 cycles, up to 4 more to finish the current
+// instruction), the vector jump (3 cycles), the ISR prologue, and the table
+// load and two writes (about 5 cycles); `make bench` measures this as the
+// "fault" cycles. In the worst case, it follows the longest other ISR or
+// interrupts-disabled section, which may be an edge ISR (the "isr" cycles)
+// or, in builds with telemetry, another ISR sending a telemetry record;
+// frames sent by the main loop are copied into the UART buffer with
+// interrupts enabled.
 
 #define BRAKE  PORTC1
 #define PWM    PORTC2
 
+// Value of the rest of PORTC, with pull-ups on all other pins.
+#define OUTPUT_PORTC  (0xff & ~(_BV(PWM) | _BV(BRAKE)))
+
 static inline void
 output_init()
 {
@@ -54,22 +119,95 @@ enum condition {
     OVERLOAD
 };
 
-volatile int condition = NO_SIGNAL;
+volatile uint8_t condition = _BV(NO_SIGNAL);
+
+// PORTC value for each condition mask.
+static const uint8_t output_table[_BV(OVERLOAD + 1)] = {
+    [0] = OUTPUT_PORTC | _BV(PWM),
+    [1 ... _BV(OVERLOAD + 1) - 1] = OUTPUT_PORTC | _BV(BRAKE),
+};
 
 __attribute__((always_inline))
 static inline void
 output_set()
 {
+    uint8_t value = output_table[condition];
+
     // Clear PWM before BRAKE to consistently short by source rather than
     // letting the DIR pin decide whether short by source or sink. Likewise
     // release BRAKE first for the same reason.
-    if (condition) {
-        PORTC &= ~_BV(PWM);
-        PORTC |= _BV(BRAKE);
-    } else {
-        PORTC &= ~_BV(BRAKE);
-        PORTC |= _BV(PWM);
+    PORTC = OUTPUT_PORTC;
+    PORTC = value;
+#ifdef OUTPUT_SET_HOOK
+    OUTPUT_SET_HOOK();
+#endif
+}
+
+// Set condition bits, and update the outputs to match.
+//
+// Atomic so that it may be used from both ISRs and the main loop.
+__attribute__((always_inline))
+static inline void
+condition_set(uint8_t mask)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        condition |= mask;
+        output_set();
+    }
+}
+
+// Clear condition bits, and update the outputs to match.
+//
+// Atomic so that it may be used from both ISRs and the main loop.
+__attribute__((always_inline))
+static inline void
+condition_clear(uint8_t mask)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        condition &= ~mask;
+        output_set();
+    }
+}
+
+static inline void journal_condition(uint8_t value);
+
+// Set by ISRs that leave work for the main loop other than edges, so that it
+// wakes without a DCC signal; see Main Loop.
+volatile uint8_t main_wakeup;
+
+// Set when the condition has changed since it was last sent.
+volatile uint8_t condition_changed;
+
+// Queue the current condition to be sent as a telemetry record by the main
+// loop, and when built with FAULT_JOURNAL, journal it.
+//
+// Called after changes to the exception conditions, but not for the cutout
+// since those are expected after every packet. The record is sent by the
+// main loop so that the ISRs don't spend time encoding it; changes in quick
+// succession may be sent as one record.
+static inline void
+condition_report()
+{
+    condition_changed = 1;
+    main_wakeup = 1;
+    journal_condition(condition);
+}
+
+// Send a condition record, if the condition has changed since the last;
+// called from the main loop.
+static inline void
+condition_poll()
+{
+    uint8_t value;
+
+    if (!condition_changed)
+        return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        condition_changed = 0;
+        value = condition;
     }
+    telemetry_send(TELEMETRY_CONDITION, &value, sizeof value);
 }
 
 
@@ -82,9 +220,6 @@ output_set()
 
 #define THERMAL  PORTD3
 
-// Overload threshold of 3A, where we pull the power.
-#define HARD_OVERLOAD  512
-
 static inline void
 input_init()
 {
@@ -94,14 +229,8 @@ input_init()
 
     // Check for initial overhead condition.
     if (!bit_is_set(PIND, THERMAL)) {
-        condition |= _BV(OVERHEAT);
-        output_set();
+        condition_set(_BV(OVERHEAT));
     }
-
-    // Configure the ADC in free-running mode, reading from ADC0, generating
-    // interrupts on new data, and with a clock pre-scalar of 128 (125kHz).
-    ADMUX = _BV(REFS0);
-    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
 }
 
 // INT1 Interrupt.
@@ -112,413 +241,1947 @@ ISR(INT1_vect)
 {
     if (!bit_is_set(PIND, THERMAL)) {
         if (!bit_is_set(condition, OVERHEAT)) {
-            condition |= _BV(OVERHEAT);
-            output_set();
+            condition_set(_BV(OVERHEAT));
+            condition_report();
         }
     } else if (bit_is_set(condition, OVERHEAT)) {
-        condition &= ~_BV(OVERHEAT);
-        output_set();
+        condition_clear(_BV(OVERHEAT));
+        condition_report();
     }
 }
 
-// ADC Interrupt.
-// Fires when a new analog value is ready to be read.
+
+// MARK: Latency Probe
+
+// Latency Probe
+// -------------
+// When built with LATENCY_PROBE the booster reports when it decodes each
+// probe packet from the Pi, so that the Pi can measure the latency from
+// queueing a packet to its arrival at the booster, and the jitter in it;
+// see `LatencyProbe` in the DCC module.
 //
-// Reads the value and checks it for overload.
-ISR(ADC_vect)
+// Probe packets use the reserved address of the idle packet, with a non-zero
+// sequence number in place of its zero data byte, so decoders ignore them.
+// The Pi may repeat a probe in the signal, so only the first packet with each
+// sequence number is reported.
+//
+// The timestamp of the edge that completed the packet is extended to 32 bits
+// with a count of TIMER1 overflows, which the recovery tick below already
+// interrupts for, and reported by the main loop as a probe record.
+
+#if LATENCY_PROBE
+#define PROBE_ADDRESS  0xff
+
+volatile uint16_t timer1_overflows;
+
+// Sequence number and extended timestamp of the last probe decoded, and the
+// sequence number last reported.
+volatile uint8_t probe_sequence;
+volatile uint32_t probe_timestamp;
+uint8_t probe_reported;
+
+// Return the 32-bit extended timestamp for a TIMER1 timestamp taken less than
+// one overflow ago.
+static inline uint32_t
+probe_extend_timestamp(unsigned int timestamp)
 {
-    int value = ADCL;
-    value |= (ADCH << 8);
+    unsigned int now;
+    uint16_t overflows;
 
-    if (value >= HARD_OVERLOAD) {
-        if (!bit_is_set(condition, OVERLOAD)) {
-            condition |= _BV(OVERLOAD);
-            output_set();
-        }
-    } else if (bit_is_set(condition, OVERLOAD)) {
-        condition &= ~_BV(OVERLOAD);
-        output_set();
+    // Reading TCNT1 uses the shared TEMP register, so must be atomic. An
+    // overflow may be pending but not yet counted, in which case it's only
+    // counted when TCNT1 was read after it.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        now = TCNT1;
+        overflows = timer1_overflows;
+        if (bit_is_set(TIFR1, TOV1) && now < 0x8000)
+            ++overflows;
+    }
+
+    return ((uint32_t)overflows << 16 | now) - (unsigned int)(now - timestamp);
+}
+
+// Record the packet just decoded, completed by the edge at the given
+// timestamp, if it's a new probe.
+static inline void
+probe_check(const struct dcc_packet *packet, unsigned int timestamp)
+{
+    if (packet->length != 3 || packet->data[0] != PROBE_ADDRESS)
+        return;
+    if (!packet->data[1] || packet->data[1] == probe_sequence)
+        return;
+
+    probe_timestamp = probe_extend_timestamp(timestamp);
+    probe_sequence = packet->data[1];
+}
+
+// Send a probe record for the last probe decoded, if not yet reported.
+static inline void
+probe_poll()
+{
+    uint8_t payload[5];
+    uint32_t timestamp;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        payload[0] = probe_sequence;
+        timestamp = probe_timestamp;
     }
+    if (payload[0] == probe_reported)
+        return;
+
+    memcpy(payload + 1, &timestamp, 4);
+    telemetry_send(TELEMETRY_PROBE, payload, sizeof payload);
+    probe_reported = payload[0];
 }
+#else  // LATENCY_PROBE
+static inline void probe_check(const struct dcc_packet *packet, unsigned int timestamp) {}
+static inline void probe_poll() {}
+#endif  // LATENCY_PROBE
 
 
-// MARK: DCC Signal Input
+// MARK: Overload Recovery
 
-// DCC Signal Timing
+// Overload Recovery
 // -----------------
-// The DCC signal is a a series of high/low periods where the length of the
-// high and low parts indicate whether it's a zero-bit or a one-bit. Either
-// the high or low can come first, depending on the wiring:
+// When the current protection trips the OVERLOAD condition the outputs are
+// kept off for at least RECOVERY_OFF_MS before retrying; if the outputs trip
+// again within RECOVERY_PROBATION_MS of the retry, the off time is doubled
+// before the next attempt. After RECOVERY_MAX_FAILURES consecutive failures
+// the outputs are latched off, until explicitly reset with the reset command,
+// or by restarting the booster; losing the DCC signal doesn't reset it, so a
+// booster sitting on a short isn't re-armed by a glitch in the signal.
 //
-//    __    __   _   _        __    __    _   _
-// __|  |__|  |_| |_| |  or  |  |__|  |__| |_| |_  =>  0011
-//
-// We use a single timer to both measure the time in microseconds between
-// edges, and to detect a loss of signal.
+// Timing uses the TIMER1 overflow as a tick, since the timer is already
+// free-running for the DCC input; when built with LATENCY_PROBE the overflows
+// are also counted for the probe timestamps, and with FAULT_JOURNAL for the
+// journal's. A trip happens part way through a tick, so the off time is
+// counted from the next, and can't be set shorter than one.
 //
-// TIMER1 counts the number of 0.5µs ticks in TCNT1, and the INT0 (D2) ISR
-// is fired on edges, storing this value in `edge` for the main loop to
-// retrieve. TCNT1 is then reset to zero, to begin counting again for the
-// next edge.
+//            trip                  ticks
+//   NORMAL ------> OFF <-----------------+
+//     ^             |  ticks             | trip
+//     |             +------> RETRY ------+
+//     |  ticks                 |
+//     +------------------------+
 //
-// The value of TOP for TIMER1 is set to the maximum permitted time for a
-// zero-bit high or low period, when exceeeded the timer ISR is triggered
-// indicating a loss of signal.
+// The tick counts for the settings are calculated when they're changed,
+// since the trip is made by the ADC ISR. Transitions are sent as telemetry
+// records by the main loop, along with the log message for the reason of
+// the trip; transitions in quick succession may be sent as one record.
 
-#define DCC  PD2
+// TIMER1 overflows every 65,536 ticks, every DCC_OVERFLOW_US.
+#define TICKS(ms)  (((uint32_t)(ms) * 1000 + DCC_OVERFLOW_US - 1) / DCC_OVERFLOW_US)
+
+#define RECOVERY_OFF_MS  250
+#define RECOVERY_OFF_MIN_MS  ((DCC_OVERFLOW_US + 999) / 1000)
+#define RECOVERY_PROBATION_MS  1000
+#define RECOVERY_MAX_FAILURES  5
+
+enum recovery_state {
+    RECOVERY_NORMAL,
+    RECOVERY_OFF,
+    RECOVERY_RETRY,
+    RECOVERY_LOCKOUT,
+};
+
+uint8_t recovery_state = RECOVERY_NORMAL;
+uint8_t recovery_failures;
+uint16_t recovery_ticks;
+
+// Ticks of the off and probation times, from the settings.
+uint16_t recovery_off_ticks = TICKS(RECOVERY_OFF_MS);
+uint16_t recovery_probation_ticks = TICKS(RECOVERY_PROBATION_MS);
+
+// Set when the state has changed since it was last sent, and the log
+// message and value for the last trip, if not yet sent.
+volatile uint8_t recovery_changed;
+volatile uint8_t recovery_trip_message;
+volatile uint16_t recovery_trip_value;
 
 static inline void
-dcc_init()
+recovery_init()
 {
-    // Configure INT0 to generate interrupts for any logical change.
-    EICRA |= _BV(ISC00);
-    EIMSK |= _BV(INT0);
-
-    // To analyze the DCC signal we need a timer on which we can measure, with
-    // reasonable precision, the time in microseconds between edges. Set up TIMER1
-    // in CTC mode with 0.5µs (8 prescale) ticks, and a TOP of the maximum permitted
-    // length of a high or low period (10,000µs).
-    //
-    // We'll reset TCNT1 whenever an edge in the input is detected, meaning a timer
-    // interrupt is generated when the maximum length of a zero-bit high or low period
-    // has been exceeded, indicating loss of signal.
-    TCCR1A = 0;
-    TCCR1B = _BV(WGM12);
-    TCCR1C = 0;
-    TIMSK1 = _BV(OCIE1A);
-    OCR1A = 10000 * 2;
+    // Generate an interrupt on TIMER1 overflow for the tick.
+    TIMSK1 |= _BV(TOIE1);
 }
 
+// Change the recovery state, with a number of ticks before the next.
 static inline void
-dcc_timer_start()
+recovery_set(uint8_t state, uint16_t ticks)
 {
-    TCNT1 = 0;
-    TCCR1B |= _BV(CS11);
+    recovery_state = state;
+    recovery_ticks = ticks;
+    recovery_changed = 1;
+    main_wakeup = 1;
 }
 
-volatile unsigned int edge;
-
-// INT0 Interrupt.
-// Fires when the input signal on INT0 (D2) changes.
-//
-// Reads TCNT1 and resets it, clears any loss of signal status.
-ISR(INT0_vect)
+// Set the OVERLOAD condition, and begin recovery from it; the log message
+// and value give the reason.
+static inline void
+recovery_trip(uint8_t message, uint16_t value)
 {
-    edge = TCNT1;
-    TCNT1 = 0;
+    condition_set(_BV(OVERLOAD));
+    condition_report();
 
-    if (bit_is_set(condition, NO_SIGNAL)) {
-        condition &= ~_BV(NO_SIGNAL);
-        output_set();
+    recovery_trip_message = message;
+    recovery_trip_value = value;
+
+    if (++recovery_failures >= settings.recovery_max_failures) {
+        recovery_set(RECOVERY_LOCKOUT, 0);
+    } else {
+        recovery_set(RECOVERY_OFF, (recovery_off_ticks << (recovery_failures - 1)) + 1);
     }
 }
 
-// TIMER1 Comparison Interrupt.
-// Fires when TIMER1 reaches TOP.
-//
-// Indicates a timeout waiting for the input signal to change.
-ISR(TIMER1_COMPA_vect)
+// Reset a lockout, clearing the OVERLOAD condition; called from the main
+// loop for the reset command. The state is always sent, as the answer.
+static inline void
+recovery_reset()
 {
-    if (!bit_is_set(condition, NO_SIGNAL)) {
-        condition |= _BV(NO_SIGNAL);
-        output_set();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (recovery_state == RECOVERY_LOCKOUT) {
+            condition_clear(_BV(OVERLOAD));
+            condition_report();
+            recovery_failures = 0;
+            recovery_set(RECOVERY_NORMAL, 0);
+        }
+        recovery_changed = 1;
     }
 }
 
-// Wait for an edge and return the length.
-static inline unsigned int
-wait_for_edge()
+// Send the log message for the last trip, and an overload record if the
+// state has changed since the last; called from the main loop.
+static inline void
+recovery_poll()
 {
-    unsigned int length;
-    uint8_t sreg;
+    uint8_t payload[2];
+    uint8_t message;
+    uint16_t value;
 
-    while (!edge)
-        ;
+    if (!recovery_changed)
+        return;
 
-    sreg = SREG;
-    cli();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        message = recovery_trip_message;
+        value = recovery_trip_value;
+        recovery_trip_message = 0;
 
-    length = edge;
-    edge = 0;
+        payload[0] = recovery_state;
+        payload[1] = recovery_failures;
+        recovery_changed = 0;
+    }
 
-    SREG = sreg;
-    return length;
+    if (message)
+        log_u16(message, value);
+    telemetry_send(TELEMETRY_OVERLOAD, payload, sizeof payload);
 }
 
+static inline void journal_tick();
 
-// MARK: RailCom Cutout Generation
+// TIMER1 Overflow Interrupt.
+// Fires every tick.
+//
+// Retries the outputs at the end of the off time, and ends recovery once
+// they've stayed on.
+ISR(TIMER1_OVF_vect)
+{
+#if LATENCY_PROBE
+    ++timer1_overflows;
+#endif
+    journal_tick();
 
-// RailCom Cutout
-// --------------
-// The RailCom cutout is a gap in the DCC signal where no power is present
-// on the track, during which the decoder can transmit its own signal.
+    switch (recovery_state) {
+        case RECOVERY_OFF:
+            if (--recovery_ticks)
+                break;
+
+            condition_clear(_BV(OVERLOAD));
+            condition_report();
+            recovery_set(RECOVERY_RETRY, recovery_probation_ticks);
+            break;
+        case RECOVERY_RETRY:
+            if (--recovery_ticks)
+                break;
+
+            recovery_failures = 0;
+            recovery_set(RECOVERY_NORMAL, 0);
+            break;
+    }
+}
+
+
+// MARK: Current Protection
+
+// Current Protection
+// ------------------
+// Each ADC sample is the top 8 bits of the current sense, 1/255 of 5V, where
+// 128 is 3A, and there are two ways that the current can trip the OVERLOAD
+// condition. Samples taken during the cutout are ignored, since the outputs
+// are off and the current meaningless.
 //
-//    _   _              _   _
-//  _| |_| '-++--++++-._| |_| |_
+// With ADC_SYNC, samples are taken at a fixed phase, ADC_SYNC_PHASE, after
+// each edge of the DCC signal so that they always fall at the same point in
+// each half of a bit, clear of the switching transients at the edges.
 //
-// We generate the cutout after we see the packet end bit to a valid packet,
-// starting TIMER0 which triggers ISRs when the delay time for the cutout start
-// and end (as measured from the end of the packet end bit) have passed.
+// The hard trip catches a short, and trips when consecutive samples are over
+// HARD_OVERLOAD; requiring more than one avoids cutting the track on a single
+// noisy sample.
+//
+// The slow trip catches a sustained overload under that limit, such as a
+// stalled motor, and uses an I²t accumulator of the heating effect of the
+// current above the continuous CURRENT_RATING. Samples are first smoothed with
+// an IIR filter, and squared, which adds to the accumulator
+// while over the rating, and drains it while under. The accumulator limit is
+// the heat of a current just under HARD_OVERLOAD for I2T_TRIP_MS.
+//
+// When the outputs are first turned on, or back on after an exception, the
+// locomotives on the track will all draw a burst of current as they start
+// up. For INRUSH_MS the hard trip is raised to INRUSH_OVERLOAD and the
+// accumulator does not fill.
+//
+// After either trip the accumulator is filled to its limit, so that it has
+// drained by the time the outputs are retried; see Overload Recovery above.
+
+#if ADC_SYNC
+// Samples per second, one per edge; this is nominal since it depends on the
+// mix of one-bits (17,241 edges per second) and zero-bits (at most 10,000).
+#define ADC_SAMPLE_RATE  12500
+
+// Phase of the sample after each edge, in TIMER0 ticks; the ADC samples 1.5
+// ADC clocks (6µs) after the trigger, so this is the middle of a one-bit half.
+// TIMER0 wraps every 256 ticks (128µs at 0.5µs), so very long zero-bits are
+// sampled again.
+#define ADC_SYNC_PHASE  DCC_TICKS(20)
+#else
+// Samples per second, 16MHz / 64 prescaler / 13 cycles per conversion.
+#define ADC_SAMPLE_RATE  19231
+#endif
+
+#define ADC_SAMPLES(ms)  ((uint32_t)(ms) * ADC_SAMPLE_RATE / 1000)
+
+// Overload threshold of 3A, where we pull the power, and the number of
+// consecutive samples over it.
+#define HARD_OVERLOAD  128
+#define HARD_OVERLOAD_SAMPLES  2
+
+// Continuous current rating, default 2.5A; may be overridden by the Makefile.
+#ifndef CURRENT_RATING
+#define CURRENT_RATING  106
+#endif
 
-// Inherent processing delay between the packet end bit coming from the input source
-// and any changes we make to the H-Bridge Output pins to take effect. Subtracted from
-// timer values to get the right period for the RailCom cutout.
-#define RAILCOM_DELAY 12
+#if CURRENT_RATING >= HARD_OVERLOAD
+#error "CURRENT_RATING must be lower than HARD_OVERLOAD"
+#endif
+
+// Shift of the IIR filter, each sample moves the filtered value 1/16th of the
+// way towards it.
+#define CURRENT_FILTER_SHIFT  4
+
+// Time to trip at a current just under HARD_OVERLOAD.
+#define I2T_TRIP_MS  500
+
+#define I2T_SQUARE(value)  ((uint16_t)(value) * (value))
+#define I2T_LIMIT(hard, rating) \
+    ((uint32_t)(I2T_SQUARE(hard) - I2T_SQUARE(rating)) * ADC_SAMPLES(I2T_TRIP_MS))
+
+// Inrush allowance, 4.5A for 100ms.
+#define INRUSH_OVERLOAD  192
+#define INRUSH_MS  100
+
+// Conditions for which the outputs are off, other than the cutout.
+#define OUTPUTS_OFF  (_BV(NO_SIGNAL) | _BV(OVERHEAT) | _BV(OVERLOAD))
+
+// Filtered current, with CURRENT_FILTER_SHIFT bits of fraction.
+uint16_t current_filtered;
+uint32_t current_i2t;
+uint8_t current_hard_samples;
+uint16_t current_inrush_samples = ADC_SAMPLES(INRUSH_MS);
+
+// Square of the current rating, and the accumulator limit, from the settings.
+uint16_t current_i2t_rating = I2T_SQUARE(CURRENT_RATING);
+uint32_t current_i2t_limit = I2T_LIMIT(HARD_OVERLOAD, CURRENT_RATING);
 
 static inline void
-railcom_init()
+current_init()
 {
-    // For the RailCom cutout we need to measure both the time until cutout start and
-    // end, and we need a reasonable degree of consistency, as for example a 64 prescale
-    // would have a ≤4µs variance between delays as we can't reset the prescaler since it's
-    // shared with TIMER1 which measures the incoming DCC signal.
+    // Configure the ADC reading from ADC0 with the result left-adjusted so
+    // that the top 8 bits can be read from ADCH alone, generating interrupts
+    // on new data, and with a clock pre-scalar of 64 (250kHz); which is too
+    // fast for 10-bit accuracy but fine for 8-bit.
     //
-    // Instead we use TIMER0 with 0.5µs (8 prescale) ticks, but since it's an 8-bit timer
-    // and we can't simply count to 454µs at that scale, we also count overflows. The timer
-    // is set to Normal mode, with OCIE0 set to the delay for the cutout start, and OCIE0B
-    // set to the (modulus) delay for the cutout end. Both generate interrupts, but both
-    // also check the value of `timer_ovf_count` which is incremented by the overflow ISR.
+    // Conversions are either free-running, or with ADC_SYNC triggered by the
+    // TIMER0 Compare Match A that follows each DCC edge; TIMER0 runs in
+    // Normal mode with the same ticks as TIMER1, restarted by each edge.
+    ADMUX = _BV(REFS0) | _BV(ADLAR);
+#if ADC_SYNC
     TCCR0A = 0;
-    TCCR0B = 0;
-    TIMSK0 = _BV(OCIE0A) | _BV(OCIE0B) | _BV(TOIE0);
-    OCR0A = (26 - RAILCOM_DELAY) * 2;
-    OCR0B = ((454 - RAILCOM_DELAY) * 2) % 256;
-}
+    TCCR0B = DCC_TIMER0_CS;
+    OCR0A = ADC_SYNC_PHASE;
 
-volatile int timer0_ovf_count;
+    ADCSRB = _BV(ADTS1) | _BV(ADTS0);
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1);
+#else
+    ADCSRB = 0;
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1);
+#endif
+}
 
+// Trip the OVERLOAD condition, reporting the reason and current.
 static inline void
-railcom_timer_start()
+current_trip(uint8_t message, uint16_t value)
 {
-    timer0_ovf_count = 0;
-    TCNT0 = 0;
-    TCCR0B |= _BV(CS01);
+    current_i2t = current_i2t_limit;
+    if (!bit_is_set(condition, OVERLOAD))
+        recovery_trip(message, value);
 }
 
-static inline void
-railcom_timer_stop()
+static inline void ack_sample(uint8_t value);
+static inline void journal_sample(uint8_t value);
+
+// ADC Interrupt.
+// Fires when a new analog value is ready to be read.
+//
+// Reads the value and checks it for overload; the condition is cleared again
+// by the overload recovery. When built with SERVICE_MODE_ACK, also watches
+// it for an acknowledgement, and with FAULT_JOURNAL, records its peak.
+ISR(ADC_vect)
 {
-    TCCR0B &= ~(_BV(CS02) | _BV(CS01) | _BV(CS00));
+    uint8_t active = condition;
+    uint8_t value, filtered, limit;
+    uint16_t heat;
+
+#if ADC_SYNC
+    // Clear the compare flag, since there's no ISR to do so, otherwise the
+    // next compare won't trigger a conversion.
+    TIFR0 = _BV(OCF0A);
+#endif
+
+    if (bit_is_set(active, CUTOUT))
+        return;
+
+    value = ADCH;
+
+    current_filtered += value - (current_filtered >> CURRENT_FILTER_SHIFT);
+    filtered = current_filtered >> CURRENT_FILTER_SHIFT;
+
+    // Hold the inrush allowance while the outputs are off, so that it starts
+    // counting down once they're turned back on.
+    if (active & OUTPUTS_OFF) {
+        current_inrush_samples = ADC_SAMPLES(INRUSH_MS);
+    } else if (current_inrush_samples) {
+        --current_inrush_samples;
+    }
+
+    limit = current_inrush_samples ? settings.inrush_overload : settings.hard_overload;
+    if (value < limit) {
+        current_hard_samples = 0;
+    } else if (current_hard_samples < HARD_OVERLOAD_SAMPLES) {
+        ++current_hard_samples;
+    }
+
+    heat = (uint16_t)filtered * filtered;
+    if (heat > current_i2t_rating) {
+        if (!current_inrush_samples)
+            current_i2t += heat - current_i2t_rating;
+    } else if (current_i2t > current_i2t_rating - heat) {
+        current_i2t -= current_i2t_rating - heat;
+    } else {
+        current_i2t = 0;
+    }
+
+    ack_sample(value);
+    journal_sample(value);
+
+    if (current_hard_samples >= HARD_OVERLOAD_SAMPLES) {
+        current_trip(LOG_HARD_OVERLOAD, value);
+    } else if (current_i2t >= current_i2t_limit) {
+        current_trip(LOG_SLOW_OVERLOAD, filtered);
+    }
 }
 
-// TIMER0 Comparison Interrupt A.
-// Fires when TIMER0 reaches OCR0A.
+
+// MARK: Service Mode Acknowledgement
+
+// Service Mode Acknowledgement
+// ----------------------------
+// On a programming track, a decoder in service mode acknowledges a packet by
+// drawing at least 60mA more current for 6ms ±1ms, usually by pulsing its
+// motor; see NMRA S-9.2.3. When built with SERVICE_MODE_ACK, the current
+// samples are watched for this after each service mode instruction packet,
+// recognized by a long preamble of at least ACK_PREAMBLE_BITS and an
+// instruction in the first byte of 0111xxxx.
+//
+// The first ACK_BASELINE_SAMPLES after the packet are summed to give the
+// baseline current, in the same units as the filtered current. An
+// acknowledgement is detected as soon as the filtered current has stayed
+// ACK_THRESHOLD above the baseline for ACK_MIN_MS, rather than at the end of
+// the pulse, and the window otherwise closes ACK_WINDOW_MS after the last
+// service mode packet; the Pi's CV reads can move on to the next bit as soon
+// as either is reported, rather than waiting out their own timeout.
 //
-// Starts the RailCom cutout in the first timer period.
-ISR(TIMER0_COMPA_vect)
+//          packet              samples
+//   IDLE ---------> BASELINE ---------> WATCH <---------+
+//    ^ ^                                 |   |          | fall
+//    | |             window closed       |   |  rise    |
+//    | +---------------------------------+   +-------> RISE
+//    |                                                  |
+//    |     fall                          ACK_MIN_MS     |
+//    +------------- HOLD <------------------------------+
+//
+// Detection runs in the ADC ISR, and the result is sent by the main loop as
+// an ack record, with the delay from the last packet to the rise in current
+// and the size of the rise; with ADC_SYNC the delay is approximate, since the
+// sample rate is nominal.
+
+#if SERVICE_MODE_ACK
+#define ACK_PREAMBLE_BITS  20
+
+// Currents in mA, in the units of the filtered current where HARD_OVERLOAD is
+// 3A; the threshold is a little under the 60mA minimum to allow for noise.
+#define ACK_CURRENT(ma) \
+    ((uint16_t)((uint32_t)(ma) * (HARD_OVERLOAD << CURRENT_FILTER_SHIFT) / 3000))
+#define ACK_MA(current) \
+    ((uint16_t)((uint32_t)(current) * 3000 / (HARD_OVERLOAD << CURRENT_FILTER_SHIFT)))
+#define ACK_THRESHOLD  ACK_CURRENT(50)
+
+// Summing this many samples gives the same units as the filtered current.
+#define ACK_BASELINE_SAMPLES  (1 << CURRENT_FILTER_SHIFT)
+
+#define ACK_MIN_MS  3
+#define ACK_WINDOW_MS  20
+
+enum ack_state {
+    ACK_IDLE,
+    ACK_BASELINE,
+    ACK_WATCH,
+    ACK_RISE,
+    ACK_HOLD,
+};
+
+enum ack_result {
+    ACK_RESULT_NONE,
+    ACK_RESULT_NACK,
+    ACK_RESULT_ACK,
+};
+
+volatile uint8_t ack_state = ACK_IDLE;
+
+// Samples since the last service mode packet, and samples counted towards the
+// baseline or the duration of the rise.
+uint16_t ack_samples;
+uint8_t ack_count;
+
+// Baseline current, and the delay and greatest size of the rise above it.
+uint16_t ack_baseline;
+uint16_t ack_delay, ack_rise;
+
+// Result for the main loop to report, with the delay and rise.
+volatile uint8_t ack_result;
+volatile uint16_t ack_result_delay, ack_result_rise;
+
+// Open or extend the window if the packet just decoded is a service mode
+// instruction; the baseline is kept once taken, and a rise in progress isn't
+// interrupted.
+static inline void
+ack_check(const struct dcc_packet *packet)
 {
-    if (timer0_ovf_count == 0) {
-        condition |= _BV(CUTOUT);
-        output_set();
+    if (dcc_decoder.preamble_bits < ACK_PREAMBLE_BITS)
+        return;
+    if ((packet->data[0] & 0xf0) != 0x70 || (packet->length != 3 && packet->length != 4))
+        return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        switch (ack_state) {
+            case ACK_IDLE:
+                ack_baseline = 0;
+                ack_count = 0;
+                ack_state = ACK_BASELINE;
+                // fallthrough
+            case ACK_BASELINE:
+            case ACK_WATCH:
+                ack_samples = 0;
+                break;
+        }
     }
 }
 
-// TIMER0 Comparison Interrupt B.
-// Fires when TIMER0 reaches OCR0B.
-//
-// Stops the RailCom cutout and timer in the correct timer period.
-ISR(TIMER0_COMPB_vect)
+// Close the window with the given result.
+static inline void
+ack_finish(uint8_t result, uint8_t state)
 {
-    if (timer0_ovf_count == ((454 - RAILCOM_DELAY) * 2) / 256) {
-        condition &= ~_BV(CUTOUT);
-        output_set();
+    ack_result = result;
+    ack_result_delay = ack_delay;
+    ack_result_rise = ack_rise;
+    ack_state = state;
+}
+
+// Watch the current sample just taken for an acknowledgement.
+static inline void
+ack_sample(uint8_t value)
+{
+    switch (ack_state) {
+        case ACK_IDLE:
+            return;
+        case ACK_BASELINE:
+            ack_baseline += value;
+            if (++ack_count == ACK_BASELINE_SAMPLES)
+                ack_state = ACK_WATCH;
+            break;
+        case ACK_WATCH:
+            if (current_filtered >= ack_baseline + ACK_THRESHOLD) {
+                ack_delay = ack_samples;
+                ack_rise = current_filtered - ack_baseline;
+                ack_count = 0;
+                ack_state = ACK_RISE;
+            }
+            break;
+        case ACK_RISE:
+            if (current_filtered < ack_baseline + ACK_THRESHOLD) {
+                ack_state = ACK_WATCH;
+                break;
+            }
+
+            if (current_filtered - ack_baseline > ack_rise)
+                ack_rise = current_filtered - ack_baseline;
+            if (++ack_count >= ADC_SAMPLES(ACK_MIN_MS))
+                ack_finish(ACK_RESULT_ACK, ACK_HOLD);
+            return;
+        case ACK_HOLD:
+            // Wait for the end of the pulse, so it isn't detected again.
+            if (current_filtered < ack_baseline + ACK_THRESHOLD)
+                ack_state = ACK_IDLE;
+            return;
+    }
 
-        railcom_timer_stop();
+    if (++ack_samples >= ADC_SAMPLES(ACK_WINDOW_MS) && ack_state != ACK_RISE) {
+        ack_delay = ack_rise = 0;
+        ack_finish(ACK_RESULT_NACK, ACK_IDLE);
     }
 }
 
-// TIMER0 Overflow Interrupt.
-// Fires when TIMER0 reaches MAX.
-//
-// Increments the overflow count, allowing us to count periods of 128µs and longer.
-ISR(TIMER0_OVF_vect)
+// Send an ack record for the window last closed, if not yet reported.
+static inline void
+ack_poll()
 {
-    ++timer0_ovf_count;
+    uint8_t payload[5];
+    uint8_t result;
+    uint16_t delay, rise;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        result = ack_result;
+        delay = ack_result_delay;
+        rise = ack_result_rise;
+        ack_result = ACK_RESULT_NONE;
+    }
+    if (result == ACK_RESULT_NONE)
+        return;
+
+    delay = (uint32_t)delay * 1000000 / ADC_SAMPLE_RATE;
+    rise = ACK_MA(rise);
+
+    payload[0] = result == ACK_RESULT_ACK;
+    memcpy(payload + 1, &delay, 2);
+    memcpy(payload + 3, &rise, 2);
+    telemetry_send(TELEMETRY_ACK, payload, sizeof payload);
 }
+#else  // SERVICE_MODE_ACK
+static inline void ack_check(const struct dcc_packet *packet) {}
+static inline void ack_sample(uint8_t value) {}
+static inline void ack_poll() {}
+#endif  // SERVICE_MODE_ACK
 
 
-// MARK: Main Loop
+// MARK: DCC Signal Input
 
-// Main Loop
-// ---------
-// There are two basic passes to analyzing the incoming DCC signal.
-//
-// The first is to determine the phase; when we start to receive incoming
-// half-bits, we do not yet know whether the signal is in high-low or
-// low-high order, and thus do not know whether an edge is a boundary
-// between bits, or between a single bit's high and low parts.
-//
-// To synchronize we need to look for a point at which the period length
-// changes between that of a one-bit and a zero-bit:
-//
-//                   :
-//   _   _   _   _    __    __   _   _
-// _| |_| |_| |_| |__|  |__|  |_| |_| |
-//                   :
-//         length change means we
-//         must be now in Phase A
-//
-// Since the preamble that marks the start of a packet is a train of
-// one-bits followed by a zero-bit, we can combine both phase synchronization
-// and preamble detection into one pass. A suitably long sequence of one-bits
-// followed by the first period of a zero-bit gives us both the phase of the
-// signal and the start of a packet.
-//
-//
-// The second pass is packet and byte extraction. Due to the different byte
-// and packet end bits, the packet structure can be followed logically and
-// byte and packet boundaries followed provided the input conforms to
-// specification. The final byte is always a check byte, which we compare
-// against an accumulated xor of the previous bytes in the packet.
-//
-//    ?    preamble.   byte     byte  check byte
-//        +--------+ +------+ +------+ +------+
-// 1101000111111111101010101001111000000101101011111...
-//                  :        :        :        :
-//                  +--byte end bits--+    packet end bit
-//
-
-enum parser_state {
-    SEEKING_PREAMBLE,
-    PACKET_START,
-    PACKET_A,
-    PACKET_B
-};
+// DCC Signal Timing
+// -----------------
+// The DCC signal is a a series of high/low periods where the length of the
+// high and low parts indicate whether it's a zero-bit or a one-bit. Either
+// the high or low can come first, depending on the wiring:
+//
+//    __    __   _   _        __    __    _   _
+// __|  |__|  |_| |_| |  or  |  |__|  |__| |_| |_  =>  0011
+//
+// We use a single timer to both measure the time in microseconds between
+// edges, and to detect a loss of signal; it's also used to schedule the
+// RailCom cutout.
+//
+// TIMER1 runs freely counting the number of ticks in TCNT1, and the
+// timestamp of each edge is placed in the edge ring for the main loop to
+// retrieve, which subtracts that of the previous edge to give the length
+// of the period.
+//
+// By default the INT0 (D2) ISR is fired on edges and reads TCNT1 for the
+// timestamp, which means the length includes the latency of entering the
+// ISR, and that varies whenever another ISR happens to be running. When
+// built with DCC_ICP the input is instead taken from ICP1 (B0), and the
+// input capture unit latches TCNT1 into ICR1 in hardware at the moment of
+// the edge; the ISR flips ICES1 to capture the opposite edge next time.
+//
+// OCR1A is moved along with each edge to the maximum permitted time for a
+// zero-bit high or low period after it, when exceeeded the timer ISR is
+// triggered indicating a loss of signal.
 
-// Absolute delta between two unsigned values.
-#define DELTA(_a, _b) ((_a) > (_b) ? (_a) - (_b) : (_b) - (_a))
+#if DCC_ICP
+#define DCC  PB0
+#else
+#define DCC  PD2
+#endif
 
-int
-main()
+static inline void
+dcc_init()
 {
-    cli();
-    // To save power, enable pull-ups on all pins we're not using as input.
-    PORTB = PORTC = ~0;
-    PORTD = ~_BV(DCC);
+#if DCC_ICP
+    // Configure the input capture unit to latch TCNT1 into ICR1 on the edge
+    // opposite to the current level of ICP1, and generate an interrupt.
+    TCCR1B = bit_is_set(PINB, DCC) ? 0 : _BV(ICES1);
+    TIMSK1 = _BV(ICIE1) | _BV(OCIE1A);
+#else
+    // Configure INT0 to generate interrupts for any logical change.
+    EICRA |= _BV(ISC00);
+    EIMSK |= _BV(INT0);
 
-    output_init();
-    input_init();
-    dcc_init();
-    railcom_init();
-    uart_init();
-    sei();
+    TCCR1B = 0;
+    TIMSK1 = _BV(OCIE1A);
+#endif
 
-    output_set();
-    dcc_timer_start();
+    // To analyze the DCC signal we need a timer on which we can measure, with
+    // reasonable precision, the time in microseconds between edges. Set up TIMER1
+    // in Normal mode with DCC_TIMER_PRESCALE ticks (0.5µs at 16MHz with 8), and
+    // leave it running freely; since lengths are calculated by subtraction, the
+    // wrap at MAX doesn't matter.
+    //
+    // The compare value is set to the maximum permitted length of a high or low
+    // period (10,000µs) after the most recent edge, meaning a timer interrupt is
+    // generated when that has been exceeded, indicating loss of signal.
+    TCCR1A = 0;
+    TCCR1C = 0;
+    OCR1A = DCC_SIGNAL_TIMEOUT;
+}
 
-    enum parser_state state = SEEKING_PREAMBLE;
-    int preamble_half_bits = 0, last_bit;
-    unsigned int last_length;
-    uint8_t bitmask, byte, check_byte;
-    for (;;) {
-        // Wait for an edge from the input ISR and copy the length of the period.
-        //
-        // The specification says to allow 52-64µs periods for a one-bit, and
-        // 90-10,000µs for zero-bit. The upper-bound is already handled by timer,
-        // so only check for too-short or intermediate invalid period lengths.
-        unsigned int length = wait_for_edge();
-        int bit;
-        if (length >= 90 * 2) {
-            bit = 0;
-        } else if ((length >= 52 * 2) && (length <= 64 * 2)) {
-            bit = 1;
-        } else {
-            // On an invalid bit length, attempt to resynchronize.
-            preamble_half_bits = 0;
-            state = SEEKING_PREAMBLE;
-            uprintf("\aBAD LEN %u\r\n", length);
+static inline void
+dcc_timer_start()
+{
+    TCNT1 = 0;
+    TCCR1B |= DCC_TIMER1_CS;
+}
+
+// Timestamp at which the main loop last picked up an edge, to measure how
+// long it is then awake for.
+unsigned int awake_timestamp;
+
+// Sleep until the given ring head differs from `tail`, or an ISR sets
+// `main_wakeup`, and report the time spent awake since last returning.
+// Returns non-zero if the ring has an entry.
+__attribute__((always_inline))
+static inline uint8_t
+sleep_until(volatile uint8_t *head, uint8_t tail)
+{
+    unsigned int awake;
+    uint8_t ready;
+
+    // Reading TCNT1 uses the shared TEMP register, so must be atomic.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        awake = TCNT1 - awake_timestamp;
+        while (*head == tail && !main_wakeup) {
+            // The instruction following sei is always executed before any
+            // pending interrupt, so an edge can't arrive between the check
+            // and sleeping; and the ISR wakes us.
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+            cli();
+        }
+        main_wakeup = 0;
+        ready = *head != tail;
+        awake_timestamp = TCNT1;
+    }
+
+    telemetry_awake(awake);
+    return ready;
+}
+
+#if DCC_DECODE_IN_ISR
+// Packet Queue
+// ------------
+// When built with DCC_DECODE_IN_ISR the decoder is run by the edge ISR itself
+// rather than the main loop, so that its latency doesn't depend on whatever
+// the main loop is doing, and the RailCom cutout is scheduled from the ISR as
+// soon as the packet end bit arrives.
+//
+// Only valid packets are passed to the main loop, through a single-producer,
+// single-consumer ring in the same way as the edge ring otherwise used. When
+// the ring is full, the new packet is dropped and `packet_overruns`
+// incremented. Decoding errors are only counted, in `decode_errors`, and
+// for the fault journal.
+//
+// This lengthens the edge ISR by the cost of the decoder, which `make bench`
+// includes in the "isr" cycles.
+
+#define PACKET_RING_SIZE 4
+
+volatile struct dcc_packet packet_ring[PACKET_RING_SIZE];
+volatile uint8_t packet_head, packet_tail;
+volatile uint8_t packet_overruns, decode_errors;
+
+// Timestamp of the previous edge.
+unsigned int edge_timestamp;
+
+static inline void railcom_schedule(unsigned int timestamp);
+static inline void journal_decode(enum dcc_result result);
+
+// Record an edge at the given timestamp.
+//
+// Moves the loss of signal timeout along, clears any loss of signal status,
+// and decodes the period since the previous edge; valid packets schedule the
+// cutout and are placed in the ring.
+__attribute__((always_inline))
+static inline void
+dcc_edge(unsigned int timestamp)
+{
+    unsigned int length = timestamp - edge_timestamp;
+    edge_timestamp = timestamp;
+
+    OCR1A = timestamp + DCC_SIGNAL_TIMEOUT;
+#if ADC_SYNC
+    // Restart TIMER0 as though from the edge, rather than this ISR.
+    TCNT0 = TCNT1 - timestamp;
+#endif
+
+    if (bit_is_set(condition, NO_SIGNAL)) {
+        condition_clear(_BV(NO_SIGNAL));
+        condition_report();
+    }
+
+    enum dcc_result result = dcc_decode(length);
+    if (result == DCC_PACKET) {
+        railcom_schedule(timestamp);
+        probe_check(&dcc_decoder.packet, timestamp);
+        ack_check(&dcc_decoder.packet);
+
+        uint8_t head = packet_head;
+        if ((uint8_t)(head - packet_tail) < PACKET_RING_SIZE) {
+            packet_ring[head % PACKET_RING_SIZE] = dcc_decoder.packet;
+            packet_head = head + 1;
+        } else {
+            ++packet_overruns;
+        }
+    } else if (result != DCC_CONTINUE) {
+        ++decode_errors;
+        journal_decode(result);
+    }
+}
+#else  // DCC_DECODE_IN_ISR
+// Edge Ring
+// ---------
+// Timestamps are passed from the ISR to the main loop through a single-producer,
+// single-consumer ring so that the main loop can fall behind by a few bits, for
+// example while writing to the UART, without losing any edges.
+//
+// The head is only written by the ISR and the tail only by the main loop. Both
+// are 8-bit so are read and written atomically, and are allowed to wrap freely
+// with the size of the ring a power of two that divides 256; no locking is needed.
+// When the ring is full, the new edge is dropped and `edge_overruns` incremented.
+
+#define EDGE_RING_SIZE 32
+
+volatile unsigned int edge_ring[EDGE_RING_SIZE];
+volatile uint8_t edge_head, edge_tail;
+volatile uint8_t edge_overruns;
+
+// Timestamp of the edge most recently retrieved by the main loop.
+unsigned int edge_timestamp;
+
+// Record an edge at the given timestamp.
+//
+// Places the timestamp in the ring, moves the loss of signal timeout along,
+// and clears any loss of signal status.
+__attribute__((always_inline))
+static inline void
+dcc_edge(unsigned int timestamp)
+{
+    uint8_t head = edge_head;
+    if ((uint8_t)(head - edge_tail) < EDGE_RING_SIZE) {
+        edge_ring[head % EDGE_RING_SIZE] = timestamp;
+        edge_head = head + 1;
+    } else {
+        ++edge_overruns;
+    }
+    OCR1A = timestamp + DCC_SIGNAL_TIMEOUT;
+#if ADC_SYNC
+    // Restart TIMER0 as though from the edge, rather than this ISR.
+    TCNT0 = TCNT1 - timestamp;
+#endif
+
+    if (bit_is_set(condition, NO_SIGNAL)) {
+        condition_clear(_BV(NO_SIGNAL));
+        condition_report();
+    }
+}
+#endif  // DCC_DECODE_IN_ISR
+
+#if DCC_ICP
+// TIMER1 Input Capture Interrupt.
+// Fires when the input signal on ICP1 (B0) changes.
+//
+// Reads the timestamp latched in ICR1, and flips the edge to be captured next.
+ISR(TIMER1_CAPT_vect)
+{
+    unsigned int timestamp = ICR1;
+
+    // Changing the edge can set the input capture flag, so clear it afterwards.
+    TCCR1B ^= _BV(ICES1);
+    TIFR1 = _BV(ICF1);
+
+    dcc_edge(timestamp);
+}
+#else
+// INT0 Interrupt.
+// Fires when the input signal on INT0 (D2) changes.
+//
+// Reads the timestamp from TCNT1.
+ISR(INT0_vect)
+{
+    dcc_edge(TCNT1);
+}
+#endif
+
+// TIMER1 Comparison Interrupt.
+// Fires when TIMER1 reaches OCR1A.
+//
+// Indicates a timeout waiting for the input signal to change.
+ISR(TIMER1_COMPA_vect)
+{
+    if (!bit_is_set(condition, NO_SIGNAL)) {
+        condition_set(_BV(NO_SIGNAL));
+        condition_report();
+    }
+}
+
+#if DCC_DECODE_IN_ISR
+// Wait for a packet and copy it into `packet`, or for other work for the
+// main loop; returns non-zero if there was a packet.
+static inline uint8_t
+wait_for_packet(struct dcc_packet *packet)
+{
+    uint8_t tail = packet_tail;
+
+    if (!sleep_until(&packet_head, tail))
+        return 0;
+
+    // The ISR won't write to this entry until we advance the tail past it.
+    *packet = packet_ring[tail % PACKET_RING_SIZE];
+    packet_tail = tail + 1;
+    return 1;
+}
+#else  // DCC_DECODE_IN_ISR
+// Wait for an edge and set `length` to the length since the previous one, or
+// for other work for the main loop; returns non-zero if there was an edge.
+// The edge's timestamp is left in `edge_timestamp`.
+static inline uint8_t
+wait_for_edge(unsigned int *length)
+{
+    unsigned int timestamp;
+    uint8_t tail = edge_tail;
+
+    if (!sleep_until(&edge_head, tail))
+        return 0;
+
+    // The ISR won't write to this entry until we advance the tail past it.
+    timestamp = edge_ring[tail % EDGE_RING_SIZE];
+    edge_tail = tail + 1;
+
+    *length = timestamp - edge_timestamp;
+    edge_timestamp = timestamp;
+
+    return 1;
+}
+#endif  // DCC_DECODE_IN_ISR
+
+
+// MARK: RailCom Cutout Generation
+
+// RailCom Cutout
+// --------------
+// The RailCom cutout is a gap in the DCC signal where no power is present
+// on the track, during which the decoder can transmit its own signal.
+//
+//    _   _              _   _
+//  _| |_| '-++--++++-._| |_| |_
+//
+// We generate the cutout after we see the packet end bit to a valid packet,
+// from 26µs to 454µs after the edge that ends it. Since TIMER1 is already
+// counting freely, the cutout start and end are scheduled on it as absolute
+// compare values from the timestamp of that edge, using OCR1B for both; the
+// ISR for the start moves the compare value along to the end, and the ISR for
+// the end disables the interrupt again, so each cutout takes exactly two
+// interrupts with no overflow counting.
+//
+// The main loop, or the edge ISR when built with DCC_DECODE_IN_ISR, must
+// schedule the cutout before its start has passed, or the compare won't
+// match until the timer wraps, so a late cutout is skipped.
+
+// Inherent processing delay between the compare match and the change to the
+// H-Bridge Output pins taking effect, in µs, for entering the ISR. Subtracted
+// from compare values to get the right period for the RailCom cutout.
+//
+// When built with RAILCOM_CALIBRATE this is only the starting point, and the
+// ISR measures the real delay on TIMER1 for each cutout, which is averaged
+// and subtracted instead, so that it tracks changes in ISR load and code
+// generation; the cutout is then aimed a little later, at 28µs, so that
+// jitter either side of the average still lands within the permitted
+// 26-32µs. The measured delay is reported every 256 cutouts.
+//
+// This can't account for the latency of the edge timestamp itself, which is
+// zero when built with DCC_ICP.
+#define RAILCOM_DELAY 2
+
+#if RAILCOM_CALIBRATE
+#define RAILCOM_START  DCC_TICKS(28)
+#else
+#define RAILCOM_START  DCC_RAILCOM_START
+#endif
+#define RAILCOM_END    DCC_RAILCOM_END
+
+// Average delay in ticks, with RAILCOM_DELAY_SHIFT bits of fraction.
+#define RAILCOM_DELAY_SHIFT  3
+uint16_t railcom_delay = DCC_TICKS(RAILCOM_DELAY) << RAILCOM_DELAY_SHIFT;
+
+#if RAILCOM_CALIBRATE
+// Delay measured by the ISR for the last cutout, zero once averaged.
+volatile uint8_t railcom_latency;
+uint8_t railcom_cutouts;
+#endif
+
+// Compare value for the end of the scheduled cutout.
+unsigned int railcom_cutout_end;
+
+// Ticks from the packet end bit of the last cutout skipped for being
+// scheduled too late, and whether the average delay is due to be reported;
+// both are cleared once logged by the main loop, since the cutout may be
+// scheduled by the edge ISR.
+volatile uint16_t railcom_late_ticks;
+volatile uint8_t railcom_delay_due;
+
+#if RAILCOM_CALIBRATE
+// Fold the delay measured for the last cutout into the average, and report
+// it periodically.
+static inline void
+railcom_calibrate()
+{
+    uint8_t latency = railcom_latency;
+    if (!latency)
+        return;
+
+    railcom_latency = 0;
+    railcom_delay += latency - (railcom_delay >> RAILCOM_DELAY_SHIFT);
+
+    if (!++railcom_cutouts)
+        railcom_delay_due = 1;
+}
+#else
+static inline void railcom_calibrate() {}
+#endif
+
+// Schedule the cutout following the packet end bit that ended at the given
+// timestamp.
+static inline void
+railcom_schedule(unsigned int timestamp)
+{
+    unsigned int start;
+    uint8_t delay, late;
+
+    railcom_calibrate();
+
+    delay = railcom_delay >> RAILCOM_DELAY_SHIFT;
+    start = timestamp + settings.railcom_start - delay;
+    railcom_cutout_end = timestamp + settings.railcom_end - delay;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // A match after clearing the flag still sets it again, so the
+        // interrupt fires as soon as it's enabled.
+        OCR1B = start;
+        TIFR1 = _BV(OCF1B);
+        late = (int)(TCNT1 - start) >= 0;
+        if (!late)
+            TIMSK1 |= _BV(OCIE1B);
+    }
+
+    if (late)
+        railcom_late_ticks = TCNT1 - timestamp;
+}
+
+// Log a cutout skipped for being late, and the average delay when due;
+// called from the main loop.
+static inline void
+railcom_poll()
+{
+    uint16_t late, delay = 0;
+    uint8_t due;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        late = railcom_late_ticks;
+        railcom_late_ticks = 0;
+
+        due = railcom_delay_due;
+        railcom_delay_due = 0;
+        if (due)
+            delay = railcom_delay >> RAILCOM_DELAY_SHIFT;
+    }
+
+    if (late)
+        log_u16(LOG_CUTOUT_LATE, late);
+    if (due)
+        log_u16(LOG_RAILCOM_DELAY, delay);
+}
+
+// TIMER1 Comparison Interrupt B.
+// Fires when TIMER1 reaches OCR1B.
+//
+// Starts the RailCom cutout and moves the compare value to its end, or stops
+// it. With RAILCOM_CALIBRATE the time since the match is measured straight
+// after the output change.
+ISR(TIMER1_COMPB_vect)
+{
+    if (!bit_is_set(condition, CUTOUT)) {
+        condition_set(_BV(CUTOUT));
+#if RAILCOM_CALIBRATE
+        railcom_latency = TCNT1 - OCR1B;
+#endif
+
+        OCR1B = railcom_cutout_end;
+    } else {
+        condition_clear(_BV(CUTOUT));
+
+        TIMSK1 &= ~_BV(OCIE1B);
+    }
+}
+
+
+// MARK: Fault Journal
+
+// Fault Journal
+// -------------
+// When built with FAULT_JOURNAL the booster keeps a journal in the EEPROM of
+// each change to its exception conditions, OVERHEAT, OVERLOAD and NO_SIGNAL,
+// with the time since startup and the peak current since the change before;
+// and checkpoints its counts of decoding errors every JOURNAL_CHECKPOINT_MS
+// while they're changing. The journal survives resets and loss of power, and
+// is sent by the journal command as journal telemetry records.
+//
+// The journal is a ring of JOURNAL_RECORDS fixed-size records at the top of
+// the EEPROM, above the settings, and each record is written over the oldest
+// so that every slot wears at the same rate; checkpoints alone rewrite each
+// slot only every fifteen hours, well within the EEPROM's endurance of
+// 100,000 writes.
+//
+// Each record carries a sequence number and a CRC-8, and the sequence number
+// at the start of the record is written last; at startup the newest record is
+// found as the valid record with the latest sequence number, and the next is
+// written after it. A record torn by a reset or loss of power part way
+// through writing fails its CRC and is ignored, losing only that record and
+// the oldest it was replacing, never the rest of the journal.
+//
+// The ISRs only queue changes of condition, record the peak current, and
+// count errors; the main loop writes records a byte at a time between edges
+// whenever the EEPROM is ready, so that it never waits for the 3.4ms write of
+// a byte. While records are queued, being written, or dumped, the TIMER1
+// overflow tick also wakes the main loop, so that without a DCC signal
+// records are still written, at a byte each tick, and dumps still sent.
+
+#if FAULT_JOURNAL
+// Slots in the ring, leaving room below for the settings to grow.
+#define JOURNAL_RECORDS  62
+#define JOURNAL_OFFSET   (E2END + 1 - JOURNAL_RECORDS * sizeof(struct journal_record))
+
+#define JOURNAL_QUEUE_SIZE  4
+
+#define JOURNAL_CHECKPOINT_MS  900000
+
+// The matching table for the Pi is `BoosterJournalRecord` in the DCC module,
+// and the two must be kept in sync.
+enum journal_type {
+    // Firmware has started; data is the MCUSR reset flags.
+    JOURNAL_START = 0x01,
+    // Exception conditions changed; data is the condition bitmask, without
+    // the cutout, the peak current since the change before, and the number of
+    // changes dropped before this one because the queue was full.
+    JOURNAL_CONDITION = 0x02,
+    // Checkpoint of the decoding errors; data is the 16-bit counts since
+    // startup of BAD LEN, BAD MATCH, BAD DELTA and ERR results, which stop
+    // at their maximum.
+    JOURNAL_ERRORS = 0x03,
+};
+
+enum journal_error {
+    JOURNAL_BAD_LEN,
+    JOURNAL_BAD_MATCH,
+    JOURNAL_BAD_DELTA,
+    JOURNAL_ERR,
+    JOURNAL_ERROR_COUNTS
+};
+
+struct journal_record {
+    uint16_t sequence;
+    uint8_t type;
+    // TIMER1 overflows since startup.
+    uint32_t ticks;
+    uint8_t data[8];
+    uint8_t crc;
+};
+
+// Entry queued by an ISR for the main loop to write.
+struct journal_entry {
+    uint8_t type;
+    uint8_t data[3];
+    uint32_t ticks;
+};
+
+volatile uint32_t journal_ticks;
+
+// Peak current since the last condition journalled, and that condition.
+volatile uint8_t journal_peak;
+uint8_t journal_last;
+
+volatile struct journal_entry journal_queue[JOURNAL_QUEUE_SIZE];
+volatile uint8_t journal_head, journal_tail;
+volatile uint8_t journal_dropped;
+
+volatile uint16_t journal_errors[JOURNAL_ERROR_COUNTS];
+
+// Counts in the last checkpoint, and when it was taken.
+uint16_t journal_checkpoint_errors[JOURNAL_ERROR_COUNTS];
+uint32_t journal_checkpoint_ticks;
+
+// Record being written to the slot, and the number of bytes written so far;
+// once complete, the slot and sequence number are those of the next record.
+struct journal_record journal_record;
+volatile uint8_t journal_written = sizeof journal_record;
+uint8_t journal_slot;
+uint16_t journal_sequence;
+
+// Whether a dump is in progress, the number of slots sent so far, and the
+// low byte of the tick at which the last record was sent.
+volatile uint8_t journal_dumping;
+uint8_t journal_dumped;
+uint8_t journal_dump_tick;
+
+static inline struct journal_record *
+journal_address(uint8_t slot)
+{
+    return (struct journal_record *)JOURNAL_OFFSET + slot;
+}
+
+// Return the CRC-8 of the record, up to the CRC itself.
+static uint8_t
+journal_crc(const struct journal_record *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < offsetof(struct journal_record, crc); ++i)
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    return crc;
+}
+
+// Read the record in the given slot into `record`; returns zero if the slot
+// is erased or the record torn.
+static uint8_t
+journal_read(uint8_t slot, struct journal_record *record)
+{
+    eeprom_read_block(record, journal_address(slot), sizeof *record);
+    return record->type >= JOURNAL_START && record->type <= JOURNAL_ERRORS
+        && record->crc == journal_crc(record);
+}
+
+// Queue an entry of the given type with the first two bytes of data, the
+// count of entries dropped before it, and the current tick; called with
+// interrupts disabled.
+static inline void
+journal_push(uint8_t type, uint8_t a, uint8_t b)
+{
+    uint8_t head = journal_head;
+    if ((uint8_t)(head - journal_tail) < JOURNAL_QUEUE_SIZE) {
+        volatile struct journal_entry *entry = &journal_queue[head % JOURNAL_QUEUE_SIZE];
+        entry->type = type;
+        entry->data[0] = a;
+        entry->data[1] = b;
+        entry->data[2] = journal_dropped;
+        entry->ticks = journal_ticks;
+        journal_dropped = 0;
+        journal_head = head + 1;
+    } else if (journal_dropped < 0xff) {
+        ++journal_dropped;
+    }
+}
+
+// Find the newest record to continue the journal after, and queue a start
+// record; called before interrupts are enabled.
+static inline void
+journal_init()
+{
+    struct journal_record record;
+    uint8_t newest = JOURNAL_RECORDS;
+
+    for (uint8_t slot = 0; slot < JOURNAL_RECORDS; ++slot) {
+        if (!journal_read(slot, &record))
             continue;
+
+        // Sequence numbers wrap, but those in the ring are never further
+        // apart than its size.
+        if (newest == JOURNAL_RECORDS || (int16_t)(record.sequence - journal_sequence) > 0) {
+            newest = slot;
+            journal_sequence = record.sequence;
+        }
+    }
+
+    if (newest < JOURNAL_RECORDS) {
+        journal_slot = (newest + 1) % JOURNAL_RECORDS;
+        ++journal_sequence;
+    }
+
+    journal_push(JOURNAL_START, MCUSR, 0);
+    MCUSR = 0;
+}
+
+// Queue a record of the given condition, if the exception conditions have
+// changed since the last.
+//
+// Atomic so that it may be used from both ISRs and the main loop.
+static inline void
+journal_condition(uint8_t value)
+{
+    value &= ~_BV(CUTOUT);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (value != journal_last) {
+            journal_last = value;
+            journal_push(JOURNAL_CONDITION, value, journal_peak);
+            journal_peak = 0;
+        }
+    }
+}
+
+// Record the current sample just taken; called from the ADC ISR.
+static inline void
+journal_sample(uint8_t value)
+{
+    if (value > journal_peak)
+        journal_peak = value;
+}
+
+// Count a tick, and wake the main loop if there's journal work for it;
+// called from the TIMER1 overflow ISR.
+static inline void
+journal_tick()
+{
+    ++journal_ticks;
+
+    if (journal_written < sizeof journal_record || journal_dumping
+        || journal_head != journal_tail)
+        main_wakeup = 1;
+}
+
+// Count the result of decoding a period, if it's one of the errors
+// checkpointed.
+static inline void
+journal_decode(enum dcc_result result)
+{
+    volatile uint16_t *count;
+
+    switch (result) {
+        case DCC_BAD_LEN:
+            count = &journal_errors[JOURNAL_BAD_LEN];
+            break;
+        case DCC_BAD_MATCH:
+            count = &journal_errors[JOURNAL_BAD_MATCH];
+            break;
+        case DCC_BAD_DELTA:
+            count = &journal_errors[JOURNAL_BAD_DELTA];
+            break;
+        case DCC_ERR:
+            count = &journal_errors[JOURNAL_ERR];
+            break;
+        default:
+            return;
+    }
+
+    if (*count != UINT16_MAX)
+        ++*count;
+}
+
+// Start writing the next queued entry, or a checkpoint of the error counts
+// if one is due and they've changed.
+static inline void
+journal_begin()
+{
+    uint8_t tail = journal_tail;
+
+    if (journal_head != tail) {
+        // The ISRs won't write to this entry until we advance the tail past it.
+        volatile struct journal_entry *entry = &journal_queue[tail % JOURNAL_QUEUE_SIZE];
+
+        memset(journal_record.data, 0, sizeof journal_record.data);
+        journal_record.type = entry->type;
+        journal_record.ticks = entry->ticks;
+        for (uint8_t i = 0; i < sizeof entry->data; ++i)
+            journal_record.data[i] = entry->data[i];
+        journal_tail = tail + 1;
+    } else {
+        uint16_t errors[JOURNAL_ERROR_COUNTS];
+        uint32_t ticks;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            ticks = journal_ticks;
+            memcpy(errors, (const uint16_t *)journal_errors, sizeof errors);
+        }
+        if (ticks - journal_checkpoint_ticks < TICKS(JOURNAL_CHECKPOINT_MS)
+            || !memcmp(errors, journal_checkpoint_errors, sizeof errors))
+            return;
+
+        journal_checkpoint_ticks = ticks;
+        memcpy(journal_checkpoint_errors, errors, sizeof errors);
+
+        journal_record.type = JOURNAL_ERRORS;
+        journal_record.ticks = ticks;
+        memcpy(journal_record.data, errors, sizeof errors);
+    }
+
+    journal_record.sequence = journal_sequence;
+    journal_record.crc = journal_crc(&journal_record);
+    journal_written = 0;
+}
+
+// Write the next byte of the record being written to its slot.
+static inline void
+journal_write()
+{
+    // Start after the sequence number, so that it's written last.
+    uint8_t offset = (journal_written + sizeof journal_record.sequence) % sizeof journal_record;
+
+    eeprom_update_byte((uint8_t *)journal_address(journal_slot) + offset,
+                       ((const uint8_t *)&journal_record)[offset]);
+
+    if (++journal_written == sizeof journal_record) {
+        journal_slot = (journal_slot + 1) % JOURNAL_RECORDS;
+        ++journal_sequence;
+    }
+}
+
+#if DEBUG
+// Begin sending the journal, for the journal command.
+static inline void
+journal_dump_start()
+{
+    journal_dumping = 1;
+    journal_dumped = 0;
+    journal_dump_tick = journal_ticks - 1;
+}
+
+// Send the next record of the journal, oldest first from the slot to be
+// written next, and at most one each tick so as not to fill the UART; erased
+// and torn slots are skipped. Writing is held off until the dump finishes, so
+// the slots don't move under it.
+static inline void
+journal_dump()
+{
+    struct journal_record record;
+    uint8_t tick = journal_ticks;
+
+    if (tick == journal_dump_tick)
+        return;
+
+    if (journal_dumped == JOURNAL_RECORDS) {
+        telemetry_send(TELEMETRY_JOURNAL, NULL, 0);
+        journal_dumping = 0;
+        return;
+    }
+
+    if (journal_read((journal_slot + journal_dumped++) % JOURNAL_RECORDS, &record)) {
+        telemetry_send(TELEMETRY_JOURNAL, &record, offsetof(struct journal_record, crc));
+        journal_dump_tick = tick;
+    }
+}
+#else  // DEBUG
+static inline void journal_dump() {}
+#endif  // DEBUG
+
+// Continue writing the record in progress, a byte at a time, sending a dump,
+// or starting the next record; called from the main loop.
+static inline void
+journal_poll()
+{
+    if (!eeprom_is_ready())
+        return;
+
+    if (journal_written < sizeof journal_record) {
+        journal_write();
+    } else if (journal_dumping) {
+        journal_dump();
+    } else {
+        journal_begin();
+    }
+}
+#else  // FAULT_JOURNAL
+static inline void journal_init() {}
+static inline void journal_condition(uint8_t value) {}
+static inline void journal_sample(uint8_t value) {}
+static inline void journal_tick() {}
+static inline void journal_decode(enum dcc_result result) {}
+static inline void journal_poll() {}
+#endif  // FAULT_JOURNAL
+
+
+// MARK: Command Channel
+
+// Command Channel
+// ---------------
+// Commands from the Pi, see command.h, are received a byte at a time by the
+// USART RX ISR, and each frame is handed to the main loop when its
+// terminating zero arrives; frames that arrive before the main loop has
+// handled the last, that are too long, or that have errors, are discarded.
+// The ISR wakes the main loop to handle the frame, so commands are handled
+// with or without a DCC signal.
+//
+// Settings are saved at the start of the EEPROM with a version byte and a
+// CRC-8, and loaded at startup when both match and the settings are valid;
+// otherwise the defaults are used. Writing the EEPROM takes over 3ms per
+// changed byte, so saving loses edges, and the decoder resynchronizes.
+//
+// Only debug builds have the command channel, since the UART is otherwise
+// unused, but all builds load saved settings.
+
+#define SETTINGS_VERSION  1
+
+enum setting {
+#define _(name, ident, type, field, initial, min, max) name = ident,
+    SETTINGS(_)
+#undef _
+};
+
+struct settings settings = {
+#define _(name, ident, type, field, initial, min, max) .field = initial,
+    SETTINGS(_)
+#undef _
+};
+
+struct settings_eeprom {
+    uint8_t version;
+    struct settings settings;
+    uint8_t crc;
+};
+
+struct settings_eeprom settings_eeprom EEMEM;
+
+#if FAULT_JOURNAL
+_Static_assert(sizeof settings_eeprom <= JOURNAL_OFFSET, "settings overlap the fault journal");
+#endif
+
+// Fill in the default settings.
+static inline void
+settings_default(struct settings *values)
+{
+#define _(name, ident, type, field, initial, min, max) values->field = initial;
+    SETTINGS(_)
+#undef _
+}
+
+// Return whether the settings are all within their permitted ranges, and
+// consistent with each other.
+static uint8_t
+settings_valid(const struct settings *values)
+{
+#define _(name, ident, type, field, initial, min, max) \
+    if (values->field < (min) || values->field > (max)) \
+        return 0;
+    SETTINGS(_)
+#undef _
+
+    return values->current_rating < values->hard_overload
+        && values->railcom_start < values->railcom_end;
+}
+
+// Place the value of the setting with the given identifier in `value`;
+// returns zero if there is no such setting.
+static uint8_t
+settings_get(const struct settings *values, uint8_t id, uint16_t *value)
+{
+    switch (id) {
+#define _(name, ident, type, field, initial, min, max) \
+        case name: \
+            *value = values->field; \
+            return 1;
+        SETTINGS(_)
+#undef _
+        default:
+            return 0;
+    }
+}
+
+// Change the setting with the given identifier to `value`; returns zero if
+// there is no such setting, or the value is outside its permitted range.
+static uint8_t
+settings_put(struct settings *values, uint8_t id, uint16_t value)
+{
+    switch (id) {
+#define _(name, ident, type, field, initial, min, max) \
+        case name: \
+            if (value < (min) || value > (max)) \
+                return 0; \
+            values->field = value; \
+            return 1;
+        SETTINGS(_)
+#undef _
+        default:
+            return 0;
+    }
+}
+
+// Make the given settings current, along with the values derived from them.
+static void
+settings_apply(const struct settings *values)
+{
+    uint16_t rating = I2T_SQUARE(values->current_rating);
+    uint32_t limit = I2T_LIMIT(values->hard_overload, values->current_rating);
+    uint16_t off_ticks = TICKS(values->recovery_off_ms);
+    uint16_t probation_ticks = TICKS(values->recovery_probation_ms);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        settings = *values;
+        current_i2t_rating = rating;
+        current_i2t_limit = limit;
+        recovery_off_ticks = off_ticks;
+        recovery_probation_ticks = probation_ticks;
+        dcc_one_delta = values->dcc_one_delta;
+    }
+    telemetry_set_flags(values->telemetry);
+}
+
+// Return the CRC-8 of the settings.
+static uint8_t
+settings_crc(const struct settings *values)
+{
+    const uint8_t *bytes = (const uint8_t *)values;
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < sizeof *values; ++i)
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    return crc;
+}
+
+// Load the saved settings, or the defaults.
+static inline void
+settings_init()
+{
+    struct settings_eeprom saved;
+
+    eeprom_read_block(&saved, &settings_eeprom, sizeof saved);
+    if (saved.version != SETTINGS_VERSION
+        || saved.crc != settings_crc(&saved.settings)
+        || !settings_valid(&saved.settings))
+        settings_default(&saved.settings);
+
+    settings_apply(&saved.settings);
+}
+
+// Save the current settings.
+static inline void
+settings_save()
+{
+    struct settings_eeprom saved;
+
+    saved.version = SETTINGS_VERSION;
+    saved.settings = settings;
+    saved.crc = settings_crc(&saved.settings);
+    eeprom_update_block(&saved, &settings_eeprom, sizeof saved);
+}
+
+#if DEBUG
+// Bytes of the frame being received, and its length; set past the maximum
+// to discard the rest of a frame.
+uint8_t rx_frame[COMMAND_MAX_FRAME];
+uint8_t rx_length;
+
+// Bytes of the last frame received, without the terminating zero, for the
+// main loop; the length is cleared by the main loop once it has been
+// handled.
+uint8_t command_frame[COMMAND_MAX_FRAME];
+volatile uint8_t command_length;
+
+static inline void
+command_init()
+{
+    // The UART leaves receiving disabled, since the detector only receives
+    // during the cutout.
+    UCSR0B |= _BV(RXEN0);
+}
+
+// USART RX Complete Interrupt
+// Fires when a newly received byte is available in UDR0.
+//
+// Collate command frames.
+ISR(USART_RX_vect)
+{
+    uint8_t status, data;
+
+    status = UCSR0A;
+    data = UDR0;
+
+    if (status & (_BV(FE0) | _BV(DOR0) | _BV(UPE0))) {
+        rx_length = COMMAND_MAX_FRAME + 1;
+    } else if (data) {
+        if (rx_length < COMMAND_MAX_FRAME) {
+            rx_frame[rx_length++] = data;
+        } else {
+            rx_length = COMMAND_MAX_FRAME + 1;
+        }
+    } else {
+        if (rx_length <= COMMAND_MAX_FRAME && !command_length) {
+            memcpy(command_frame, rx_frame, rx_length);
+            command_length = rx_length;
+            main_wakeup = 1;
         }
+        rx_length = 0;
+    }
+}
+
+// Decode a COBS frame, without its terminating zero, in place; returns the
+// decoded length, or zero if malformed.
+static uint8_t
+command_unstuff(uint8_t *frame, uint8_t length)
+{
+    uint8_t index = 0, decoded = 0;
+
+    while (index < length) {
+        uint8_t code = frame[index];
+        if (!code || code > length - index)
+            return 0;
+
+        for (uint8_t i = 1; i < code; ++i)
+            frame[decoded++] = frame[index + i];
+        index += code;
+
+        // Each code, except the maximum, replaced a zero; but the final one
+        // was the terminator.
+        if (code < 0xff && index < length)
+            frame[decoded++] = 0;
+    }
+
+    return decoded;
+}
+
+// Send a setting record for the setting with the given identifier.
+static inline void
+command_report(uint8_t id, uint16_t value)
+{
+    uint8_t payload[3];
+
+    payload[0] = id;
+    memcpy(payload + 1, &value, 2);
+    telemetry_send(TELEMETRY_SETTING, payload, sizeof payload);
+}
+
+// Handle the decoded command.
+static inline void
+command_handle(const uint8_t *command, uint8_t length)
+{
+    struct settings values = settings;
+    uint16_t value;
 
-        // Each bit has two periods, how we react to each depends on whether we've
-        // detected the end of the preamble (and thus sychronized the phase), and
-        // which phase that is.
-        switch (state) {
-            case SEEKING_PREAMBLE:
-                // When we're looking for a preamble, we're looking for the first
-                // stretch of at least 10 full one-bits, terminated by a full
-                // zero-bit.
-                if (bit) {
-                    ++preamble_half_bits;
-                } else if (preamble_half_bits >= 20) {
-                    // End of preamble found, the next state is to consume the
-                    // second half of the zero bit.
-                    state = PACKET_START;
-                } else {
-                    preamble_half_bits = 0;
-                }
+    switch (length ? command[0] : 0) {
+        case COMMAND_GET:
+            if (length != 2 || !settings_get(&values, command[1], &value))
                 break;
-            case PACKET_START:
-                // If we see anything other than a zero high or low period here it means
-                // we misdetected a period as a zero that shouldn't be, so return
-                // back to seeking the preamble.
-                if (bit) {
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                } else {
-                    bitmask = 1 << 7;
-                    check_byte = 0;
-                    state = PACKET_A;
-                }
+
+            command_report(command[1], value);
+            return;
+        case COMMAND_SET:
+            if (length != 4)
+                break;
+
+            memcpy(&value, command + 2, 2);
+            if (!settings_put(&values, command[1], value) || !settings_valid(&values))
+                break;
+
+            settings_apply(&values);
+            command_report(command[1], value);
+            return;
+        case COMMAND_SAVE:
+            if (length != 1)
+                break;
+
+            settings_save();
+            log_message(LOG_SETTINGS_SAVED);
+            return;
+        case COMMAND_DEFAULTS:
+            if (length != 1)
                 break;
-            case PACKET_A:
-                // First period in a bit, save which bit it was and the length,
-                // so we can double-check in the second phase next cycle.
-                last_bit = bit;
-                last_length = length;
-                state = PACKET_B;
+
+            settings_default(&values);
+            settings_apply(&values);
+            log_message(LOG_SETTINGS_DEFAULT);
+            return;
+        case COMMAND_RESET:
+            if (length != 1)
                 break;
-            case PACKET_B:
-                if (last_bit != bit) {
-                    // Bits must match between phases; if they don't, we've probably
-                    // gone out of phase, so resynchronize again.
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                    uprintf(" \aBAD MATCH %c%c\r\n", last_bit ? 'H' : 'L', bit ? 'H': 'L');
-                } else if (bit && DELTA(length, last_length) > 6 * 2) {
-                    // Double-check the delta of one-bit phases, if we go out of spec,
-                    // treat it the same as if we had non-matching bits and
-                    // resynchronize the phase.
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                    uprintf(" \aBAD DELTA %u %u\r\n", last_length, length);
-                } else if (bitmask) {
-                    // Within the packet there are eight bits to a byte, followed by
-                    // a zero-bit or a one-bit that determines whether more bytes
-                    // follow, or a preamble.
-                    if (bit) {
-                        byte |= bitmask;
-                    } else {
-                        byte &= ~bitmask;
-                    }
-                    bitmask >>= 1;
-                    state = PACKET_A;
-                    uputc(bit ? '1' : '0');
-                } else if (!bit) {
-                    // Zero-bit goes between bytes, accumulate the check byte
-                    // and prepare for the next.
-                    check_byte ^= byte;
-                    bitmask = 1 << 7;
-                    state = PACKET_A;
-                    uputc(' ');
-                } else if (byte != check_byte) {
-                    // Check byte doesn't match, but we otherwise kept sychronisation.
-                    // Assume we can carry on, and go back to dumb preamble seeking mode
-                    // and hope the next time the packet is sent, it comes in fine.
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                    uputs(" \aERR\r\n");
-                } else {
-                    // Check byte matches the error check byte in the stream.
-                    railcom_timer_start();
-
-                    // Now we've reached the end of a packet, and go back into
-                    // dumb preamble seeking mode.
-                    state = SEEKING_PREAMBLE;
-                    preamble_half_bits = 0;
-                    uputs(" OK\r\n");
-                }
+
+            recovery_reset();
+            return;
+#if FAULT_JOURNAL
+        case COMMAND_JOURNAL:
+            if (length != 1)
                 break;
+
+            journal_dump_start();
+            return;
+#endif
+    }
+
+    log_u8_u8(LOG_BAD_COMMAND, length ? command[0] : 0, length > 1 ? command[1] : 0);
+}
+
+// Handle the last command frame received, if there is one; called from the
+// main loop.
+static inline void
+command_poll()
+{
+    uint8_t length = command_length;
+    if (!length)
+        return;
+
+    length = command_unstuff(command_frame, length);
+    command_handle(command_frame, length);
+    command_length = 0;
+}
+#else  // DEBUG
+static inline void command_init() {}
+static inline void command_poll() {}
+#endif  // DEBUG
+
+
+// MARK: Main Loop
+
+// Main Loop
+// ---------
+// Edges are retrieved from the ISR and passed to the DCC decoder, which
+// synchronizes to the phase of the signal and extracts packets from it; see
+// dcc_decoder.c for the details. Decoded packets and errors are sent as
+// telemetry records.
+//
+// Between edges the CPU is put into idle sleep, which keeps the timers, ADC
+// and USART running, and is woken by any of their interrupts as well as the
+// DCC input; waking adds 4 cycles to the response to the interrupt. The time
+// spent awake for each edge is sent periodically as a telemetry record, as a
+// measure of how much headroom the main loop has.
+//
+// ISRs that leave other work for the main loop, such as a command frame or
+// a condition to report, set `main_wakeup` so that it also wakes, and runs
+// its polls, while there is no DCC signal.
+//
+// When built with DCC_DECODE_IN_ISR the decoder is instead run by the edge
+// ISR, and the main loop only waits for valid packets to send, and reports
+// the counts of dropped packets and decoding errors when they change; the
+// awake time is then for each packet.
+
+int
+main()
+{
+    // Configure with interrupts disabled, enabling them at the end; the timer
+    // is only started after, so no edges are held off.
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        // To save power, enable pull-ups on all pins we're not using as input.
+#if DCC_ICP
+        PORTB = ~_BV(DCC);
+        PORTC = PORTD = ~0;
+#else
+        PORTB = PORTC = ~0;
+        PORTD = ~_BV(DCC);
+#endif
+
+        settings_init();
+        output_init();
+        input_init();
+        current_init();
+        dcc_init();
+        dcc_decoder_init();
+        recovery_init();
+        journal_init();
+        uart_init();
+        command_init();
+        set_sleep_mode(SLEEP_MODE_IDLE);
+    }
+
+    output_set();
+    dcc_timer_start();
+
+    telemetry_send(TELEMETRY_START, NULL, 0);
+    condition_report();
+
+#if DCC_DECODE_IN_ISR
+    uint8_t last_overruns = 0, last_errors = 0;
+    for (;;) {
+        // Wait for a packet from the input ISR and copy it, or other work.
+        struct dcc_packet packet;
+        uint8_t received = wait_for_packet(&packet);
+
+        uint8_t overruns = packet_overruns;
+        if (overruns != last_overruns) {
+            last_overruns = overruns;
+            log_u8(LOG_PACKET_OVERRUN, overruns);
+        }
+
+        uint8_t errors = decode_errors;
+        if (errors != last_errors) {
+            last_errors = errors;
+            log_u8(LOG_DECODE_ERRORS, errors);
+        }
+
+        if (received && (settings.telemetry & TELEMETRY_SEND_PACKETS))
+            telemetry_send(TELEMETRY_PACKET, packet.data, packet.length);
+        condition_poll();
+        recovery_poll();
+        railcom_poll();
+        probe_poll();
+        ack_poll();
+        journal_poll();
+        command_poll();
+        telemetry_poll();
+    }
+#else  // DCC_DECODE_IN_ISR
+    uint8_t last_overruns = 0;
+    for (;;) {
+        // Wait for an edge from the input ISR and copy the length of the
+        // period, or other work.
+        unsigned int length;
+        if (wait_for_edge(&length)) {
+            // If the ring overran, edges were lost since the last one and we
+            // can no longer trust the phase, so resynchronize.
+            uint8_t overruns = edge_overruns;
+            if (overruns != last_overruns) {
+                last_overruns = overruns;
+                dcc_decoder_reset();
+                telemetry_overrun(overruns);
+            }
+
+            enum dcc_result result = dcc_decode(length);
+            if (result == DCC_PACKET) {
+                // Check byte matches the error check byte in the stream.
+                railcom_schedule(edge_timestamp);
+                probe_check(&dcc_decoder.packet, edge_timestamp);
+                ack_check(&dcc_decoder.packet);
+            }
+            telemetry_decode(result, length);
+            journal_decode(result);
         }
+        condition_poll();
+        recovery_poll();
+        railcom_poll();
+        probe_poll();
+        ack_poll();
+        journal_poll();
+        command_poll();
+        telemetry_poll();
     }
+#endif  // DCC_DECODE_IN_ISR
 }
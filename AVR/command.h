@@ -0,0 +1,48 @@
+//
+//  command.h
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#ifndef SIGNALBOX_COMMAND_H
+#define SIGNALBOX_COMMAND_H
+
+#include <stdint.h>
+
+// Commands
+// --------
+// Commands are received over the UART as binary records, framed in the same
+// way as telemetry records with Consistent Overhead Byte Stuffing (COBS) and
+// a zero byte marking the end of each frame; see telemetry.h. Each consists
+// of a type byte followed by a payload that depends on the type, with
+// multi-byte values little-endian.
+//
+// The matching encoder for the Pi is `BoosterCommand` in the DCC module,
+// and the two must be kept in sync.
+
+// Maximum length of a command frame, including the COBS code byte and the
+// terminating zero.
+#define COMMAND_MAX_FRAME  8
+
+enum command_type {
+    // Read a setting; payload is the setting identifier. Answered with a
+    // setting telemetry record.
+    COMMAND_GET = 0x01,
+    // Change a setting; payload is the setting identifier and the 16-bit
+    // value. Answered with a setting telemetry record of the new value.
+    COMMAND_SET = 0x02,
+    // Save the current settings to the EEPROM; no payload.
+    COMMAND_SAVE = 0x03,
+    // Restore the default settings, without saving them; no payload.
+    COMMAND_DEFAULTS = 0x04,
+    // Send the fault journal of a booster built with FAULT_JOURNAL as journal
+    // telemetry records, oldest first, followed by an empty journal record;
+    // no payload.
+    COMMAND_JOURNAL = 0x05,
+    // Reset a lockout of the overload recovery, turning the outputs back on;
+    // no payload. Answered with an overload telemetry record of the state.
+    COMMAND_RESET = 0x06,
+};
+
+#endif  // SIGNALBOX_COMMAND_H
@@ -0,0 +1,397 @@
+//
+//  dcc_decoder.c
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#include "dcc_decoder.h"
+
+#include <stdint.h>
+
+
+// DCC Decoder
+// -----------
+// There are two basic passes to analyzing the incoming DCC signal.
+//
+// The first is to determine the phase; when we start to receive incoming
+// half-bits, we do not yet know whether the signal is in high-low or
+// low-high order, and thus do not know whether an edge is a boundary
+// between bits, or between a single bit's high and low parts.
+//
+// To synchronize we need to look for a point at which the period length
+// changes between that of a one-bit and a zero-bit:
+//
+//                   :
+//   _   _   _   _    __    __   _   _
+// _| |_| |_| |_| |__|  |__|  |_| |_| |
+//                   :
+//         length change means we
+//         must be now in Phase A
+//
+// Since the preamble that marks the start of a packet is a train of
+// one-bits followed by a zero-bit, we can combine both phase synchronization
+// and preamble detection into one pass. A suitably long sequence of one-bits
+// followed by the first period of a zero-bit gives us both the phase of the
+// signal and the start of a packet.
+//
+//
+// The second pass is packet and byte extraction. Due to the different byte
+// and packet end bits, the packet structure can be followed logically and
+// byte and packet boundaries followed provided the input conforms to
+// specification. The final byte is always a check byte, which we compare
+// against an accumulated xor of the previous bytes in the packet.
+//
+//    ?    preamble.   byte     byte  check byte
+//        +--------+ +------+ +------+ +------+
+// 1101000111111111101010101001111000000101101011111...
+//                  :        :        :        :
+//                  +--byte end bits--+    packet end bit
+//
+// This is called for every edge, so is written to have a small and bounded
+// number of cycles for any input: there are no loops, and period lengths are
+// classified with a single table lookup rather than a chain of 16-bit
+// comparisons.
+
+struct dcc_decoder dcc_decoder;
+
+uint8_t dcc_one_delta = DCC_ONE_DELTA;
+
+#if DCC_HISTOGRAM
+volatile uint16_t dcc_histogram[DCC_HISTOGRAM_SIZE];
+#endif
+
+enum parser_state {
+    SEEKING_PREAMBLE,
+    PACKET_START,
+    PACKET_A,
+    PACKET_B
+};
+
+// Absolute delta between two unsigned values.
+#define DELTA(_a, _b) ((_a) > (_b) ? (_a) - (_b) : (_b) - (_a))
+
+#if DCC_HISTOGRAM
+// Count a value in the histogram at the given offset, clamping it to the last
+// bucket.
+#define HISTOGRAM_COUNT(_histogram, _value) \
+    histogram_count(_histogram + ((_value) < _histogram##_SIZE - 1 ? (_value) : _histogram##_SIZE - 1))
+
+static inline void
+histogram_count(uint8_t bucket)
+{
+    uint16_t count = dcc_histogram[bucket];
+    if (count < UINT16_MAX)
+        dcc_histogram[bucket] = count + 1;
+}
+#else
+#define HISTOGRAM_COUNT(_histogram, _value)
+#endif
+
+#if DCC_CAPTURE
+// Start the capture timing of a packet with the first period of its
+// preamble, and include each period that follows.
+#define CAPTURE_START(_length) \
+    (dcc_decoder.capture_min_length = dcc_decoder.capture_max_length = (_length))
+#define CAPTURE_LENGTH(_length) capture_length(_length)
+
+static inline void
+capture_length(unsigned int length)
+{
+    if (length < dcc_decoder.capture_min_length)
+        dcc_decoder.capture_min_length = length;
+    if (length > dcc_decoder.capture_max_length)
+        dcc_decoder.capture_max_length = length;
+}
+#else
+#define CAPTURE_START(_length)
+#define CAPTURE_LENGTH(_length)
+#endif
+
+
+// MARK: Period Classification
+
+// Period Classification
+// ---------------------
+// The classification table is indexed by the period length shifted right by
+// DCC_CLASS_SHIFT, so each entry covers a bucket of ticks; both are generated
+// in dcc_timing.h, with the shift chosen as the smallest for which the table
+// reaches DCC_ZERO_MIN. Lengths beyond the end of the table are always
+// zero-bits. The values of the zero and one classes match the value of the
+// bit, so can be used directly.
+//
+// Where the boundary of a window falls within a bucket, the entry is marked
+// DCC_CLASS_CHECK and we fall back to comparing the length exactly; for the
+// standard windows at 0.5µs ticks this is only the bucket containing
+// DCC_ONE_MAX.
+
+#if DCC_ZERO_MIN > (DCC_CLASS_TABLE_SIZE << DCC_CLASS_SHIFT)
+#error "Classification table does not reach DCC_ZERO_MIN"
+#endif
+
+enum dcc_class {
+    DCC_CLASS_ZERO,
+    DCC_CLASS_ONE,
+    DCC_CLASS_INVALID,
+    DCC_CLASS_CHECK
+};
+
+static const uint8_t dcc_class_table[DCC_CLASS_TABLE_SIZE] = DCC_CLASS_TABLE;
+
+// Classify a period length by comparison.
+static uint8_t
+dcc_classify_exact(unsigned int length)
+{
+    if (length >= DCC_ZERO_MIN) {
+        return DCC_CLASS_ZERO;
+    } else if ((length >= DCC_ONE_MIN) && (length <= DCC_ONE_MAX)) {
+        return DCC_CLASS_ONE;
+    } else {
+        return DCC_CLASS_INVALID;
+    }
+}
+
+// Classify a period length using the table.
+static inline uint8_t
+dcc_classify(unsigned int length)
+{
+    if (length >= (DCC_CLASS_TABLE_SIZE << DCC_CLASS_SHIFT))
+        return DCC_CLASS_ZERO;
+
+    uint8_t class = dcc_class_table[length >> DCC_CLASS_SHIFT];
+    if (class == DCC_CLASS_CHECK)
+        class = dcc_classify_exact(length);
+
+    return class;
+}
+
+
+// MARK: Adaptive Timing
+
+// Adaptive Timing
+// ---------------
+// The windows above are the full ranges permitted by NMRA S-9.2, but our
+// command station always produces the same lengths. When built with
+// DCC_ADAPTIVE the decoder learns the centres of the one-bit periods from
+// each preamble, and of the zero-bit periods from the preambles and packets,
+// with an IIR filter that moves each 1/16th of the way towards the period.
+//
+// After DCC_ADAPTIVE_LOCK_PACKETS valid packets the windows are narrowed to
+// DCC_ADAPTIVE_ONE_MARGIN and DCC_ADAPTIVE_ZERO_MARGIN either side of the
+// centres, within the full windows, and periods outside them are rejected as
+// DCC_BAD_LEN. Corruption is then caught at the first bad period, rather than
+// by a later mismatch or the error detection byte, and a corrupt preamble
+// can't complete. The centres keep following the periods accepted, so track
+// slow drift of the command station's clock; if a real change moves them out
+// of the windows, DCC_ADAPTIVE_UNLOCK_REJECTS periods rejected without a
+// valid packet between them restore the full windows until the centres are
+// learned again.
+//
+// The preamble must still be at least DCC_PREAMBLE_HALF_BITS, since that's
+// the minimum S-9.2 permits a decoder to accept. Zero-bits stretched beyond
+// DCC_ADAPTIVE_ZERO_LEARN_MAX are not learned from, and are rejected once
+// the windows are narrowed.
+
+#if DCC_ADAPTIVE
+#define DCC_ADAPTIVE_ONE_MARGIN      DCC_TICKS(3)
+#define DCC_ADAPTIVE_ZERO_MARGIN     DCC_TICKS(6)
+#define DCC_ADAPTIVE_ZERO_LEARN_MAX  DCC_TICKS(200)
+#define DCC_ADAPTIVE_UNLOCK_REJECTS  8
+
+#define ADAPTIVE_LOCKED  (dcc_decoder.adaptive_packets >= DCC_ADAPTIVE_LOCK_PACKETS)
+#define ADAPTIVE_PERIOD(_bit, _length) adaptive_period(_bit, _length)
+#define ADAPTIVE_PACKET() adaptive_packet()
+
+// Check a period of the given bit against the narrowed windows, and learn
+// from it; returns zero if it was rejected.
+static inline uint8_t
+adaptive_period(uint8_t bit, unsigned int length)
+{
+    uint16_t *centre = bit ? &dcc_decoder.adaptive_one : &dcc_decoder.adaptive_zero;
+    unsigned int margin = bit ? DCC_ADAPTIVE_ONE_MARGIN : DCC_ADAPTIVE_ZERO_MARGIN;
+
+    if (ADAPTIVE_LOCKED && DELTA(length, *centre >> DCC_ADAPTIVE_SHIFT) > margin) {
+        if (++dcc_decoder.adaptive_rejects >= DCC_ADAPTIVE_UNLOCK_REJECTS) {
+            dcc_decoder.adaptive_packets = 0;
+            dcc_decoder.adaptive_rejects = 0;
+        }
+        return 0;
+    }
+
+    if (bit ? dcc_decoder.state == SEEKING_PREAMBLE : length <= DCC_ADAPTIVE_ZERO_LEARN_MAX)
+        *centre += length - (*centre >> DCC_ADAPTIVE_SHIFT);
+
+    return 1;
+}
+
+// Count a valid packet towards narrowing the windows.
+static inline void
+adaptive_packet()
+{
+    if (!ADAPTIVE_LOCKED)
+        ++dcc_decoder.adaptive_packets;
+    dcc_decoder.adaptive_rejects = 0;
+}
+#else
+#define ADAPTIVE_PERIOD(_bit, _length) 1
+#define ADAPTIVE_PACKET()
+#endif
+
+void
+dcc_decoder_init()
+{
+#if DCC_ADAPTIVE
+    // Start from the nominal lengths of S-9.2.
+    dcc_decoder.adaptive_one = DCC_TICKS(58) << DCC_ADAPTIVE_SHIFT;
+    dcc_decoder.adaptive_zero = DCC_TICKS(100) << DCC_ADAPTIVE_SHIFT;
+#endif
+    dcc_decoder_reset();
+}
+
+
+// MARK: State Machine
+
+void
+dcc_decoder_reset()
+{
+    dcc_decoder.preamble_half_bits = 0;
+    dcc_decoder.state = SEEKING_PREAMBLE;
+}
+
+enum dcc_result
+dcc_decode(unsigned int length)
+{
+    uint8_t bit = dcc_classify(length);
+    if (bit > DCC_CLASS_ONE || !ADAPTIVE_PERIOD(bit, length)) {
+        // On an invalid bit length, attempt to resynchronize.
+        dcc_decoder_reset();
+        return DCC_BAD_LEN;
+    }
+
+    if (bit) {
+        HISTOGRAM_COUNT(DCC_HISTOGRAM_ONE, length - DCC_ONE_MIN);
+    } else {
+        HISTOGRAM_COUNT(DCC_HISTOGRAM_ZERO, length - DCC_ZERO_MIN);
+    }
+    CAPTURE_LENGTH(length);
+
+    // Each bit has two periods, how we react to each depends on whether we've
+    // detected the end of the preamble (and thus sychronized the phase), and
+    // which phase that is.
+    switch (dcc_decoder.state) {
+        case SEEKING_PREAMBLE:
+            // When we're looking for a preamble, we're looking for the first
+            // stretch of at least 10 full one-bits, terminated by a full
+            // zero-bit.
+            if (bit) {
+                if (!dcc_decoder.preamble_half_bits)
+                    CAPTURE_START(length);
+                if (dcc_decoder.preamble_half_bits < UINT8_MAX)
+                    ++dcc_decoder.preamble_half_bits;
+            } else if (dcc_decoder.preamble_half_bits >= DCC_PREAMBLE_HALF_BITS) {
+                // End of preamble found, the next state is to consume the
+                // second half of the zero bit.
+                HISTOGRAM_COUNT(DCC_HISTOGRAM_PREAMBLE,
+                                (dcc_decoder.preamble_half_bits - DCC_PREAMBLE_HALF_BITS) / 2);
+                dcc_decoder.preamble_bits = dcc_decoder.preamble_half_bits / 2;
+                dcc_decoder.state = PACKET_START;
+            } else {
+                dcc_decoder.preamble_half_bits = 0;
+            }
+            break;
+        case PACKET_START:
+            // If we see anything other than a zero high or low period here it means
+            // we misdetected a period as a zero that shouldn't be, so return
+            // back to seeking the preamble.
+            if (bit) {
+                dcc_decoder_reset();
+            } else {
+                dcc_decoder.bitmask = 1 << 7;
+                dcc_decoder.byte = 0;
+                dcc_decoder.check_byte = 0;
+                dcc_decoder.packet.length = 0;
+                dcc_decoder.state = PACKET_A;
+            }
+            break;
+        case PACKET_A:
+            // First period in a bit, save which bit it was and the length,
+            // so we can double-check in the second phase next cycle.
+            dcc_decoder.last_bit = bit;
+            dcc_decoder.last_length = length;
+            dcc_decoder.state = PACKET_B;
+            break;
+        case PACKET_B:
+            if (bit && dcc_decoder.last_bit)
+                HISTOGRAM_COUNT(DCC_HISTOGRAM_DELTA, DELTA(length, dcc_decoder.last_length));
+
+            if (dcc_decoder.last_bit != bit) {
+                // Bits must match between phases; if they don't, we've probably
+                // gone out of phase, so resynchronize again.
+                dcc_decoder_reset();
+                return DCC_BAD_MATCH;
+            } else if (bit && DELTA(length, dcc_decoder.last_length) > dcc_one_delta) {
+                // Double-check the delta of one-bit phases, if we go out of spec,
+                // treat it the same as if we had non-matching bits and
+                // resynchronize the phase.
+                dcc_decoder_reset();
+                return DCC_BAD_DELTA;
+            } else if (dcc_decoder.bitmask) {
+                // Within the packet there are eight bits to a byte, followed by
+                // a zero-bit or a one-bit that determines whether more bytes
+                // follow, or a preamble. Store the byte in the packet as soon
+                // as it's complete.
+                if (bit)
+                    dcc_decoder.byte |= dcc_decoder.bitmask;
+                dcc_decoder.bitmask >>= 1;
+
+                if (!dcc_decoder.bitmask) {
+                    if (dcc_decoder.packet.length >= DCC_MAX_PACKET_LENGTH) {
+                        dcc_decoder_reset();
+                        return DCC_TOO_LONG;
+                    }
+
+                    dcc_decoder.packet.data[dcc_decoder.packet.length++] = dcc_decoder.byte;
+                }
+                dcc_decoder.state = PACKET_A;
+            } else if (!bit) {
+                // Zero-bit goes between bytes, accumulate the check byte
+                // and prepare for the next.
+                dcc_decoder.check_byte ^= dcc_decoder.byte;
+                dcc_decoder.bitmask = 1 << 7;
+                dcc_decoder.byte = 0;
+                dcc_decoder.state = PACKET_A;
+            } else if (dcc_decoder.byte != dcc_decoder.check_byte) {
+                // Check byte doesn't match, but we otherwise kept sychronisation.
+                // Assume we can carry on, and go back to dumb preamble seeking mode
+                // and hope the next time the packet is sent, it comes in fine.
+                dcc_decoder_reset();
+                return DCC_ERR;
+            } else {
+                // Check byte matches the error check byte in the stream.
+                // Now we've reached the end of a packet, and go back into
+                // dumb preamble seeking mode.
+                ADAPTIVE_PACKET();
+                dcc_decoder_reset();
+                return DCC_PACKET;
+            }
+            break;
+    }
+
+    return DCC_CONTINUE;
+}
+
+uint16_t
+dcc_packet_address(const struct dcc_packet *packet)
+{
+    uint8_t first = packet->data[0];
+
+    if (!packet->length) {
+        return DCC_NO_ADDRESS;
+    } else if (first < 0x80) {
+        return first;
+    } else if (first >= 0xc0 && first < 0xe8 && packet->length > 2) {
+        return (uint16_t)first << 8 | packet->data[1];
+    } else {
+        return DCC_NO_ADDRESS;
+    }
+}
@@ -0,0 +1,150 @@
+//
+//  dcc_decoder.h
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#ifndef SIGNALBOX_DCC_DECODER_H
+#define SIGNALBOX_DCC_DECODER_H
+
+#include <stdint.h>
+
+#include "dcc_timing.h"
+
+// Permitted lengths, in timer ticks, of the high and low periods of a bit
+// received by a decoder are DCC_ONE_MIN to DCC_ONE_MAX for a one-bit, and
+// from DCC_ZERO_MIN for a zero-bit, with the two halves of a one-bit
+// differing by at most DCC_ONE_DELTA; see dcc_timing.h, which is generated
+// for F_CPU and the timer prescale by `make timing`.
+
+// Permitted difference of the two halves of a one-bit actually used, which
+// may be changed at runtime; initially DCC_ONE_DELTA.
+extern uint8_t dcc_one_delta;
+
+// Minimum number of one-bit half periods in a preamble.
+#define DCC_PREAMBLE_HALF_BITS  20
+
+#if DCC_ADAPTIVE
+// Bits of fraction in the period centres learned by the decoder, and the
+// number of valid packets after which the windows are narrowed around them;
+// see Adaptive Timing in dcc_decoder.c.
+#define DCC_ADAPTIVE_SHIFT         4
+#define DCC_ADAPTIVE_LOCK_PACKETS  4
+#endif
+
+// Maximum length of a packet in bytes, including the error detection byte.
+#define DCC_MAX_PACKET_LENGTH  6
+
+// Valid packet received from the decoder.
+//
+// `data` contains all bytes of the packet, including the final error
+// detection byte.
+struct dcc_packet {
+    uint8_t length;
+    uint8_t data[DCC_MAX_PACKET_LENGTH];
+};
+
+// Value returned by `dcc_packet_address()` for packets that are not addressed
+// to a multi-function decoder.
+#define DCC_NO_ADDRESS  0xffff
+
+enum dcc_result {
+    // Period was consumed without completing a packet.
+    DCC_CONTINUE,
+    // Packet was received and validated, and is in `dcc_decoder.packet`.
+    DCC_PACKET,
+    // Period was not a valid length for a one-bit or zero-bit.
+    DCC_BAD_LEN,
+    // Periods of a bit were not the same kind; the first is in `last_bit`.
+    DCC_BAD_MATCH,
+    // Periods of a one-bit were too different; the first is in `last_length`.
+    DCC_BAD_DELTA,
+    // Packet was longer than DCC_MAX_PACKET_LENGTH bytes.
+    DCC_TOO_LONG,
+    // Error detection byte did not match, packet is in `dcc_decoder.packet`.
+    DCC_ERR
+};
+
+// Decoder state.
+//
+// Exposed so that callers can report the details of errors, and retrieve
+// the received packet.
+struct dcc_decoder {
+    uint8_t state;
+    uint8_t preamble_half_bits;
+    uint8_t last_bit;
+    unsigned int last_length;
+    uint8_t bitmask, byte, check_byte;
+    struct dcc_packet packet;
+    // Number of full one-bits in the preamble of the packet received, which
+    // distinguishes the long preamble of service mode packets.
+    uint8_t preamble_bits;
+#if DCC_ADAPTIVE
+    // Centres of the one-bit and zero-bit periods learned from the signal,
+    // with DCC_ADAPTIVE_SHIFT bits of fraction; valid packets counted towards
+    // narrowing the windows, and periods rejected since the last valid packet.
+    uint16_t adaptive_one, adaptive_zero;
+    uint8_t adaptive_packets, adaptive_rejects;
+#endif
+#if DCC_CAPTURE
+    // Timing of the packet received, from the start of its preamble: the
+    // shortest and longest periods, which are always of a one-bit and
+    // zero-bit respectively.
+    unsigned int capture_min_length, capture_max_length;
+#endif
+};
+
+extern struct dcc_decoder dcc_decoder;
+
+#if DCC_HISTOGRAM
+// Signal Histograms
+// -----------------
+// When built with DCC_HISTOGRAM the decoder counts the lengths it sees in a
+// single array of histograms, as a measure of the quality of the signal
+// without logging each bit:
+//
+//   ONE       one-bit period lengths, one bucket per timer tick from
+//             DCC_ONE_MIN to DCC_ONE_MAX
+//   ZERO      zero-bit period lengths, one bucket per tick from DCC_ZERO_MIN,
+//             the last bucket counting all longer periods
+//   DELTA     difference between the periods of a one-bit within a packet,
+//             one bucket per tick up to DCC_ONE_DELTA, the last bucket
+//             counting all greater differences
+//   PREAMBLE  full one-bits in each preamble, from the DCC_PREAMBLE_HALF_BITS
+//             minimum, the last bucket counting all longer preambles
+//
+// Counts are 16-bit and saturate, and are cleared as they are read.
+//
+// The matching layout for the Pi is `SignalHistogram` in the DCC module, and
+// the two must be kept in sync.
+#define DCC_HISTOGRAM_ONE            0
+#define DCC_HISTOGRAM_ONE_SIZE       (DCC_ONE_MAX - DCC_ONE_MIN + 1)
+#define DCC_HISTOGRAM_ZERO           (DCC_HISTOGRAM_ONE + DCC_HISTOGRAM_ONE_SIZE)
+#define DCC_HISTOGRAM_ZERO_SIZE      48
+#define DCC_HISTOGRAM_DELTA          (DCC_HISTOGRAM_ZERO + DCC_HISTOGRAM_ZERO_SIZE)
+#define DCC_HISTOGRAM_DELTA_SIZE     (DCC_ONE_DELTA + 2)
+#define DCC_HISTOGRAM_PREAMBLE       (DCC_HISTOGRAM_DELTA + DCC_HISTOGRAM_DELTA_SIZE)
+#define DCC_HISTOGRAM_PREAMBLE_SIZE  32
+#define DCC_HISTOGRAM_SIZE           (DCC_HISTOGRAM_PREAMBLE + DCC_HISTOGRAM_PREAMBLE_SIZE)
+
+extern volatile uint16_t dcc_histogram[DCC_HISTOGRAM_SIZE];
+#endif
+
+// Initialize the decoder.
+void dcc_decoder_init();
+
+// Reset the decoder back to seeking the preamble, for example after lost edges.
+void dcc_decoder_reset();
+
+// Decode the next period length, in timer ticks.
+enum dcc_result dcc_decode(unsigned int length);
+
+// Return the multi-function decoder address of a packet.
+//
+// Broadcast and primary addresses are the first byte, 0-127, and extended
+// addresses are the first two bytes, 0xc000 | address, so the two can be
+// distinguished; other packets return DCC_NO_ADDRESS.
+uint16_t dcc_packet_address(const struct dcc_packet *packet);
+
+#endif  // SIGNALBOX_DCC_DECODER_H
@@ -0,0 +1,68 @@
+//
+//  dcc_timing.h
+//  SignalBox
+//
+//  Generated by `make timing` from `DecoderTiming` in the DCC module, do not edit.
+//
+
+#ifndef SIGNALBOX_DCC_TIMING_H
+#define SIGNALBOX_DCC_TIMING_H
+
+// DCC Timing
+// ----------
+// Lengths used by the DCC decoder, loss of signal timer, and RailCom cutout,
+// in ticks of TIMER1 for a 16000000Hz clock with a prescale of 8.
+//
+// Lower bounds of the decoder windows are rounded up, and upper bounds
+// rounded down, so that they are never wider than specified; both bounds of
+// the RailCom cutout are rounded up. The upper bound of a zero-bit is handled
+// by the loss of signal timer, rather than the decoder.
+
+#if defined(F_CPU) && F_CPU != 16000000UL
+#error "dcc_timing.h was generated for a different F_CPU, run `make timing`"
+#endif
+
+// Prescale, and clock select bits, for TIMER1 and for TIMER0 when used with
+// the same tick.
+#define DCC_TIMER_PRESCALE  8
+#define DCC_TIMER0_CS       (_BV(CS01))
+#define DCC_TIMER1_CS       (_BV(CS11))
+
+// Convert a constant length in µs to ticks, rounding up.
+#define DCC_TICKS(us)  (((us) * 16000000ULL + 7999999) / 8000000)
+
+// Period in µs between overflows of TIMER1, every 65,536 ticks.
+#define DCC_OVERFLOW_US  32768
+
+// One-bit periods of 52-64µs, whose halves may differ by at most 6µs, and
+// zero-bit periods of 90-10000µs.
+#define DCC_ONE_MIN         104
+#define DCC_ONE_MAX         128
+#define DCC_ONE_DELTA       12
+#define DCC_ZERO_MIN        180
+#define DCC_SIGNAL_TIMEOUT  20000
+
+// RailCom cutout from 26µs to 454µs after the end of the packet end bit.
+#define DCC_RAILCOM_START   52
+#define DCC_RAILCOM_END     908
+
+// Period classification table, indexed by the period length shifted right
+// by DCC_CLASS_SHIFT; see dcc_decoder.c.
+#define DCC_CLASS_SHIFT       2
+#define DCC_CLASS_TABLE_SIZE  45
+#define DCC_CLASS_TABLE { \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_ONE, DCC_CLASS_ONE, \
+    DCC_CLASS_ONE, DCC_CLASS_ONE, DCC_CLASS_ONE, DCC_CLASS_ONE, \
+    DCC_CLASS_CHECK, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, DCC_CLASS_INVALID, \
+    DCC_CLASS_INVALID, \
+}
+
+#endif  // SIGNALBOX_DCC_TIMING_H
@@ -8,9 +8,16 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 
+#include <stddef.h>
 #include <string.h>
 
+#include "dcc_decoder.h"
+#include "log.h"
+#include "railcom.h"
+#include "telemetry.h"
 #include "uart.h"
 
 
@@ -28,88 +35,392 @@
 // We use a single timer to both measure the time in microseconds between
 // edges, and to detect a loss of signal.
 //
-// TIMER1 counts the number of 0.5µs ticks in TCNT1, and the INT0 (D2) ISR
-// is fired on edges, storing this value in `edge` for the main loop to
-// retrieve. TCNT1 is then reset to zero, to begin counting again for the
-// next edge.
+// TIMER1 runs freely counting the number of ticks in TCNT1, and the
+// timestamp of each edge is subtracted from that of the previous edge to
+// give the length of the period, which is placed in the edge ring for the
+// main loop to retrieve.
 //
-// The value of TOP for TIMER1 is set to the maximum permitted time for a
-// zero-bit high or low period, when exceeeded the timer ISR is triggered
-// indicating a loss of signal.
+// By default the INT0 (D2) ISR is fired on edges and reads TCNT1 for the
+// timestamp, which means the length includes the latency of entering the
+// ISR, and that varies whenever another ISR happens to be running. When
+// built with DCC_ICP the input is instead taken from ICP1 (B0), and the
+// input capture unit latches TCNT1 into ICR1 in hardware at the moment of
+// the edge; the ISR flips ICES1 to capture the opposite edge next time.
+//
+// OCR1A is moved along with each edge to the maximum permitted time for a
+// zero-bit high or low period after it, when exceeeded the timer ISR is
+// triggered indicating a loss of signal.
 
+#if DCC_ICP
+#define DCC  PB0
+#else
 #define DCC  PD2
+#endif
+
+#if DCC_GLITCH_FILTER
+// Glitch Filter
+// -------------
+// Since the input is taken from the rails, it picks up noise spikes that
+// would otherwise be invalid periods, resynchronizing the decoder and losing
+// the packet along with the RailCom response after it. When built with
+// DCC_GLITCH_FILTER these are removed from the signal instead.
+//
+// With DCC_ICP the input capture noise canceller is enabled, so that ICP1
+// must be stable for four clock cycles before an edge is captured, and the
+// edge captured next is chosen from the level of ICP1 rather than flipped, so
+// that an edge of a spike too short for the ISR can't leave it backwards.
+//
+// Longer spikes appear as a pair of edges within a period. A period shorter
+// than DCC_GLITCH_TICKS can never be half of a valid bit, so is taken to be
+// such a spike, and is merged along with the periods either side of it into
+// the one period; the decoder sees the original period, and keeps its phase.
+// When the period after a spike is also short, the spike is instead taken to
+// be at the start of a period, just after its edge, and the short pair is
+// merged into the period after; a spike just before an edge looks the same,
+// and is merged the wrong way, moving the edge by less than the pair.
+//
+// A spike is only recognized at its second edge, so the main loop holds each
+// edge back until either the next arrives or DCC_GLITCH_TICKS have passed,
+// which delays the decoding of each period by at most that long; it sleeps
+// meanwhile, with the OCR1B comparison interrupt set for the deadline.
+//
+// Merged spikes are counted in `glitch_count`, which is reported as a log
+// message every GLITCH_REPORT_INTERVAL edges when it has changed.
+#define DCC_GLITCH_TICKS  DCC_TICKS(10)
+#define GLITCH_REPORT_INTERVAL  8192
+
+uint16_t glitch_count;
+
+// Length of a spike at the start of the next period and the gap before it,
+// to be merged into that period.
+unsigned int glitch_prefix;
+#endif
 
 static inline void
 dcc_init()
 {
+#if DCC_ICP
+    // Configure the input capture unit to latch TCNT1 into ICR1 on the edge
+    // opposite to the current level of ICP1, and generate an interrupt.
+    TCCR1B = bit_is_set(PINB, DCC) ? 0 : _BV(ICES1);
+#if DCC_GLITCH_FILTER
+    TCCR1B |= _BV(ICNC1);
+#endif
+    TIMSK1 = _BV(ICIE1) | _BV(OCIE1A);
+#else
     // Configure INT0 to generate interrupts for any logical change.
     EICRA |= _BV(ISC00);
     EIMSK |= _BV(INT0);
 
+    TCCR1B = 0;
+    TIMSK1 = _BV(OCIE1A);
+#endif
+#if DCC_CAPTURE
+    TIMSK1 |= _BV(TOIE1);
+#endif
+
     // To analyze the DCC signal we need a timer on which we can measure, with
     // reasonable precision, the time in microseconds between edges. Set up TIMER1
-    // in CTC mode with 0.5µs (8 prescale) ticks, and a TOP of the maximum permitted
-    // length of a high or low period (10,000µs).
+    // in Normal mode with DCC_TIMER_PRESCALE ticks (0.5µs at 16MHz with 8), and
+    // leave it running freely; since lengths are calculated by subtraction, the
+    // wrap at MAX doesn't matter.
     //
-    // We'll reset TCNT1 whenever an edge in the input is detected, meaning a timer
-    // interrupt is generated when the maximum length of a zero-bit high or low period
-    // has been exceeded, indicating loss of signal.
+    // The compare value is set to the maximum permitted length of a high or low
+    // period (10,000µs) after the most recent edge, meaning a timer interrupt is
+    // generated when that has been exceeded, indicating loss of signal.
     TCCR1A = 0;
-    TCCR1B = _BV(WGM12);
     TCCR1C = 0;
-    TIMSK1 = _BV(OCIE1A);
-    OCR1A = 10000 * 2;
+    OCR1A = DCC_SIGNAL_TIMEOUT;
 }
 
 static inline void
 dcc_timer_start()
 {
     TCNT1 = 0;
-    TCCR1B |= _BV(CS11);
+    TCCR1B |= DCC_TIMER1_CS;
 }
 
-volatile unsigned int edge;
+// Edge Ring
+// ---------
+// Lengths are passed from the ISR to the main loop through a single-producer,
+// single-consumer ring so that the main loop can fall behind by a few bits, for
+// example while writing to the UART, without losing any edges.
+//
+// The head is only written by the ISR and the tail only by the main loop. Both
+// are 8-bit so are read and written atomically, and are allowed to wrap freely
+// with the size of the ring a power of two that divides 256; no locking is needed.
+// When the ring is full, the new edge is dropped and `edge_overruns` incremented.
+
+#define EDGE_RING_SIZE 32
+
+volatile unsigned int edge_ring[EDGE_RING_SIZE];
+volatile uint8_t edge_head, edge_tail;
+volatile uint8_t edge_overruns;
+
+// Timestamp of the previous edge.
+unsigned int last_edge_timestamp;
+
+#if DCC_CAPTURE
+// Capture Timestamps
+// ------------------
+// When built with DCC_CAPTURE, each edge is also given a 32-bit timestamp so
+// that captured packets can be placed in time beyond the 32ms wrap of TIMER1.
+// The overflow ISR counts the upper 16 bits, and the edge ISRs combine that
+// with the timestamp of the edge into a ring alongside the lengths.
+//
+// An overflow may be pending but not yet counted while an edge ISR runs, in
+// which case it's only counted for timestamps in the lower half of the timer,
+// which must have been taken after the overflow; the ISR latency is far less
+// than half the period.
+volatile uint32_t edge_timestamp_ring[EDGE_RING_SIZE];
+volatile uint16_t timer1_overflows;
+
+// Extended timestamp of the edge last returned by `wait_for_edge()`.
+uint32_t edge_timestamp;
+
+// Return the 32-bit extended timestamp for a TIMER1 timestamp taken in an ISR.
+static inline uint32_t
+dcc_extend_timestamp(unsigned int timestamp)
+{
+    uint16_t overflows = timer1_overflows;
+
+    if (bit_is_set(TIFR1, TOV1) && timestamp < 0x8000)
+        ++overflows;
+
+    return (uint32_t)overflows << 16 | timestamp;
+}
+
+// TIMER1 Overflow Interrupt.
+// Fires when TIMER1 wraps from MAX to zero.
+ISR(TIMER1_OVF_vect)
+{
+    ++timer1_overflows;
+}
+#endif
+
+// Record an edge at the given timestamp.
+//
+// Calculates the length since the previous edge, and moves the loss of signal
+// timeout along.
+__attribute__((always_inline))
+static inline void
+dcc_edge(unsigned int timestamp)
+{
+    uint8_t head = edge_head;
+    if ((uint8_t)(head - edge_tail) < EDGE_RING_SIZE) {
+        edge_ring[head % EDGE_RING_SIZE] = timestamp - last_edge_timestamp;
+#if DCC_CAPTURE
+        edge_timestamp_ring[head % EDGE_RING_SIZE] = dcc_extend_timestamp(timestamp);
+#endif
+        edge_head = head + 1;
+    } else {
+        ++edge_overruns;
+    }
+    last_edge_timestamp = timestamp;
+    OCR1A = timestamp + DCC_SIGNAL_TIMEOUT;
+}
+
+#if DCC_ICP
+// TIMER1 Input Capture Interrupt.
+// Fires when the input signal on ICP1 (B0) changes.
+//
+// Reads the timestamp latched in ICR1, and flips the edge to be captured next;
+// when built with DCC_GLITCH_FILTER, selects it from the level of ICP1.
+ISR(TIMER1_CAPT_vect)
+{
+    unsigned int timestamp = ICR1;
+
+    // Changing the edge can set the input capture flag, so clear it afterwards.
+#if DCC_GLITCH_FILTER
+    if (bit_is_set(PINB, DCC)) {
+        TCCR1B &= ~_BV(ICES1);
+    } else {
+        TCCR1B |= _BV(ICES1);
+    }
+#else
+    TCCR1B ^= _BV(ICES1);
+#endif
+    TIFR1 = _BV(ICF1);
 
+    dcc_edge(timestamp);
+}
+#else
 // INT0 Interrupt.
 // Fires when the input signal on INT0 (D2) changes.
 //
-// Reads TCNT1 and resets it, clears any loss of signal status.
+// Reads the timestamp from TCNT1.
 ISR(INT0_vect)
 {
-    // TODO: should indicate overflow?
-    edge = TCNT1;
-    TCNT1 = 0;
+    dcc_edge(TCNT1);
 }
+#endif
 
 // TIMER1 Comparison Interrupt.
-// Fires when TIMER1 reaches TOP.
+// Fires when TIMER1 reaches OCR1A.
 //
-// Indicates a timeout waiting for the input signal to change.
+// Indicates a timeout waiting for the input signal to change; nothing needs to
+// be done, since the period is a bad length when the signal returns, which
+// resynchronizes the decoder.
 ISR(TIMER1_COMPA_vect)
 {
-    // TODO: should mark overflow?
 }
 
-// Wait for an edge and return the length.
+#if DCC_GLITCH_FILTER
+// TIMER1 Comparison B Interrupt.
+// Fires when TIMER1 reaches OCR1B.
+//
+// Indicates the deadline for the edge after one held back by the glitch
+// filter; nothing needs to be done, the interrupt only wakes the main loop.
+ISR(TIMER1_COMPB_vect)
+{
+}
+#endif
+
+// Timestamp at which the main loop last picked up an edge, to measure how
+// long it is then awake for.
+unsigned int awake_timestamp;
+
+// Take the next edge from the ring and return the length.
+//
+// Sleeps until the next interrupt while there are no edges, and reports the
+// time spent awake since the last edge was picked up. When built with
+// DCC_CAPTURE, also sets `edge_timestamp`.
 static inline unsigned int
-wait_for_edge()
+take_edge()
 {
-    unsigned int length;
-    uint8_t sreg;
+    unsigned int length, awake;
+    uint8_t tail = edge_tail;
 
-    while (!edge)
-        ;
+    // Reading TCNT1 uses the shared TEMP register, so must be atomic.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        awake = TCNT1 - awake_timestamp;
+        while (edge_head == tail) {
+            // The instruction following sei is always executed before any
+            // pending interrupt, so an edge can't arrive between the check
+            // and sleeping; and the ISR wakes us.
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+            cli();
+        }
+        awake_timestamp = TCNT1;
+    }
 
-    sreg = SREG;
-    cli();
+    telemetry_awake(awake);
 
-    length = edge;
-    edge = 0;
+    // The ISR won't write to this entry until we advance the tail past it.
+    length = edge_ring[tail % EDGE_RING_SIZE];
+#if DCC_CAPTURE
+    edge_timestamp = edge_timestamp_ring[tail % EDGE_RING_SIZE];
+#endif
+    edge_tail = tail + 1;
 
-    SREG = sreg;
     return length;
 }
 
+#if DCC_GLITCH_FILTER
+// Sleep until there's an edge in the ring, or DCC_GLITCH_TICKS have passed
+// since the last; returns non-zero if there's an edge.
+//
+// The time spent asleep is left out of the awake time reported.
+static inline uint8_t
+glitch_wait()
+{
+    unsigned int start;
+    uint8_t tail = edge_tail, ready;
+
+    // Reading TCNT1 uses the shared TEMP register, and the timestamp is
+    // written by the ISR, so must be atomic.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        start = TCNT1;
+        OCR1B = last_edge_timestamp + DCC_GLITCH_TICKS;
+        TIFR1 = _BV(OCF1B);
+        TIMSK1 |= _BV(OCIE1B);
+        while (edge_head == tail
+               && (unsigned int)(TCNT1 - last_edge_timestamp) < DCC_GLITCH_TICKS) {
+            // As in take_edge(), neither the edge nor the comparison can
+            // arrive between the check and sleeping.
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+            cli();
+        }
+        TIMSK1 &= ~_BV(OCIE1B);
+        awake_timestamp += TCNT1 - start;
+        ready = edge_head != tail;
+    }
+
+    return ready;
+}
+
+// Wait for an edge and return the length, with any glitches merged into it.
+static inline unsigned int
+wait_for_edge()
+{
+    unsigned int length = glitch_prefix + take_edge();
+    unsigned int spike, after;
+
+    glitch_prefix = 0;
+    for (;;) {
+        // Hold the edge back until the next arrives, or it's too late for it
+        // to be the start of a spike.
+        if (!glitch_wait() || edge_ring[edge_tail % EDGE_RING_SIZE] >= DCC_GLITCH_TICKS)
+            return length;
+
+#if DCC_CAPTURE
+        uint32_t timestamp = edge_timestamp;
+#endif
+        spike = take_edge();
+        after = take_edge();
+        ++glitch_count;
+
+        if (after < DCC_GLITCH_TICKS) {
+            // The period after is short too, so the spike is taken to be at
+            // the start of the next period, and `spike` the gap before it;
+            // return this period as it is, and merge the pair into the next.
+#if DCC_CAPTURE
+            edge_timestamp = timestamp;
+#endif
+            glitch_prefix = spike + after;
+            return length;
+        }
+
+        // Merge the spike, and the rest of the period after it.
+        length += spike + after;
+    }
+}
+
+// Periodically send a log message with the count of glitches merged, when it
+// has changed; called from the main loop for each edge.
+static inline void
+glitch_poll()
+{
+    static uint16_t reported;
+    static uint16_t polls;
+
+    if (++polls < GLITCH_REPORT_INTERVAL)
+        return;
+    polls = 0;
+
+    if (glitch_count == reported)
+        return;
+    reported = glitch_count;
+
+    log_u16(LOG_GLITCHES, glitch_count);
+}
+#else  // DCC_GLITCH_FILTER
+// Wait for an edge and return the length.
+static inline unsigned int
+wait_for_edge()
+{
+    return take_edge();
+}
+
+static inline void glitch_poll() {}
+#endif  // DCC_GLITCH_FILTER
+
 
 // MARK: RailCom Input
 
@@ -133,7 +444,13 @@ wait_for_edge()
 // interrupt for each byte we receive.
 //
 // Whether receiving data is enabled is toggled by the INT1 interrupt so
-// that noise outside of the cutout is ignored.
+// that noise outside of the cutout is ignored. At the end of the cutout the
+// bytes received are handed to the main loop, which decodes the datagrams
+// within them; see railcom.c for the details.
+//
+// When built with DETECTOR_ZONES, the USART is not used and the signals of
+// each zone are instead sampled during the cutout; see Multi-Zone Input
+// below.
 
 #define CUTOUT  PD3
 
@@ -145,46 +462,661 @@ railcom_init()
     EIMSK |= _BV(INT1);
 }
 
-volatile int rx;
+// Maximum number of bytes in a RailCom response, two in channel 1 and six in
+// channel 2.
+#define RAILCOM_MAX_LENGTH 8
+
+// Channel Windows
+// ---------------
+// Each byte is timestamped on TIMER1 as it's completed, relative to the start
+// of the cutout, and placed into channel 1 or channel 2 by when it arrived
+// rather than by what it contains.
+//
+// Channel 1 ends 177µs after the end of the packet end bit, and channel 2
+// begins at 193µs, while the cutout begins 26-32µs after it and the USART
+// completes a byte 38µs after its start bit. So the last byte of channel 1
+// is completed no later than 151µs after the start of the cutout, and the
+// first of channel 2 no earlier than 199µs; RAILCOM_CHANNEL2_START is halfway
+// between, leaving margin for the latency of the timestamps.
+//
+// Within a channel, a byte received with a framing error or data overrun, or
+// that isn't a valid 4/8 code, discards the bytes of the channel received so
+// far and all that follow, since the boundaries of its datagrams can no
+// longer be trusted; so does a third byte in channel 1, which can only be a
+// collision between decoders. The errors are counted, along with the bytes
+// received, and the counts are sent every RAILCOM_STATS_INTERVAL edges when
+// they have changed, as a measure of the quality of the link.
+
+#define RAILCOM_CHANNEL2_START  DCC_TICKS(175)
+#define RAILCOM_STATS_INTERVAL  8192
+
+#if DETECTOR_ZONES
+#define RAILCOM_ZONES  DETECTOR_ZONES
+#else
+#define RAILCOM_ZONES  1
+#endif
+
+struct railcom_stats railcom_stats[RAILCOM_ZONES];
+
+// Response being received.
+struct railcom_receiver {
+    // Channel of the last byte, and whether the rest of it is discarded.
+    uint8_t channel, discard;
+    // Number of bytes of channel 1, once channel 2 has begun.
+    uint8_t channel1_length;
+    uint8_t length;
+    uint8_t bytes[RAILCOM_MAX_LENGTH];
+};
+
+// Start receiving a new response.
+static inline void
+railcom_receive_start(struct railcom_receiver *receiver)
+{
+    receiver->channel = 1;
+    receiver->discard = 0;
+    receiver->channel1_length = 0;
+    receiver->length = 0;
+}
+
+// Move on to channel 2 when a byte completed at the given offset from the
+// start of the cutout belongs to it.
+static inline void
+railcom_receive_channel(struct railcom_receiver *receiver, unsigned int offset)
+{
+    if (receiver->channel == 1 && offset >= RAILCOM_CHANNEL2_START) {
+        receiver->channel = 2;
+        receiver->discard = 0;
+        receiver->channel1_length = receiver->length;
+    }
+}
+
+// Discard the bytes of the current channel, and the rest of it.
+static inline void
+railcom_receive_discard(struct railcom_receiver *receiver)
+{
+    receiver->length = receiver->channel == 1 ? 0 : receiver->channel1_length;
+    receiver->discard = 1;
+}
+
+// Receive a byte that was completed without error at the given offset from
+// the start of the cutout.
+__attribute__((always_inline))
+static inline void
+railcom_receive(struct railcom_receiver *receiver, struct railcom_stats *stats,
+                uint8_t data, unsigned int offset)
+{
+    railcom_receive_channel(receiver, offset);
+
+    if (railcom_decode(data) == RAILCOM_INVALID
+        || (receiver->channel == 1 && receiver->length == 2)) {
+        ++stats->invalid;
+        railcom_receive_discard(receiver);
+        return;
+    }
+
+    ++stats->received;
+    if (!receiver->discard && receiver->length < RAILCOM_MAX_LENGTH)
+        receiver->bytes[receiver->length++] = data;
+}
+
+// Return the number of bytes of channel 1 in the response.
+static inline uint8_t
+railcom_channel1_length(const struct railcom_receiver *receiver)
+{
+    return receiver->channel == 1 ? receiver->length : receiver->channel1_length;
+}
+
+#if !DETECTOR_ZONES
+// Response being received by the USART, and the timestamp of the start of the
+// cutout; both only used by ISRs.
+struct railcom_receiver rx;
+unsigned int cutout_timestamp;
+
+// Bytes of the last response, for the main loop; the length is cleared by the
+// main loop once they have been decoded, and a new response is discarded if
+// that has not yet happened.
+uint8_t railcom_response[RAILCOM_MAX_LENGTH];
+uint8_t railcom_response_channel1_length;
+volatile uint8_t railcom_response_length;
+
+// Index into `railcom_packets` of the packet preceding the last response.
+uint8_t railcom_response_packet;
+#else
+static inline void zone_sample();
+#endif
+
+// Last valid packets received, double buffered so that the main loop can
+// store a new packet while the last is still needed for the response to it;
+// `railcom_packet_index` is the most recent.
+struct dcc_packet railcom_packets[2];
+volatile uint8_t railcom_packet_index;
+
+// Store the packet just decoded, as the one RailCom responses will be for.
+static inline void
+railcom_store_packet()
+{
+    uint8_t index = railcom_packet_index ^ 1;
+
+    railcom_packets[index] = dcc_decoder.packet;
+    railcom_packet_index = index;
+}
 
 // INT1 Interrupt.
 // Fires when the input signal on INT1 (D3) changes.
 //
 // Check the value of the pin to determine whether we're in the cutout or
-// not. Toggle whether RX is enabled on the USART accordingly.
+// not. Toggle whether RX is enabled on the USART accordingly, timestamping
+// the start of the cutout, and at the end of the cutout pass the bytes
+// received during it to the main loop.
+//
+// When built with DETECTOR_ZONES, the zones are instead sampled from the
+// start of the cutout until its end, within this ISR.
 ISR(INT1_vect)
 {
     int cutout = bit_is_set(PIND, CUTOUT);
-    
+
+#if DETECTOR_ZONES
+    if (cutout)
+        zone_sample();
+#else
     if (cutout) {
+        cutout_timestamp = TCNT1;
+        railcom_receive_start(&rx);
         UCSR0B |= _BV(RXEN0);
     } else {
         UCSR0B &= ~_BV(RXEN0);
-        if (rx) {
-            uputc('\r');
-            uputc('\n');
-            rx = 0;
+        if (rx.length && !railcom_response_length) {
+            memcpy(railcom_response, rx.bytes, rx.length);
+            railcom_response_channel1_length = railcom_channel1_length(&rx);
+            railcom_response_packet = railcom_packet_index;
+            railcom_response_length = rx.length;
         }
     }
+#endif
 }
 
+#if !DETECTOR_ZONES
 // USART RX Complete Interrupt
 // Fires when a newly received byte is available in UDR0.
 //
-// Collate RailCom response bytes.
+// Collate RailCom response bytes into channels, checking for errors.
 ISR(USART_RX_vect)
 {
     uint8_t status, data;
-    
+    unsigned int offset;
+
+    // The error flags are only valid until UDR0 is read.
     status = UCSR0A;
     data = UDR0;
-    rx = 1;
-    
-    // TODO: check the error flags.
-    // TODO: do something with the bytes.
-    uputc(((data >> 4) > 9 ? '7' : '0') + (data >> 4));
-    uputc(((data & 0xf) > 9 ? '7' : '0') + (data & 0xf));
-    uputc(' ');
+    offset = TCNT1 - cutout_timestamp;
+
+    if (status & _BV(FE0)) {
+        ++railcom_stats[0].framing;
+    } else if (status & _BV(DOR0)) {
+        ++railcom_stats[0].overruns;
+    } else {
+        railcom_receive(&rx, &railcom_stats[0], data, offset);
+        return;
+    }
+
+    railcom_receive_channel(&rx, offset);
+    railcom_receive_discard(&rx);
+}
+#endif
+
+// Decode the datagrams of a RailCom response received in the given zone, or
+// TELEMETRY_NO_ZONE, in response to a packet with the given address, and
+// send them as telemetry records.
+//
+// The first `channel1_length` bytes are channel 1, and the rest of the
+// response is channel 2. Bytes of a channel that cannot be decoded are sent
+// raw.
+static void
+railcom_send(uint8_t zone, const uint8_t *response, uint8_t length,
+             uint8_t channel1_length, uint16_t address)
+{
+    struct railcom_datagram datagram;
+    uint8_t offset = 0, channel, end, used;
+
+    for (channel = 1; channel <= 2; ++channel) {
+        end = channel == 1 ? channel1_length : length;
+        while (offset < end) {
+            used = railcom_parse(response + offset, end - offset, channel, &datagram);
+            if (!used) {
+                telemetry_railcom_bytes(zone, response + offset, end - offset);
+                break;
+            }
+
+            telemetry_railcom(zone, channel, address, &datagram);
+            offset += used;
+        }
+        offset = end;
+    }
+}
+
+#if !DETECTOR_ZONES
+// Decode the datagrams of the last RailCom response, if there is one, and
+// send them as telemetry records.
+//
+// Datagrams are sent with the address of the packet preceding the cutout,
+// which can't have been replaced yet since this is called after every edge,
+// well before another packet can be completed.
+static inline void
+railcom_report()
+{
+    uint8_t length;
+    uint16_t address;
+
+    length = railcom_response_length;
+    if (!length)
+        return;
+
+    address = dcc_packet_address(&railcom_packets[railcom_response_packet]);
+    railcom_send(TELEMETRY_NO_ZONE, railcom_response, length,
+                 railcom_response_channel1_length, address);
+
+    railcom_response_length = 0;
+}
+#endif
+
+// Periodically send a statistics record for each zone whose counts have
+// changed; called from the main loop for each edge.
+static inline void
+railcom_stats_poll()
+{
+    static struct railcom_stats reported[RAILCOM_ZONES];
+    static uint16_t polls;
+    struct railcom_stats stats;
+
+    if (++polls < RAILCOM_STATS_INTERVAL)
+        return;
+    polls = 0;
+
+    for (uint8_t zone = 0; zone < RAILCOM_ZONES; ++zone) {
+        // Counts of a single zone are updated by the USART ISR.
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            stats = railcom_stats[zone];
+        }
+
+        if (!memcmp(&stats, &reported[zone], sizeof stats))
+            continue;
+        reported[zone] = stats;
+
+#if DETECTOR_ZONES
+        telemetry_railcom_stats(zone, &stats);
+#else
+        telemetry_railcom_stats(TELEMETRY_NO_ZONE, &stats);
+#endif
+    }
+}
+
+
+// MARK: Multi-Zone Input
+
+#if DETECTOR_ZONES
+// Multi-Zone Input
+// ----------------
+// When built with DETECTOR_ZONES, a single detector covers several zones of
+// track, each with its own window comparator output input on PORTC from PC0
+// for zone 0; up to six zones. The comparator outputs are low while current
+// is flowing in the zone, which is both how occupancy is detected, and how
+// the RailCom signal of a decoder in the zone is received during the cutout.
+//
+// Outside of the cutout, a pin-change interrupt notes each zone seen drawing
+// current, and the main loop checks these every ZONE_OCCUPANCY_INTERVAL
+// edges along with the current level of the inputs. A zone becomes occupied
+// as soon as current is seen, and vacant only after none has been seen for
+// ZONE_VACANT_INTERVALS checks, so that dirty wheels don't make it flicker;
+// changes are sent as occupancy records.
+//
+// There's only one USART, so instead the INT1 ISR samples all of the zone
+// inputs together every ZONE_SAMPLE_TICKS, paced by TIMER1, from the start of
+// the cutout until its end. Afterwards the main loop decodes the bytes of
+// each zone in turn from the samples with a software receiver, a few samples
+// for each edge so that it keeps up with them. Samples are only taken when
+// those of the last cutout have been decoded.
+//
+// The RailCom signal is 250kbaud, so a bit is 4µs, and at 16MHz there are
+// only 16 cycles between samples; interrupts are disabled throughout the
+// cutout, which only delays UART transmission, and the timestamp of an INT0
+// edge arriving at the very end of it, which isn't a problem with DCC_ICP.
+
+#if DETECTOR_ZONES > 6
+#error "At most six zones are supported, on PC0-PC5"
+#endif
+
+#define ZONE_MASK  (_BV(DETECTOR_ZONES) - 1)
+
+// Zones are checked every 256 edges, at least 15ms of DCC signal, and become
+// vacant after a quarter of a second or more without current.
+#define ZONE_OCCUPANCY_INTERVAL  256
+#define ZONE_VACANT_INTERVALS    16
+
+// Samples are taken every 1µs, four per RailCom bit, which tolerates the
+// permitted 2% error in the decoder's baud rate; there are enough for the
+// longest cutout, 488µs less the 26µs before it starts.
+#define RAILCOM_BIT_TICKS  DCC_TICKS(4)
+#define ZONE_SAMPLE_TICKS  DCC_TICKS(1)
+#define ZONE_SAMPLES       464
+
+// Offset in samples from the first sample of a start bit to the middle of
+// the given bit, with the start bit as 0 and the stop bit as 9; the start
+// edge is on average half a sample before the first sample of the start bit.
+#define ZONE_BIT_SAMPLE(_bit)  ((2 * (_bit) + 1) * RAILCOM_BIT_TICKS / (2 * ZONE_SAMPLE_TICKS))
+
+static const uint8_t zone_bit_samples[10] = {
+    ZONE_BIT_SAMPLE(0), ZONE_BIT_SAMPLE(1), ZONE_BIT_SAMPLE(2), ZONE_BIT_SAMPLE(3),
+    ZONE_BIT_SAMPLE(4), ZONE_BIT_SAMPLE(5), ZONE_BIT_SAMPLE(6), ZONE_BIT_SAMPLE(7),
+    ZONE_BIT_SAMPLE(8), ZONE_BIT_SAMPLE(9),
+};
+
+// Samples of PINC during the last cutout, and their count; `zone_sampled` is
+// set by the ISR after both, and cleared by the main loop once all zones have
+// been decoded.
+uint8_t zone_samples[ZONE_SAMPLES];
+uint16_t zone_sample_count;
+volatile uint8_t zone_sampled;
+
+// Index into `railcom_packets` of the packet preceding the last samples.
+uint8_t zone_sample_packet;
+
+// Number of samples the software receiver looks at for each edge, so that the
+// main loop keeps up with the edges.
+#define ZONE_RECEIVE_SAMPLES  64
+
+// State of the software receiver; `sample` is the index of the next sample
+// to look at for a start edge, from 1 since it's compared with the previous.
+struct zone_receiver {
+    uint8_t zone;
+    uint16_t sample;
+    struct railcom_receiver rx;
+};
+
+struct zone_receiver zone_receiver = { .sample = 1, .rx = { .channel = 1 } };
+
+// Zones seen drawing current by the pin-change ISR since the last check.
+volatile uint8_t zone_current;
+
+// Occupied zones, and the number of checks each has not drawn current for.
+uint8_t zone_occupied;
+uint8_t zone_quiet[DETECTOR_ZONES];
+
+static inline void
+zone_init()
+{
+    // Configure the pin-change interrupt for the zone inputs.
+    PCMSK1 = ZONE_MASK;
+    PCICR |= _BV(PCIE1);
+}
+
+// Sample the zone inputs until the end of the cutout; called from the INT1
+// ISR at its start.
+static inline void
+zone_sample()
+{
+    uint8_t *sample = zone_samples;
+    uint8_t next;
+
+    if (zone_sampled)
+        return;
+
+    // Only the low byte of the timer is needed to pace samples; reading it
+    // latches the high byte into TEMP, which is safe with interrupts disabled.
+    next = TCNT1L;
+    do {
+        // Two samples for each check for the end, so that each loop is well
+        // within the time of two samples.
+        next += ZONE_SAMPLE_TICKS;
+        while ((int8_t)(TCNT1L - next) < 0)
+            ;
+        *sample++ = PINC;
+
+        next += ZONE_SAMPLE_TICKS;
+        while ((int8_t)(TCNT1L - next) < 0)
+            ;
+        *sample++ = PINC;
+    } while (bit_is_set(PIND, CUTOUT) && sample < zone_samples + ZONE_SAMPLES);
+
+    zone_sample_packet = railcom_packet_index;
+    zone_sample_count = sample - zone_samples;
+    zone_sampled = 1;
+}
+
+// Pin Change 1 Interrupt.
+// Fires when any of the zone inputs on PORTC changes.
+//
+// Note the zones drawing current.
+ISR(PCINT1_vect)
+{
+    zone_current |= ~PINC;
+}
+
+// Continue receiving the bytes of the current zone from the samples, looking
+// at up to ZONE_RECEIVE_SAMPLES samples for a start edge, and return whether
+// the zone is complete.
+//
+// The start edge of each byte is found where the input falls, and the bits
+// are read from the samples closest to their middle. As with the USART, a
+// byte without a valid stop bit is a framing error, and the search resumes
+// after it; bytes are timestamped by the sample of their stop bit.
+static inline uint8_t
+zone_receive()
+{
+    struct zone_receiver *receiver = &zone_receiver;
+    struct railcom_stats *stats = &railcom_stats[receiver->zone];
+    uint8_t mask = _BV(receiver->zone), byte, bit;
+    uint16_t i = receiver->sample, limit = i + ZONE_RECEIVE_SAMPLES, offset;
+
+    while (i < limit) {
+        if (i + zone_bit_samples[9] >= zone_sample_count
+            || receiver->rx.length == RAILCOM_MAX_LENGTH)
+            return 1;
+
+        if ((zone_samples[i] & mask) || !(zone_samples[i - 1] & mask)) {
+            ++i;
+            continue;
+        }
+
+        byte = 0;
+        for (bit = 1; bit <= 8; ++bit) {
+            byte >>= 1;
+            if (zone_samples[i + zone_bit_samples[bit]] & mask)
+                byte |= 0x80;
+        }
+
+        if (zone_samples[i + zone_bit_samples[0]] & mask) {
+            ++i;
+            continue;
+        }
+
+        i += zone_bit_samples[9];
+        offset = i * ZONE_SAMPLE_TICKS;
+        if (zone_samples[i] & mask) {
+            railcom_receive(&receiver->rx, stats, byte, offset);
+        } else {
+            ++stats->framing;
+            railcom_receive_channel(&receiver->rx, offset);
+            railcom_receive_discard(&receiver->rx);
+        }
+    }
+
+    receiver->sample = i;
+    return 0;
+}
+
+// Continue decoding the last samples, if there are any, and once a zone is
+// complete send the datagrams received in it as telemetry records; called
+// from the main loop for each edge.
+//
+// All zones are complete within ZONE_SAMPLES / ZONE_RECEIVE_SAMPLES edges
+// each, so as with a single zone, the packet preceding the cutout can't have
+// been replaced yet.
+static inline void
+zone_report()
+{
+    struct zone_receiver *receiver = &zone_receiver;
+
+    if (!zone_sampled || !zone_receive())
+        return;
+
+    if (receiver->rx.length)
+        railcom_send(receiver->zone, receiver->rx.bytes, receiver->rx.length,
+                     railcom_channel1_length(&receiver->rx),
+                     dcc_packet_address(&railcom_packets[zone_sample_packet]));
+
+    receiver->sample = 1;
+    railcom_receive_start(&receiver->rx);
+    if (++receiver->zone == DETECTOR_ZONES) {
+        receiver->zone = 0;
+        zone_sampled = 0;
+    }
+}
+
+// Periodically check the zones for current, and send an occupancy record
+// when they change; called from the main loop for each edge.
+static inline void
+zone_occupancy_poll()
+{
+    static uint16_t polls;
+    uint8_t current, occupied, zone;
+
+    if (++polls < ZONE_OCCUPANCY_INTERVAL)
+        return;
+    polls = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        current = zone_current;
+        zone_current = 0;
+    }
+    current |= ~PINC;
+
+    occupied = zone_occupied;
+    for (zone = 0; zone < DETECTOR_ZONES; ++zone) {
+        if (current & _BV(zone)) {
+            zone_quiet[zone] = 0;
+            occupied |= _BV(zone);
+        } else if (zone_quiet[zone] < ZONE_VACANT_INTERVALS
+                   && ++zone_quiet[zone] == ZONE_VACANT_INTERVALS) {
+            occupied &= ~_BV(zone);
+        }
+    }
+
+    if (occupied != zone_occupied) {
+        zone_occupied = occupied;
+        telemetry_occupancy(occupied);
+    }
+}
+#endif
+
+
+// MARK: Packet Cache
+
+// Packet Cache
+// ------------
+// Command stations resend the same speed and function packets continuously,
+// so rather than send every one as a telemetry record, recently seen packets
+// are kept in a small cache and repeats of them are only counted. A packet
+// record is sent only when a packet is new, or has changed, and a repeats
+// record gives the count of repeats of an entry since the last; these are
+// sent for one entry, round-robin, every PACKET_CACHE_INTERVAL edges, and
+// when an entry is evicted; so every entry with repeats is reported at least
+// every PACKET_CACHE_SIZE * PACKET_CACHE_INTERVAL edges.
+//
+// Entries are found by an 8-bit hash of the packet, checked against the
+// bytes, and kept in least recently used order through `packet_cache_order`,
+// with the most recent first; a new packet replaces the last.
+
+#define PACKET_CACHE_SIZE      16
+#define PACKET_CACHE_INTERVAL  1024
+
+struct packet_cache_entry {
+    uint8_t hash;
+    uint16_t repeats;
+    struct dcc_packet packet;
+};
+
+struct packet_cache_entry packet_cache[PACKET_CACHE_SIZE];
+uint8_t packet_cache_order[PACKET_CACHE_SIZE];
+
+static inline void
+packet_cache_init()
+{
+    for (uint8_t i = 0; i < PACKET_CACHE_SIZE; ++i)
+        packet_cache_order[i] = i;
+}
+
+// Return the hash of a packet.
+static inline uint8_t
+packet_cache_hash(const struct dcc_packet *packet)
+{
+    uint8_t hash = packet->length;
+    for (uint8_t i = 0; i < packet->length; ++i)
+        hash = (hash << 1 | hash >> 7) ^ packet->data[i];
+    return hash;
+}
+
+// Send a repeats record for the entry, if it has any.
+static inline void
+packet_cache_report(struct packet_cache_entry *entry)
+{
+    if (!entry->repeats)
+        return;
+
+    telemetry_repeats(&entry->packet, entry->repeats);
+    entry->repeats = 0;
+}
+
+// Look up the packet in the cache, and return whether it's a repeat.
+//
+// Repeats are counted, otherwise the packet replaces the least recently used
+// entry.
+static inline uint8_t
+packet_cache_repeat(const struct dcc_packet *packet)
+{
+    struct packet_cache_entry *entry;
+    uint8_t hash, index, i, repeat = 0;
+
+    hash = packet_cache_hash(packet);
+    for (i = 0; i < PACKET_CACHE_SIZE; ++i) {
+        entry = &packet_cache[packet_cache_order[i]];
+        if (entry->hash == hash && entry->packet.length == packet->length
+            && !memcmp(entry->packet.data, packet->data, packet->length)) {
+            repeat = 1;
+            break;
+        }
+    }
+
+    if (repeat) {
+        ++entry->repeats;
+    } else {
+        i = PACKET_CACHE_SIZE - 1;
+        entry = &packet_cache[packet_cache_order[i]];
+        packet_cache_report(entry);
+        entry->hash = hash;
+        entry->packet = *packet;
+    }
+
+    // Move the entry to the front.
+    index = packet_cache_order[i];
+    memmove(packet_cache_order + 1, packet_cache_order, i);
+    packet_cache_order[0] = index;
+
+    return repeat;
+}
+
+// Periodically report the repeats of the next entry; called from the main
+// loop for each edge.
+static inline void
+packet_cache_poll()
+{
+    static uint16_t polls;
+    static uint8_t next;
+
+    if (++polls < PACKET_CACHE_INTERVAL)
+        return;
+    polls = 0;
+
+    packet_cache_report(&packet_cache[next++ % PACKET_CACHE_SIZE]);
 }
 
 
@@ -192,179 +1124,94 @@ ISR(USART_RX_vect)
 
 // Main Loop
 // ---------
-// There are two basic passes to analyzing the incoming DCC signal.
-//
-// The first is to determine the phase; when we start to receive incoming
-// half-bits, we do not yet know whether the signal is in high-low or
-// low-high order, and thus do not know whether an edge is a boundary
-// between bits, or between a single bit's high and low parts.
-//
-// To synchronize we need to look for a point at which the period length
-// changes between that of a one-bit and a zero-bit:
-//
-//                   :
-//   _   _   _   _    __    __   _   _
-// _| |_| |_| |_| |__|  |__|  |_| |_| |
-//                   :
-//         length change means we
-//         must be now in Phase A
-//
-// Since the preamble that marks the start of a packet is a train of
-// one-bits followed by a zero-bit, we can combine both phase synchronization
-// and preamble detection into one pass. A suitably long sequence of one-bits
-// followed by the first period of a zero-bit gives us both the phase of the
-// signal and the start of a packet.
-//
-//
-// The second pass is packet and byte extraction. Due to the different byte
-// and packet end bits, the packet structure can be followed logically and
-// byte and packet boundaries followed provided the input conforms to
-// specification. The final byte is always a check byte, which we compare
-// against an accumulated xor of the previous bytes in the packet.
-//
-//    ?    preamble.   byte     byte  check byte
-//        +--------+ +------+ +------+ +------+
-// 1101000111111111101010101001111000000101101011111...
-//                  :        :        :        :
-//                  +--byte end bits--+    packet end bit
-//
-
-enum parser_state {
-    SEEKING_PREAMBLE,
-    PACKET_START,
-    PACKET_A,
-    PACKET_B
-};
-
-// Absolute delta between two unsigned values.
-#define DELTA(_a, _b) ((_a) > (_b) ? (_a) - (_b) : (_b) - (_a))
+// Edges are retrieved from the ISR and passed to the DCC decoder, which
+// synchronizes to the phase of the signal and extracts packets from it; see
+// dcc_decoder.c for the details. Decoded packets, other than repeats counted
+// by the packet cache, and errors are sent as telemetry records, along with
+// the datagrams of any RailCom response received since the last edge, and
+// when built with DETECTOR_ZONES those of the next zone and any change in
+// occupancy; and periodically the RailCom statistics.
+//
+// When built with DCC_CAPTURE every packet is instead sent as a capture
+// record, with its extended timestamp and timing, bypassing the packet cache
+// so that the stream can be recorded as a trace; see `PacketCapture` in the
+// DCC module.
+//
+// Between edges the CPU is put into idle sleep, which keeps the timers and
+// USART running, and is woken by any of their interrupts as well as the DCC
+// and cutout inputs; waking adds 4 cycles to the response to the interrupt.
+// The time spent awake for each edge is sent periodically as a telemetry
+// record, as a measure of how much headroom the main loop has.
 
 int
 main()
 {
-    cli();
-    // To save power, enable pull-ups on all pins we're not using as input.
-    PORTB = PORTC = ~0;
-    PORTD = ~(_BV(DCC) | _BV(CUTOUT));
+    // Configure with interrupts disabled, enabling them at the end; the timer
+    // is only started after, so no edges are held off.
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+        // To save power, enable pull-ups on all pins we're not using as input.
+#if DCC_ICP
+        PORTB = ~_BV(DCC);
+        PORTC = ~0;
+        PORTD = ~_BV(CUTOUT);
+#else
+        PORTB = PORTC = ~0;
+        PORTD = ~(_BV(DCC) | _BV(CUTOUT));
+#endif
+#if DETECTOR_ZONES
+        PORTC = ~ZONE_MASK;
+#endif
 
-    dcc_init();
-    uart_init();
-    railcom_init();
-    sei();
-    
-    uputs("Running\r\n");
+        dcc_init();
+        dcc_decoder_init();
+        uart_init();
+        railcom_init();
+#if DETECTOR_ZONES
+        zone_init();
+#endif
+        packet_cache_init();
+        set_sleep_mode(SLEEP_MODE_IDLE);
+    }
+
+    dcc_timer_start();
+    telemetry_send(TELEMETRY_START, NULL, 0);
     
-    enum parser_state state = SEEKING_PREAMBLE;
-    int preamble_half_bits = 0, last_bit;
-    unsigned int last_length;
-    uint8_t bitmask, byte, check_byte;
+    uint8_t last_overruns = 0;
     for (;;) {
         // Wait for an edge from the input ISR and copy the length of the period.
-        //
-        // The specification says to allow 52-64µs periods for a one-bit, and
-        // 90-10,000µs for zero-bit. The upper-bound is already handled by timer,
-        // so only check for too-short or intermediate invalid period lengths.
         unsigned int length = wait_for_edge();
-        int bit;
-        if (length >= 90 * 2) {
-            bit = 0;
-        } else if ((length >= 52 * 2) && (length <= 64 * 2)) {
-            bit = 1;
-        } else {
-            // On an invalid bit length, attempt to resynchronize.
-            preamble_half_bits = 0;
-            state = SEEKING_PREAMBLE;
-            uprintf("\aBAD LEN %u\r\n", length);
-            continue;
+
+        // If the ring overran, edges were lost since the last one and we can no
+        // longer trust the phase, so resynchronize.
+        uint8_t overruns = edge_overruns;
+        if (overruns != last_overruns) {
+            last_overruns = overruns;
+            dcc_decoder_reset();
+            telemetry_overrun(overruns);
         }
 
-        // Each bit has two periods, how we react to each depends on whether we've
-        // detected the end of the preamble (and thus sychronized the phase), and
-        // which phase that is.
-        switch (state) {
-            case SEEKING_PREAMBLE:
-                // When we're looking for a preamble, we're looking for the first
-                // stretch of at least 10 full one-bits, terminated by a full
-                // zero-bit.
-                if (bit) {
-                    ++preamble_half_bits;
-                } else if (preamble_half_bits >= 20) {
-                    // End of preamble found, the next state is to consume the
-                    // second half of the zero bit.
-                    state = PACKET_START;
-                } else {
-                    preamble_half_bits = 0;
-                }
-                break;
-            case PACKET_START:
-                // If we see anything other than a zero high or low period here it means
-                // we misdetected a period as a zero that shouldn't be, so return
-                // back to seeking the preamble.
-                if (bit) {
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                } else {
-                    bitmask = 1 << 7;
-                    check_byte = 0;
-                    state = PACKET_A;
-                }
-                break;
-            case PACKET_A:
-                // First period in a bit, save which bit it was and the length,
-                // so we can double-check in the second phase next cycle.
-                last_bit = bit;
-                last_length = length;
-                state = PACKET_B;
-                break;
-            case PACKET_B:
-                if (last_bit != bit) {
-                    // Bits must match between phases; if they don't, we've probably
-                    // gone out of phase, so resynchronize again.
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                    uprintf(" \aBAD MATCH %c%c\r\n", last_bit ? 'H' : 'L', bit ? 'H': 'L');
-                } else if (bit && DELTA(length, last_length) > 6 * 2) {
-                    // Double-check the delta of one-bit phases, if we go out of spec,
-                    // treat it the same as if we had non-matching bits and
-                    // resynchronize the phase.
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                    uprintf(" \aBAD DELTA %u %u\r\n", last_length, length);
-                } else if (bitmask) {
-                    // Within the packet there are eight bits to a byte, followed by
-                    // a zero-bit or a one-bit that determines whether more bytes
-                    // follow, or a preamble.
-                    if (bit) {
-                        byte |= bitmask;
-                    } else {
-                        byte &= ~bitmask;
-                    }
-                    bitmask >>= 1;
-                    state = PACKET_A;
-                    uputc(bit ? '1' : '0');
-                } else if (!bit) {
-                    // Zero-bit goes between bytes, accumulate the check byte
-                    // and prepare for the next.
-                    check_byte ^= byte;
-                    bitmask = 1 << 7;
-                    state = PACKET_A;
-                    uputc(' ');
-                } else if (byte != check_byte) {
-                    // Check byte doesn't match, but we otherwise kept sychronisation.
-                    // Assume we can carry on, and go back to dumb preamble seeking mode
-                    // and hope the next time the packet is sent, it comes in fine.
-                    preamble_half_bits = 0;
-                    state = SEEKING_PREAMBLE;
-                    uputs(" \aERR\r\n");
-                } else {
-                    // Check byte matches the error check byte in the stream.
-                    // Now we've reached the end of a packet, and go back into
-                    // dumb preamble seeking mode.
-                    state = SEEKING_PREAMBLE;
-                    preamble_half_bits = 0;
-                    uputs(" OK\r\n");
-                }
-                break;
+        enum dcc_result result = dcc_decode(length);
+        if (result == DCC_PACKET)
+            railcom_store_packet();
+#if DCC_CAPTURE
+        if (result == DCC_PACKET) {
+            telemetry_capture(edge_timestamp);
+        } else {
+            telemetry_decode(result, length);
         }
+#else
+        if (result != DCC_PACKET || !packet_cache_repeat(&dcc_decoder.packet))
+            telemetry_decode(result, length);
+#endif
+#if DETECTOR_ZONES
+        zone_report();
+        zone_occupancy_poll();
+#else
+        railcom_report();
+#endif
+        railcom_stats_poll();
+        glitch_poll();
+        packet_cache_poll();
+        telemetry_poll();
     }
 }
@@ -0,0 +1,103 @@
+//
+//  log.h
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#ifndef SIGNALBOX_LOG_H
+#define SIGNALBOX_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+// Deferred Logging
+// ----------------
+// Rather than formatting messages on the AVR, log messages are sent as
+// telemetry records containing only a message identifier and the raw values
+// of the arguments; the format strings never make it into the firmware, and
+// are instead used by the host to expand the message back into text.
+//
+// The format strings use a small subset of printf conversions, which also
+// give the size of each argument in the record:
+//
+//   %u    16-bit unsigned integer
+//   %hhu  8-bit unsigned integer
+//   %hhx  8-bit unsigned integer, in hexadecimal
+//   %c    8-bit character
+//
+// Where there are fewer arguments than conversions, the message is truncated
+// before the first missing argument.
+//
+// The matching table for the Pi is `LogMessage` in the DCC module, and the
+// two must be kept in sync.
+
+#define LOG_MESSAGES(_) \
+    _(LOG_BAD_LEN,          0x01, "BAD LEN %u") \
+    _(LOG_BAD_MATCH,        0x02, "BAD MATCH %c%c") \
+    _(LOG_BAD_DELTA,        0x03, "BAD DELTA %u %u") \
+    _(LOG_TOO_LONG,         0x04, "TOO LONG") \
+    _(LOG_ERR,              0x05, "ERR %hhx %hhx %hhx %hhx %hhx %hhx") \
+    _(LOG_OVERRUN,          0x06, "OVERRUN %hhu") \
+    _(LOG_GLITCHES,         0x07, "GLITCHES %u") \
+    _(LOG_HARD_OVERLOAD,    0x10, "HARD OVERLOAD %u") \
+    _(LOG_SLOW_OVERLOAD,    0x11, "SLOW OVERLOAD %u") \
+    _(LOG_CUTOUT_LATE,      0x12, "CUTOUT LATE %u") \
+    _(LOG_RAILCOM_DELAY,    0x13, "RAILCOM DELAY %u") \
+    _(LOG_DECODE_ERRORS,    0x14, "DECODE ERRORS %hhu") \
+    _(LOG_PACKET_OVERRUN,   0x15, "PACKET OVERRUN %hhu") \
+    _(LOG_BAD_COMMAND,      0x16, "BAD COMMAND %hhx %hhx") \
+    _(LOG_SETTINGS_SAVED,   0x17, "SETTINGS SAVED") \
+    _(LOG_SETTINGS_DEFAULT, 0x18, "SETTINGS DEFAULT")
+
+enum log_message {
+#define _(name, id, format) name = id,
+    LOG_MESSAGES(_)
+#undef _
+};
+
+// Send a log message with the raw arguments.
+static inline void
+log_send(uint8_t message, const void *args, uint8_t length)
+{
+    telemetry_log(message, args, length);
+}
+
+// Send a log message without arguments.
+static inline void
+log_message(uint8_t message)
+{
+    log_send(message, NULL, 0);
+}
+
+// Send a log message with 8-bit arguments, for %hhu, %hhx or %c.
+static inline void
+log_u8(uint8_t message, uint8_t a)
+{
+    log_send(message, &a, sizeof a);
+}
+
+static inline void
+log_u8_u8(uint8_t message, uint8_t a, uint8_t b)
+{
+    uint8_t args[2] = { a, b };
+    log_send(message, args, sizeof args);
+}
+
+// Send a log message with 16-bit arguments, for %u.
+static inline void
+log_u16(uint8_t message, uint16_t a)
+{
+    log_send(message, &a, sizeof a);
+}
+
+static inline void
+log_u16_u16(uint8_t message, uint16_t a, uint16_t b)
+{
+    uint16_t args[2] = { a, b };
+    log_send(message, args, sizeof args);
+}
+
+#endif  // SIGNALBOX_LOG_H
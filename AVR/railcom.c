@@ -0,0 +1,152 @@
+//
+//  railcom.c
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#include "railcom.h"
+
+#include <avr/pgmspace.h>
+
+#include <stdint.h>
+
+
+// MARK: 4/8 Code
+
+// 4/8 Code
+// --------
+// Each byte transmitted by a RailCom decoder has exactly four bits set, and
+// encodes a 6-bit value, or one of the ACK, NACK, or BUSY indications; there
+// are two encodings for ACK, and the two remaining 4/8 bytes are reserved.
+// Any other byte is invalid, most likely a collision between two decoders or
+// noise on the track.
+//
+// Since there is no simple relationship between the byte and the value, a
+// 256-entry table in flash is used to decode them, generated from the
+// encoding table in RCN-217.
+
+#define ____ RAILCOM_INVALID
+#define _ACK RAILCOM_ACK
+#define NACK RAILCOM_NACK
+#define BUSY RAILCOM_BUSY
+
+const uint8_t railcom_decode_table[256] PROGMEM = {
+    /* 0x00 */ ____, ____, ____, ____, ____, ____, ____, ____,
+    /* 0x08 */ ____, ____, ____, ____, ____, ____, ____, _ACK,
+    /* 0x10 */ ____, ____, ____, ____, ____, ____, ____, 0x33,
+    /* 0x18 */ ____, ____, ____, 0x34, ____, 0x35, 0x36, ____,
+    /* 0x20 */ ____, ____, ____, ____, ____, ____, ____, 0x3a,
+    /* 0x28 */ ____, ____, ____, 0x3b, ____, 0x3c, 0x37, ____,
+    /* 0x30 */ ____, ____, ____, 0x3f, ____, 0x3d, 0x38, ____,
+    /* 0x38 */ ____, 0x3e, 0x39, ____, NACK, ____, ____, ____,
+    /* 0x40 */ ____, ____, ____, ____, ____, ____, ____, 0x24,
+    /* 0x48 */ ____, ____, ____, 0x23, ____, 0x22, 0x21, ____,
+    /* 0x50 */ ____, ____, ____, 0x1f, ____, 0x1e, 0x20, ____,
+    /* 0x58 */ ____, 0x1d, 0x1c, ____, 0x1b, ____, ____, ____,
+    /* 0x60 */ ____, ____, ____, 0x19, ____, 0x18, 0x1a, ____,
+    /* 0x68 */ ____, 0x17, 0x16, ____, 0x15, ____, ____, ____,
+    /* 0x70 */ ____, 0x25, 0x14, ____, 0x13, ____, ____, ____,
+    /* 0x78 */ 0x32, ____, ____, ____, ____, ____, ____, ____,
+    /* 0x80 */ ____, ____, ____, ____, ____, ____, ____, ____,
+    /* 0x88 */ ____, ____, ____, 0x0e, ____, 0x0d, 0x0c, ____,
+    /* 0x90 */ ____, ____, ____, 0x0a, ____, 0x09, 0x0b, ____,
+    /* 0x98 */ ____, 0x08, 0x07, ____, 0x06, ____, ____, ____,
+    /* 0xa0 */ ____, ____, ____, 0x04, ____, 0x03, 0x05, ____,
+    /* 0xa8 */ ____, 0x02, 0x01, ____, 0x00, ____, ____, ____,
+    /* 0xb0 */ ____, 0x0f, 0x10, ____, 0x11, ____, ____, ____,
+    /* 0xb8 */ 0x12, ____, ____, ____, ____, ____, ____, ____,
+    /* 0xc0 */ ____, ____, ____, ____, ____, 0x2b, 0x30, ____,
+    /* 0xc8 */ ____, 0x2a, 0x2f, ____, 0x31, ____, ____, ____,
+    /* 0xd0 */ ____, 0x29, 0x2e, ____, 0x2d, ____, ____, ____,
+    /* 0xd8 */ 0x2c, ____, ____, ____, ____, ____, ____, ____,
+    /* 0xe0 */ ____, BUSY, 0x28, ____, 0x27, ____, ____, ____,
+    /* 0xe8 */ 0x26, ____, ____, ____, ____, ____, ____, ____,
+    /* 0xf0 */ _ACK, ____, ____, ____, ____, ____, ____, ____,
+    /* 0xf8 */ ____, ____, ____, ____, ____, ____, ____, ____,
+};
+
+#undef ____
+#undef _ACK
+#undef NACK
+#undef BUSY
+
+
+// MARK: Datagrams
+
+// Datagrams
+// ---------
+// Channel 1 holds a single 12-bit datagram of two bytes, a 4-bit identifier
+// and 8 bits of data; used to broadcast the decoder's address in two halves.
+//
+// Channel 2 holds up to six bytes, which may be one or more datagrams whose
+// length depends on the identifier, or single ACK, NACK, or BUSY bytes.
+
+// Return the length in bytes of a channel 2 datagram with the given
+// identifier, or 0 if the length is unknown.
+static inline uint8_t
+railcom_datagram_length(uint8_t id)
+{
+    switch (id) {
+        case 0:  // POM
+            return 2;
+        case 3:  // EXT
+        case 7:  // DYN
+            return 3;
+        case 8:  // XPOM
+        case 9:
+        case 10:
+        case 11:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+uint8_t
+railcom_parse(const uint8_t *bytes, uint8_t length, uint8_t channel,
+              struct railcom_datagram *datagram)
+{
+    uint8_t value, datagram_length;
+
+    if (!length)
+        return 0;
+
+    value = railcom_decode(bytes[0]);
+    if (value == RAILCOM_INVALID)
+        return 0;
+
+    if (value >= RAILCOM_ACK) {
+        datagram->id = value;
+        datagram->length = 1;
+        datagram->data = 0;
+        return 1;
+    }
+
+    datagram->id = value >> 2;
+
+    if (channel == 1) {
+        if (datagram->id != RAILCOM_ID_ADR_HIGH && datagram->id != RAILCOM_ID_ADR_LOW)
+            return 0;
+        datagram_length = 2;
+    } else {
+        datagram_length = railcom_datagram_length(datagram->id);
+        if (!datagram_length)
+            return 0;
+    }
+
+    if (datagram_length > length)
+        return 0;
+
+    datagram->length = datagram_length;
+    datagram->data = value & 0x03;
+    for (uint8_t i = 1; i < datagram_length; ++i) {
+        value = railcom_decode(bytes[i]);
+        if (value >= RAILCOM_ACK)
+            return 0;
+
+        datagram->data = (datagram->data << 6) | value;
+    }
+
+    return datagram_length;
+}
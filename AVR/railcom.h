@@ -0,0 +1,66 @@
+//
+//  railcom.h
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#ifndef SIGNALBOX_RAILCOM_H
+#define SIGNALBOX_RAILCOM_H
+
+#include <avr/pgmspace.h>
+
+#include <stdint.h>
+
+// Values of the 4/8 encoded bytes that are not data.
+#define RAILCOM_ACK      0x40
+#define RAILCOM_NACK     0x41
+#define RAILCOM_BUSY     0x42
+#define RAILCOM_INVALID  0xff
+
+// Datagram identifiers permitted in channel 1.
+#define RAILCOM_ID_ADR_HIGH  1
+#define RAILCOM_ID_ADR_LOW   2
+
+extern const uint8_t railcom_decode_table[256] PROGMEM;
+
+// Return the 6-bit value of a 4/8 encoded byte, or one of the non-data values
+// above.
+static inline uint8_t
+railcom_decode(uint8_t byte)
+{
+    return pgm_read_byte(&railcom_decode_table[byte]);
+}
+
+// Datagram received in a RailCom response.
+struct railcom_datagram {
+    // 4-bit identifier, or one of RAILCOM_ACK, RAILCOM_NACK, or RAILCOM_BUSY.
+    uint8_t id;
+    // Number of response bytes the datagram occupied.
+    uint8_t length;
+    // Bits following the identifier.
+    uint32_t data;
+};
+
+// Counts of RailCom bytes received by a detector since startup, and of
+// errors, which cause bytes to be discarded.
+struct railcom_stats {
+    // Valid bytes received, including those discarded due to other errors.
+    uint16_t received;
+    // Bytes without a valid stop bit.
+    uint16_t framing;
+    // Bytes lost because the USART's receive buffer was full.
+    uint16_t overruns;
+    // Bytes that were not valid 4/8 codes, or were a third byte in channel 1.
+    uint16_t invalid;
+};
+
+// Parse a datagram from the start of the 4/8 encoded bytes of a response in
+// the given channel (1 or 2).
+//
+// Returns the number of bytes used for the datagram, or 0 if the bytes do not
+// start with a valid datagram for the channel.
+uint8_t railcom_parse(const uint8_t *bytes, uint8_t length, uint8_t channel,
+                      struct railcom_datagram *datagram);
+
+#endif  // SIGNALBOX_RAILCOM_H
@@ -0,0 +1,364 @@
+//
+//  telemetry.c
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#include "telemetry.h"
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "dcc_decoder.h"
+#include "log.h"
+#include "railcom.h"
+#include "uart.h"
+
+
+#if DEBUG || TELEMETRY_SPI
+// Records sent, from `enum telemetry_flag`.
+static uint8_t telemetry_flags = TELEMETRY_SEND_ALL;
+
+// Return the UART lane for records of the given type.
+static inline enum uart_lane
+telemetry_lane(uint8_t type)
+{
+    switch (type) {
+        case TELEMETRY_START:
+        case TELEMETRY_DROPPED:
+        case TELEMETRY_CONDITION:
+        case TELEMETRY_OVERLOAD:
+        case TELEMETRY_SETTING:
+        case TELEMETRY_PROBE:
+        case TELEMETRY_ACK:
+        case TELEMETRY_JOURNAL:
+        case TELEMETRY_OCCUPANCY:
+            return UART_HIGH;
+        default:
+            return UART_BULK;
+    }
+}
+
+void
+telemetry_send(uint8_t type, const void *payload, uint8_t length)
+{
+    // Frames are at most 254 bytes, so the COBS code never needs the special
+    // 0xff case; each zero is replaced by the offset to the next, with an
+    // extra code byte at the start and the zero terminator at the end.
+    uint8_t frame[TELEMETRY_MAX_PAYLOAD + 3];
+    uint8_t code_index = 0, index = 1, code = 1;
+    const uint8_t *data = payload;
+
+    if (length > TELEMETRY_MAX_PAYLOAD)
+        length = TELEMETRY_MAX_PAYLOAD;
+
+    for (int16_t i = -1; i < length; ++i) {
+        uint8_t byte = i < 0 ? type : data[i];
+        if (byte) {
+            frame[index++] = byte;
+            ++code;
+        } else {
+            frame[code_index] = code;
+            code_index = index++;
+            code = 1;
+        }
+    }
+
+    frame[code_index] = code;
+    frame[index++] = 0;
+
+    uart_write(telemetry_lane(type), frame, index);
+}
+
+void
+telemetry_log(uint8_t message, const void *args, uint8_t length)
+{
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+
+    if (length > TELEMETRY_MAX_PAYLOAD - 1)
+        length = TELEMETRY_MAX_PAYLOAD - 1;
+
+    payload[0] = message;
+    memcpy(payload + 1, args, length);
+    telemetry_send(TELEMETRY_LOG, payload, 1 + length);
+}
+
+void
+telemetry_set_flags(uint8_t flags)
+{
+    telemetry_flags = flags;
+}
+
+void
+telemetry_decode(enum dcc_result result, unsigned int length)
+{
+    if (result == DCC_PACKET ? !(telemetry_flags & TELEMETRY_SEND_PACKETS)
+                             : !(telemetry_flags & TELEMETRY_SEND_ERRORS))
+        return;
+
+    switch (result) {
+        case DCC_CONTINUE:
+            break;
+        case DCC_PACKET:
+            telemetry_send(TELEMETRY_PACKET, dcc_decoder.packet.data, dcc_decoder.packet.length);
+            break;
+        case DCC_BAD_LEN:
+            log_u16(LOG_BAD_LEN, length);
+            break;
+        case DCC_BAD_MATCH:
+            if (dcc_decoder.last_bit) {
+                log_u8_u8(LOG_BAD_MATCH, 'H', 'L');
+            } else {
+                log_u8_u8(LOG_BAD_MATCH, 'L', 'H');
+            }
+            break;
+        case DCC_BAD_DELTA:
+            log_u16_u16(LOG_BAD_DELTA, dcc_decoder.last_length, length);
+            break;
+        case DCC_TOO_LONG:
+            log_message(LOG_TOO_LONG);
+            break;
+        case DCC_ERR:
+            log_send(LOG_ERR, dcc_decoder.packet.data, dcc_decoder.packet.length);
+            break;
+    }
+}
+
+void
+telemetry_overrun(uint8_t overruns)
+{
+    log_u8(LOG_OVERRUN, overruns);
+}
+
+void
+telemetry_repeats(const struct dcc_packet *packet, uint16_t count)
+{
+    uint8_t payload[2 + DCC_MAX_PACKET_LENGTH];
+
+    memcpy(payload, &count, 2);
+    memcpy(payload + 2, packet->data, packet->length);
+    telemetry_send(TELEMETRY_REPEATS, payload, 2 + packet->length);
+}
+
+#if DCC_CAPTURE
+void
+telemetry_capture(uint32_t timestamp)
+{
+    uint8_t payload[9 + DCC_MAX_PACKET_LENGTH];
+
+    if (!(telemetry_flags & TELEMETRY_SEND_PACKETS))
+        return;
+
+    memcpy(payload, &timestamp, 4);
+    payload[4] = dcc_decoder.preamble_bits;
+    memcpy(payload + 5, &dcc_decoder.capture_min_length, 2);
+    memcpy(payload + 7, &dcc_decoder.capture_max_length, 2);
+    memcpy(payload + 9, dcc_decoder.packet.data, dcc_decoder.packet.length);
+    telemetry_send(TELEMETRY_CAPTURE, payload, 9 + dcc_decoder.packet.length);
+}
+#endif
+
+void
+telemetry_railcom_bytes(uint8_t zone, const uint8_t *bytes, uint8_t length)
+{
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+
+    if (zone == TELEMETRY_NO_ZONE) {
+        telemetry_send(TELEMETRY_RAILCOM, bytes, length);
+        return;
+    }
+
+    if (length > TELEMETRY_MAX_PAYLOAD - 1)
+        length = TELEMETRY_MAX_PAYLOAD - 1;
+
+    payload[0] = zone;
+    memcpy(payload + 1, bytes, length);
+    telemetry_send(TELEMETRY_ZONE_RAILCOM, payload, 1 + length);
+}
+
+void
+telemetry_railcom(uint8_t zone, uint8_t channel, uint16_t address, const struct railcom_datagram *datagram)
+{
+    uint8_t payload[5 + sizeof datagram->data];
+    uint8_t length = 0;
+
+    // Each byte after the first carries six bits of data, and the first
+    // carries two after the identifier.
+    if (datagram->id < RAILCOM_ACK)
+        length = (datagram->length * 6 - 4 + 7) / 8;
+
+    payload[0] = zone;
+    payload[1] = channel;
+    memcpy(payload + 2, &address, 2);
+    payload[4] = datagram->id;
+    memcpy(payload + 5, &datagram->data, length);
+
+    // The zone is only sent by multi-zone detectors.
+    if (zone == TELEMETRY_NO_ZONE) {
+        telemetry_send(TELEMETRY_RAILCOM_DATAGRAM, payload + 1, 4 + length);
+    } else {
+        telemetry_send(TELEMETRY_ZONE_RAILCOM_DATAGRAM, payload, 5 + length);
+    }
+}
+
+void
+telemetry_railcom_stats(uint8_t zone, const struct railcom_stats *stats)
+{
+    uint8_t payload[1 + sizeof *stats];
+
+    payload[0] = zone;
+    memcpy(payload + 1, stats, sizeof *stats);
+    telemetry_send(TELEMETRY_RAILCOM_STATS, payload, sizeof payload);
+}
+
+void
+telemetry_occupancy(uint8_t zones)
+{
+    telemetry_send(TELEMETRY_OCCUPANCY, &zones, 1);
+}
+
+// Maximum and total awake time since the last awake record, and the number
+// of times counted.
+static uint16_t awake_max;
+static uint32_t awake_total;
+static uint16_t awake_count;
+
+// Return the CPU cycles in the given timer ticks, stopping at the maximum.
+static inline uint16_t
+telemetry_cycles(uint32_t ticks)
+{
+    return ticks <= UINT16_MAX / DCC_TIMER_PRESCALE ? ticks * DCC_TIMER_PRESCALE : UINT16_MAX;
+}
+
+void
+telemetry_awake(uint16_t ticks)
+{
+    if (ticks > awake_max)
+        awake_max = ticks;
+    awake_total += ticks;
+    ++awake_count;
+}
+
+// Return the timer ticks since the last call, which must be less than a
+// TIMER1 overflow ago.
+static inline uint16_t
+telemetry_elapsed()
+{
+    static unsigned int last;
+    unsigned int now, elapsed;
+
+    // Reading TCNT1 uses the shared TEMP register, so must be atomic.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        now = TCNT1;
+    }
+    elapsed = now - last;
+    last = now;
+
+    return elapsed;
+}
+
+#if DCC_HISTOGRAM
+// Send the signal histograms as a series of records, one every
+// TELEMETRY_HISTOGRAM_SPACING_MS following the start of each snapshot,
+// clearing the counts sent; `elapsed` is the timer ticks since the last poll.
+static inline void
+telemetry_histogram(uint16_t elapsed)
+{
+    static uint32_t ticks, part_ticks;
+    static uint8_t sequence, offset = DCC_HISTOGRAM_SIZE;
+    uint8_t payload[2 + TELEMETRY_HISTOGRAM_BUCKETS * 2], length;
+
+    ticks += elapsed;
+    part_ticks += elapsed;
+    if (ticks >= DCC_TICKS(TELEMETRY_HISTOGRAM_MS * 1000UL)) {
+        ticks = 0;
+        ++sequence;
+        offset = 0;
+        part_ticks = DCC_TICKS(TELEMETRY_HISTOGRAM_SPACING_MS * 1000UL);
+    }
+
+    if (offset >= DCC_HISTOGRAM_SIZE || part_ticks < DCC_TICKS(TELEMETRY_HISTOGRAM_SPACING_MS * 1000UL))
+        return;
+    part_ticks = 0;
+
+    length = DCC_HISTOGRAM_SIZE - offset;
+    if (length > TELEMETRY_HISTOGRAM_BUCKETS)
+        length = TELEMETRY_HISTOGRAM_BUCKETS;
+
+    payload[0] = sequence;
+    payload[1] = offset;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint8_t i = 0; i < length; ++i) {
+            uint16_t count = dcc_histogram[offset + i];
+            dcc_histogram[offset + i] = 0;
+            memcpy(payload + 2 + i * 2, &count, 2);
+        }
+    }
+    telemetry_send(TELEMETRY_HISTOGRAM, payload, 2 + length * 2);
+
+    offset += length;
+}
+#else
+static inline void telemetry_histogram(uint16_t elapsed) {}
+#endif
+
+#if DCC_ADAPTIVE
+// Send a timing record with the period centres learned by the decoder.
+static inline void
+telemetry_timing()
+{
+    uint8_t payload[5];
+
+    // The decoder may be run by the edge ISR.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        payload[0] = dcc_decoder.adaptive_packets >= DCC_ADAPTIVE_LOCK_PACKETS;
+        memcpy(payload + 1, &dcc_decoder.adaptive_one, 2);
+        memcpy(payload + 3, &dcc_decoder.adaptive_zero, 2);
+    }
+    telemetry_send(TELEMETRY_TIMING, payload, sizeof payload);
+}
+#else
+static inline void telemetry_timing() {}
+#endif
+
+void
+telemetry_poll()
+{
+    static uint32_t ticks;
+    static uint16_t reported[2];
+    uint16_t awake[2], dropped[2], elapsed;
+
+    elapsed = telemetry_elapsed();
+    if (telemetry_flags & TELEMETRY_SEND_HISTOGRAM)
+        telemetry_histogram(elapsed);
+
+    ticks += elapsed;
+    if (ticks < DCC_TICKS(TELEMETRY_POLL_MS * 1000UL))
+        return;
+    ticks = 0;
+
+    awake[0] = telemetry_cycles(awake_max);
+    awake[1] = telemetry_cycles(awake_count ? awake_total / awake_count : 0);
+    if (telemetry_flags & TELEMETRY_SEND_AWAKE)
+        telemetry_send(TELEMETRY_AWAKE, awake, sizeof awake);
+    awake_max = 0;
+    awake_total = 0;
+    awake_count = 0;
+
+    if (telemetry_flags & TELEMETRY_SEND_HISTOGRAM)
+        telemetry_timing();
+
+    dropped[0] = uart_dropped(UART_HIGH);
+    dropped[1] = uart_dropped(UART_BULK);
+    if (dropped[0] == reported[0] && dropped[1] == reported[1])
+        return;
+
+    telemetry_send(TELEMETRY_DROPPED, dropped, sizeof dropped);
+    reported[0] = dropped[0];
+    reported[1] = dropped[1];
+}
+#endif  // DEBUG || TELEMETRY_SPI
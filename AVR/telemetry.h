@@ -0,0 +1,222 @@
+//
+//  telemetry.h
+//  SignalBox
+//
+//  Created by agent on 10/14/26.
+//
+
+#ifndef SIGNALBOX_TELEMETRY_H
+#define SIGNALBOX_TELEMETRY_H
+
+#include <stdint.h>
+
+#include "dcc_decoder.h"
+#include "railcom.h"
+
+// Telemetry Records
+// -----------------
+// Telemetry is sent over the UART as a series of binary records, each
+// consisting of a type byte followed by a payload that depends on the type.
+// Multi-byte values in payloads are little-endian.
+//
+// Each record is framed with Consistent Overhead Byte Stuffing (COBS), which
+// removes all zero bytes from the record at the cost of one extra byte, so
+// that a zero byte can be used to mark the end of each frame. A receiver can
+// start listening at any point, and synchronizes at the next zero.
+//
+// The matching decoder for the Pi is `TelemetryDecoder` in the DCC module,
+// and the two must be kept in sync.
+
+// Maximum length of a record payload.
+#define TELEMETRY_MAX_PAYLOAD  64
+
+// Time in ms between checks of the dropped byte counts and awake records.
+//
+// Intervals are measured on TIMER1, which both boards run freely for the DCC
+// input, so are the same however often `telemetry_poll()` is called: for each
+// edge, or for each packet with DCC_DECODE_IN_ISR.
+#define TELEMETRY_POLL_MS  500
+
+// Time in ms between snapshots of the decoder's signal histograms, and
+// between each part of a snapshot, and the number of buckets in each part.
+#define TELEMETRY_HISTOGRAM_MS          2000
+#define TELEMETRY_HISTOGRAM_SPACING_MS  4
+#define TELEMETRY_HISTOGRAM_BUCKETS     16
+
+enum telemetry_type {
+    // Firmware has started; no payload.
+    TELEMETRY_START = 0x01,
+    // Log message; payload is a message identifier from `enum log_message`
+    // in log.h, followed by the raw arguments.
+    TELEMETRY_LOG = 0x02,
+    // Bytes dropped by the UART; payload is the 16-bit running counts for
+    // the high priority and best effort lanes.
+    TELEMETRY_DROPPED = 0x03,
+    // Time the main loop was awake for each edge; payload is the 16-bit
+    // maximum and average in CPU cycles since the last record, which stop at
+    // their maximum.
+    TELEMETRY_AWAKE = 0x04,
+
+    // Valid packet decoded; payload is the packet bytes, including the
+    // error detection byte.
+    TELEMETRY_PACKET = 0x10,
+    // Repeats of a packet since its last packet or repeats record; payload is
+    // the 16-bit count, followed by the packet bytes.
+    TELEMETRY_REPEATS = 0x11,
+    // Part of a snapshot of the decoder's signal histograms; payload is the
+    // snapshot sequence number, the offset of the first bucket within
+    // `dcc_histogram`, and the 16-bit counts of the buckets from there.
+    TELEMETRY_HISTOGRAM = 0x12,
+    // Valid packet captured, sent for every packet in place of packet and
+    // repeats records when built with DCC_CAPTURE; payload is the 32-bit
+    // timestamp in timer ticks of the edge that completed it, the number of
+    // one-bits in its preamble, the 16-bit shortest and longest period
+    // lengths from the start of the preamble, and the packet bytes.
+    TELEMETRY_CAPTURE = 0x13,
+    // Period centres learned by a decoder built with DCC_ADAPTIVE; payload is
+    // 1 if its windows are narrowed around them or 0 if not, followed by the
+    // 16-bit one-bit and zero-bit centres in timer ticks, with
+    // DCC_ADAPTIVE_SHIFT bits of fraction.
+    TELEMETRY_TIMING = 0x14,
+
+    // Booster condition changed; payload is the condition bitmask.
+    TELEMETRY_CONDITION = 0x20,
+    // Booster overload recovery changed state; payload is the state and the
+    // number of consecutive failures.
+    TELEMETRY_OVERLOAD = 0x21,
+    // Booster setting value, in response to a command; payload is the
+    // setting identifier and the 16-bit value.
+    TELEMETRY_SETTING = 0x22,
+    // Probe packet decoded by a booster built with LATENCY_PROBE; payload is
+    // the sequence number of the probe, followed by the 32-bit extended
+    // timestamp of the edge that completed it.
+    TELEMETRY_PROBE = 0x23,
+    // Service mode acknowledgement window closed on a booster built with
+    // SERVICE_MODE_ACK; payload is 1 if an acknowledgement was detected or 0
+    // if not, followed by the 16-bit delay in µs from the last service mode
+    // packet to the rise in current, and the 16-bit rise in mA.
+    TELEMETRY_ACK = 0x24,
+    // Record of the fault journal of a booster built with FAULT_JOURNAL, in
+    // response to a command; payload is the 16-bit sequence number, the
+    // journal record type, the 32-bit count of TIMER1 overflows since
+    // startup, and 8 bytes of data that depend on the type, see booster.c.
+    // The last record of the journal is followed by one with no payload.
+    TELEMETRY_JOURNAL = 0x25,
+
+    // RailCom bytes received during a cutout that could not be decoded;
+    // payload is the raw bytes.
+    TELEMETRY_RAILCOM = 0x30,
+    // RailCom datagram decoded; payload is the channel, the 16-bit address of
+    // the packet preceding the cutout from `dcc_packet_address()`, the
+    // identifier (or ACK, NACK, or BUSY value), and the data bits in as few
+    // bytes as needed.
+    TELEMETRY_RAILCOM_DATAGRAM = 0x31,
+    // RailCom bytes received in a zone of a multi-zone detector that could
+    // not be decoded; payload is the zone, followed by the raw bytes.
+    TELEMETRY_ZONE_RAILCOM = 0x32,
+    // RailCom datagram decoded in a zone of a multi-zone detector; payload is
+    // the zone, followed by the same payload as a RailCom datagram record.
+    TELEMETRY_ZONE_RAILCOM_DATAGRAM = 0x33,
+    // Occupancy of the zones of a multi-zone detector changed; payload is the
+    // bitmask of occupied zones.
+    TELEMETRY_OCCUPANCY = 0x34,
+    // Counts of RailCom bytes received by a detector and of errors, since
+    // startup; payload is the zone, or TELEMETRY_NO_ZONE for a detector
+    // without multiple zones, followed by the 16-bit counts of bytes
+    // received, framing errors, data overruns, and invalid bytes.
+    TELEMETRY_RAILCOM_STATS = 0x35,
+};
+
+// Zone for RailCom records from a detector without multiple zones, which are
+// sent as the records without a zone.
+#define TELEMETRY_NO_ZONE  0xff
+
+// Optional records, for `telemetry_set_flags()`; records not listed here are
+// always sent.
+enum telemetry_flag {
+    // Packet records from `telemetry_decode()`, and capture records.
+    TELEMETRY_SEND_PACKETS = 1 << 0,
+    // Log messages for decoding errors from `telemetry_decode()`.
+    TELEMETRY_SEND_ERRORS = 1 << 1,
+    // Awake records.
+    TELEMETRY_SEND_AWAKE = 1 << 2,
+    // Histogram and timing records.
+    TELEMETRY_SEND_HISTOGRAM = 1 << 3,
+
+    TELEMETRY_SEND_ALL = 0x0f,
+};
+
+#if DEBUG || TELEMETRY_SPI
+// Send a record with the given type and payload.
+//
+// Start, condition, overload, setting, probe, ack, journal, occupancy, and
+// dropped records are sent in the UART's high priority lane, all others are
+// best effort.
+void telemetry_send(uint8_t type, const void *payload, uint8_t length);
+
+// Send a log message record with the given message and raw arguments;
+// generally called through the helpers in log.h.
+void telemetry_log(uint8_t message, const void *args, uint8_t length);
+
+// Set the optional records that are sent, from `enum telemetry_flag`; all are
+// sent by default.
+void telemetry_set_flags(uint8_t flags);
+
+// Send the record for the result of decoding a period of the given length,
+// if there is one.
+void telemetry_decode(enum dcc_result result, unsigned int length);
+
+// Send a log message for lost edges.
+void telemetry_overrun(uint8_t overruns);
+
+// Send a repeats record for the given packet.
+void telemetry_repeats(const struct dcc_packet *packet, uint16_t count);
+
+// Send a capture record for the packet just decoded, completed by the edge
+// at the given extended timestamp; only available when built with
+// DCC_CAPTURE.
+void telemetry_capture(uint32_t timestamp);
+
+// Send a record for RailCom bytes received in the given zone, or
+// TELEMETRY_NO_ZONE, that could not be decoded.
+void telemetry_railcom_bytes(uint8_t zone, const uint8_t *bytes, uint8_t length);
+
+// Send a record for a decoded RailCom datagram received in the given zone, or
+// TELEMETRY_NO_ZONE, and channel, in response to a packet with the given
+// address.
+void telemetry_railcom(uint8_t zone, uint8_t channel, uint16_t address, const struct railcom_datagram *datagram);
+
+// Send a statistics record for the RailCom bytes received in the given zone,
+// or TELEMETRY_NO_ZONE.
+void telemetry_railcom_stats(uint8_t zone, const struct railcom_stats *stats);
+
+// Send an occupancy record for the given bitmask of occupied zones.
+void telemetry_occupancy(uint8_t zones);
+
+// Record the time in timer ticks the main loop was awake for the last edge,
+// or packet.
+void telemetry_awake(uint16_t ticks);
+
+// Periodically send an awake record, a dropped record when the UART has
+// dropped bytes since the last, when built with DCC_HISTOGRAM a snapshot of
+// the signal histograms, and when built with DCC_ADAPTIVE a timing record;
+// called from the main loop, at least once every TIMER1 overflow while there
+// is a DCC signal.
+void telemetry_poll();
+#else  // DEBUG || TELEMETRY_SPI
+static inline void telemetry_send(uint8_t type, const void *payload, uint8_t length) {}
+static inline void telemetry_log(uint8_t message, const void *args, uint8_t length) {}
+static inline void telemetry_set_flags(uint8_t flags) {}
+static inline void telemetry_decode(enum dcc_result result, unsigned int length) {}
+static inline void telemetry_overrun(uint8_t overruns) {}
+static inline void telemetry_repeats(const struct dcc_packet *packet, uint16_t count) {}
+static inline void telemetry_capture(uint32_t timestamp) {}
+static inline void telemetry_railcom_bytes(uint8_t zone, const uint8_t *bytes, uint8_t length) {}
+static inline void telemetry_railcom(uint8_t zone, uint8_t channel, uint16_t address, const struct railcom_datagram *datagram) {}
+static inline void telemetry_railcom_stats(uint8_t zone, const struct railcom_stats *stats) {}
+static inline void telemetry_occupancy(uint8_t zones) {}
+static inline void telemetry_awake(uint16_t ticks) {}
+static inline void telemetry_poll() {}
+#endif  // DEBUG || TELEMETRY_SPI
+
+#endif  // SIGNALBOX_TELEMETRY_H
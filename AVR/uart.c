@@ -9,16 +9,71 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
 
 #include <stdint.h>
-#include <stdio.h>
-#include <stdlib.h>
 
 
-#if DEBUG
-#define UBUFFER_SIZE 256
-volatile char ubuffer[UBUFFER_SIZE];
-volatile uint8_t uput, usend;
+#if DEBUG || TELEMETRY_SPI
+// Transmit Buffers
+// ----------------
+// Each lane has its own ring buffer, with free-running indexes, so that the
+// number of bytes waiting is always `put - send` and the buffer is full when
+// that equals its size. Sizes must be powers of two.
+//
+// The high priority lane only carries small records, so is kept short; a
+// block that would never fit is always dropped.
+//
+// Interrupts are only disabled while space for a block is reserved, by
+// advancing `reserve` past it, and while it is published; the block is
+// copied in between with interrupts enabled, so that writing a frame from an
+// ISR or the main loop doesn't delay the edge and cutout ISRs. An ISR may
+// write a block while the main loop is part-way through copying its own, so
+// `put` is only advanced to `reserve` once the last writer has finished,
+// publishing both blocks in the order they were reserved.
+#define UHIGH_SIZE 64
+volatile uint8_t uhigh[UHIGH_SIZE];
+volatile uint8_t uhigh_put, uhigh_reserve, uhigh_send;
+
+#define UBULK_SIZE 128
+volatile uint8_t ubulk[UBULK_SIZE];
+volatile uint8_t ubulk_put, ubulk_reserve, ubulk_send;
+
+// Number of blocks reserved but not yet copied.
+volatile uint8_t uwriters;
+
+// Set while a best effort frame is part-way sent.
+volatile uint8_t usending_bulk;
+
+volatile uint16_t udropped[2];
+
+#if TELEMETRY_SPI
+// SPI Transport
+// -------------
+// When built with TELEMETRY_SPI the lanes are drained by the SPI, as a slave
+// in mode 0, rather than by the USART, so that a Raspberry Pi can poll many
+// boards on one bus at a higher rate, each with its own chip select on SS
+// (B2). The USART is still used for receiving.
+//
+// The SPI doesn't release MISO (B4) itself while SS is high, it drives it
+// whenever DDB4 is set, so boards sharing it would contend; instead a pin
+// change interrupt on SS sets DDB4 only while SS is low, and the Pi must
+// leave time after asserting the chip select for it to run.
+//
+// The Pi clocks out zeros on MOSI, and each byte clocked in is the next from
+// the lanes, or zero when they are empty, which the telemetry decoder takes
+// as an empty frame. The SPI has no transmit buffer, so the byte for each
+// transfer is loaded by the ISR for the one before, and the Pi must leave
+// time between bytes for it to run; see `SPI` in the RaspberryPi module.
+//
+// The ISR is late whenever interrupts are disabled, or another ISR is
+// running, for longer than that time after a byte, such as the edge ISR of a
+// booster built with DCC_DECODE_IN_ISR, or a detector built with
+// DETECTOR_ZONES sampling the cutout. Writing SPDR during a transfer is
+// ignored and sets WCOL, and the zero received is sent instead, ending the
+// frame early so that the decoder discards it; the byte is only taken from
+// its lane once loaded, so the frames after are unaffected.
+#endif
 
 void
 uart_init()
@@ -31,44 +86,147 @@ uart_init()
     UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
     UBRR0H = 0;
     UBRR0L = 0x03;
+
+#if TELEMETRY_SPI
+    // Configure the SPI as a slave with the interrupt enabled, and a zero
+    // ready for the first transfer. MISO is left as an input until SS is
+    // low, with an interrupt for each change of SS.
+    SPCR = _BV(SPIE) | _BV(SPE);
+    SPDR = 0;
+    PCMSK0 |= _BV(PCINT2);
+    PCICR |= _BV(PCIE0);
+#endif
 }
 
 void
-uputc(char ch)
+uart_write(enum uart_lane lane, const uint8_t *data, uint8_t length)
 {
-    ubuffer[uput++] = ch;
-    UCSR0B |= _BV(UDRIE0);
+    volatile uint8_t *buffer;
+    uint8_t mask, index;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (lane == UART_HIGH) {
+            if (length > UHIGH_SIZE - (uint8_t)(uhigh_reserve - uhigh_send)) {
+                udropped[lane] += length;
+                return;
+            }
+
+            buffer = uhigh;
+            mask = UHIGH_SIZE - 1;
+            index = uhigh_reserve;
+            uhigh_reserve = index + length;
+        } else {
+            if (length > UBULK_SIZE - (uint8_t)(ubulk_reserve - ubulk_send)) {
+                udropped[lane] += length;
+                return;
+            }
+
+            buffer = ubulk;
+            mask = UBULK_SIZE - 1;
+            index = ubulk_reserve;
+            ubulk_reserve = index + length;
+        }
+
+        ++uwriters;
+    }
+
+    while (length--)
+        buffer[index++ & mask] = *data++;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!--uwriters) {
+            uhigh_put = uhigh_reserve;
+            ubulk_put = ubulk_reserve;
+#if !TELEMETRY_SPI
+            UCSR0B |= _BV(UDRIE0);
+#endif
+        }
+    }
 }
 
-void
-uputs(const char *str)
+uint16_t
+uart_dropped(enum uart_lane lane)
 {
-    while (*str)
-        uputc(*str++);
+    uint16_t dropped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dropped = udropped[lane];
+    }
+    return dropped;
 }
 
-void
-uprintf(const char *format, ...)
+// Copy the next byte to transmit from the lanes into `byte`, returning
+// whether there was one; it's left in its lane until `uart_take()`.
+static inline uint8_t
+uart_peek(uint8_t *byte)
 {
-    char data[UBUFFER_SIZE];
-    va_list args;
+    // Drain the high priority lane first, but never in the middle of a best
+    // effort frame; since blocks are written whole, that frame's remaining
+    // bytes are always already in the buffer.
+    if (!usending_bulk && uhigh_put != uhigh_send) {
+        *byte = uhigh[uhigh_send % UHIGH_SIZE];
+    } else if (ubulk_put != ubulk_send) {
+        *byte = ubulk[ubulk_send % UBULK_SIZE];
+    } else {
+        return 0;
+    }
 
-    va_start(args, format);
-    vsnprintf(data, UBUFFER_SIZE, format, args);
-    va_end(args);
+    return 1;
+}
 
-    data[UBUFFER_SIZE - 1] = '\0';
-    uputs(data);
+// Take the byte last copied by `uart_peek()` from its lane, once it has been
+// transmitted; called from the same ISR, so the lanes can't have changed.
+static inline void
+uart_take(uint8_t byte)
+{
+    if (!usending_bulk && uhigh_put != uhigh_send) {
+        ++uhigh_send;
+    } else {
+        ++ubulk_send;
+        usending_bulk = byte != 0;
+    }
 }
 
+#if TELEMETRY_SPI
+// Pin Change Interrupt Request 0
+// Fires when SS changes.
+//
+// Drive MISO only while this board is selected.
+ISR(PCINT0_vect)
+{
+    if (bit_is_clear(PINB, PB2)) {
+        DDRB |= _BV(PB4);
+    } else {
+        DDRB &= ~_BV(PB4);
+    }
+}
+
+// SPI Serial Transfer Complete Interrupt
+// Fires when the master has clocked a byte in.
+ISR(SPI_STC_vect)
+{
+    uint8_t byte = 0, next;
+
+    next = uart_peek(&byte);
+    SPDR = byte;
+
+    // Reading SPSR with WCOL set, and then writing SPDR in the next ISR,
+    // clears it; so it's read every time.
+    if (!(SPSR & _BV(WCOL)) && next)
+        uart_take(byte);
+}
+#else
 // USART Data Register Empty Interrupt
 // Fires when the USART is ready to transmit a byte.
 ISR(USART_UDRE_vect)
 {
-    if (uput != usend) {
-        UDR0 = ubuffer[usend++];
+    uint8_t byte;
+
+    if (uart_peek(&byte)) {
+        UDR0 = byte;
+        uart_take(byte);
     } else {
         UCSR0B &= ~_BV(UDRIE0);
     }
 }
-#endif  // DEBUG
+#endif
+#endif  // DEBUG || TELEMETRY_SPI
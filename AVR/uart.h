@@ -8,23 +8,44 @@
 #ifndef SIGNALBOX_UART_H
 #define SIGNALBOX_UART_H
 
-#if DEBUG
+#include <stdint.h>
+
+// Transmit lanes.
+//
+// Blocks written to the high priority lane are always sent before those in
+// the best effort lane, so that fault reports are not lost or delayed behind
+// a burst of packet records. Blocks must be zero-terminated frames, since the
+// UART only switches lanes after sending a zero.
+//
+// When built with TELEMETRY_SPI, the lanes are sent over the SPI as a slave
+// instead; see uart.c.
+//
+// Telemetry, and so the UART, is only built into debug builds, unless built
+// with TELEMETRY_SPI, which has it in all builds; the command channel is
+// always only in debug builds.
+enum uart_lane {
+    UART_HIGH,
+    UART_BULK,
+};
+
+#if DEBUG || TELEMETRY_SPI
 // Initialize the UART.
 void uart_init();
 
-// Write a single character to the UART.
-void uputc(char ch);
-
-// Write a string to the UART.
-void uputs(const char *str);
+// Write a block of bytes to the UART in the given lane.
+//
+// Space for the block is reserved in the transmit buffer atomically, and the
+// block copied with interrupts enabled, so this may be called from both ISRs
+// and the main loop without blocks interleaving. When there is not enough
+// space in the lane for the whole block, it is dropped and counted instead.
+void uart_write(enum uart_lane lane, const uint8_t *data, uint8_t length);
 
-// Write a formatted string to the UART.
-void uprintf(const char *format, ...);
-#else  // DEBUG
+// Return the number of bytes dropped from the given lane since startup.
+uint16_t uart_dropped(enum uart_lane lane);
+#else  // DEBUG || TELEMETRY_SPI
 static inline void uart_init() {}
-static inline void uputc(char ch) {}
-static inline void uputs(const char *str) {}
-static inline void uprintf(const char *format, ...) {}
-#endif  // DEBUG
+static inline void uart_write(enum uart_lane lane, const uint8_t *data, uint8_t length) {}
+static inline uint16_t uart_dropped(enum uart_lane lane) { return 0; }
+#endif  // DEBUG || TELEMETRY_SPI
 
 #endif  // SIGNALBOX_UART_H
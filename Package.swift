@@ -11,6 +11,10 @@ let package = Package(
         .library(name: "DCC", targets: ["DCC"]),
 
         .executable(name: "Prototype", targets: ["Prototype"]),
+        .executable(name: "Monitor", targets: ["Monitor"]),
+        .executable(name: "Sniffer", targets: ["Sniffer"]),
+        .executable(name: "Latency", targets: ["Latency"]),
+        .executable(name: "TimingHeader", targets: ["TimingHeader"]),
 
         .executable(name: "TestGPIO", targets: ["TestGPIO"]),
         .executable(name: "TestPWM", targets: ["TestPWM"]),
@@ -31,6 +35,10 @@ let package = Package(
         .testTarget(name: "DCCTests", dependencies: ["DCC"]),
 
         .target(name: "Prototype", dependencies: ["DCC"]),
+        .target(name: "Monitor", dependencies: ["DCC", "RaspberryPi", "Util"]),
+        .target(name: "Sniffer", dependencies: ["DCC"]),
+        .target(name: "Latency", dependencies: ["DCC"]),
+        .target(name: "TimingHeader", dependencies: ["DCC"]),
 
         .target(name: "OldDCC", dependencies: ["Util", "RaspberryPi"]),
         .target(name: "OldPrototype", dependencies: ["OldDCC"]),
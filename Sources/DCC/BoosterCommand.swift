@@ -0,0 +1,110 @@
+//
+//  BoosterCommand.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Setting of a booster that can be changed at runtime.
+///
+/// Currents are in 8-bit ADC counts, where 128 is 3A, and RailCom timings are in timer ticks from
+/// the end of the packet end bit; see `DecoderTiming`.
+///
+/// - Note: Matches `SETTINGS` in `AVR/booster.c`.
+public enum BoosterSetting : UInt8, CaseIterable {
+    /// Current at which consecutive samples trip the outputs off.
+    case hardOverload = 0x01
+
+    /// Continuous current rating, above which the sustained overload accumulates.
+    case currentRating = 0x02
+
+    /// Hard overload current while the outputs are first turned on.
+    case inrushOverload = 0x03
+
+    /// Time in ms the outputs are kept off after the first overload; at least one overflow of the
+    /// booster's timer, `DecoderTiming.overflowPeriod`.
+    case recoveryOffTime = 0x10
+
+    /// Time in ms the outputs must stay on after a retry to complete recovery.
+    case recoveryProbationTime = 0x11
+
+    /// Consecutive overloads after which the outputs are latched off.
+    case recoveryMaxFailures = 0x12
+
+    /// Start of the RailCom cutout.
+    case railComStart = 0x20
+
+    /// End of the RailCom cutout.
+    case railComEnd = 0x21
+
+    /// Permitted difference in timer ticks between the two halves of a one-bit.
+    case oneBitDelta = 0x30
+
+    /// Optional telemetry records sent, as a bitmask of `enum telemetry_flag` in `AVR/telemetry.h`.
+    case telemetry = 0x40
+}
+
+/// Command sent to a booster.
+///
+/// - Note: Matches `enum command_type` in `AVR/command.h`.
+public enum BoosterCommand : Equatable {
+    /// Read a setting, answered with a `.setting` telemetry record.
+    case get(BoosterSetting)
+
+    /// Change a setting, answered with a `.setting` telemetry record of the new value; invalid
+    /// values are rejected with a `badCommand` log message.
+    case set(BoosterSetting, value: Int)
+
+    /// Save the current settings to the EEPROM.
+    case save
+
+    /// Restore the default settings, without saving them.
+    case defaults
+
+    /// Send the fault journal of a booster built with `FAULT_JOURNAL`, answered with a `.journal`
+    /// telemetry record for each record, oldest first, and then `.journalEnd`.
+    case journal
+
+    /// Reset a lockout of the overload recovery, turning the outputs back on; answered with an
+    /// `.overload` telemetry record of the state.
+    case reset
+
+    /// Bytes of the command.
+    public var bytes: [UInt8] {
+        switch self {
+        case .get(let setting):
+            return [0x01, setting.rawValue]
+        case .set(let setting, let value):
+            return [0x02, setting.rawValue, UInt8(truncatingIfNeeded: value), UInt8(truncatingIfNeeded: value >> 8)]
+        case .save:
+            return [0x03]
+        case .defaults:
+            return [0x04]
+        case .journal:
+            return [0x05]
+        case .reset:
+            return [0x06]
+        }
+    }
+
+    /// Bytes of the command framed with Consistent Overhead Byte Stuffing (COBS), and terminated
+    /// with a zero byte, ready to be written.
+    public var frame: [UInt8] {
+        // Commands are short, so never need the special 0xff code.
+        var frame: [UInt8] = [0]
+        var codeIndex = frame.startIndex
+        for byte in bytes {
+            if byte == 0 {
+                frame[codeIndex] = UInt8(frame.endIndex - codeIndex)
+                codeIndex = frame.endIndex
+                frame.append(0)
+            } else {
+                frame.append(byte)
+            }
+        }
+        frame[codeIndex] = UInt8(frame.endIndex - codeIndex)
+        frame.append(0)
+
+        return frame
+    }
+}
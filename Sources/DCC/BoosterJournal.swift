@@ -0,0 +1,80 @@
+//
+//  BoosterJournal.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Record of the fault journal kept in the EEPROM of a booster built with `FAULT_JOURNAL`, sent in
+/// response to `BoosterCommand.journal`.
+///
+/// Records are numbered in the order they were written, across restarts of the booster, and
+/// timestamped in ticks of its timer overflow since the start before them.
+///
+/// - Note: Matches `struct journal_record` and `enum journal_type` in `AVR/booster.c`.
+public struct BoosterJournalRecord : Equatable {
+    /// Content of a journal record.
+    public enum Content : Equatable {
+        /// Booster firmware started; `resetFlags` is the MCUSR register giving the cause of the reset.
+        case start(resetFlags: UInt8)
+
+        /// Exception conditions of the booster changed, excluding the cutout.
+        ///
+        /// `peakCurrent` is the highest current sample since the change before, in 8-bit ADC
+        /// counts where 128 is 3A, and `dropped` the number of changes just before this one that
+        /// could not be journalled.
+        case condition(BoosterCondition, peakCurrent: Int, dropped: Int)
+
+        /// Checkpoint of the counts of decoding errors since the booster started, which stop at
+        /// their maximum.
+        case errors(badLength: Int, badMatch: Int, badDelta: Int, errorDetection: Int)
+    }
+
+    /// Sequence number of the record, wrapping at 16 bits.
+    public var sequence: Int
+
+    /// Timer overflows from the start of the booster to the record.
+    public var ticks: UInt32
+
+    /// Content of the record.
+    public var content: Content
+
+    public init(sequence: Int, ticks: UInt32, content: Content) {
+        self.sequence = sequence
+        self.ticks = ticks
+        self.content = content
+    }
+
+    /// Initialize from the payload of a journal telemetry record.
+    ///
+    /// - Parameters:
+    ///   - payload: 16-bit little-endian sequence number, record type byte, 32-bit little-endian
+    ///     ticks, and 8 bytes of data.
+    ///
+    /// Returns `nil` if the payload is malformed or the type unknown.
+    init?(payload: [UInt8]) {
+        guard payload.count == 15 else { return nil }
+        let data = Array(payload.dropFirst(7))
+
+        switch payload[2] {
+        case 0x01:
+            content = .start(resetFlags: data[0])
+        case 0x02:
+            content = .condition(BoosterCondition(rawValue: data[0]), peakCurrent: Int(data[1]), dropped: Int(data[2]))
+        case 0x03:
+            content = .errors(badLength: uint16(data, at: 0), badMatch: uint16(data, at: 2),
+                              badDelta: uint16(data, at: 4), errorDetection: uint16(data, at: 6))
+        default:
+            return nil
+        }
+
+        sequence = uint16(payload, at: 0)
+        ticks = UInt32(uint16(payload, at: 3)) | UInt32(uint16(payload, at: 5)) << 16
+    }
+
+    /// Returns the time in seconds from the start of the booster to the record, for a booster
+    /// with the given `timing`.
+    public func uptime(timing: DecoderTiming = .standard) -> Double {
+        Double(ticks) * 65536 * timing.tickLength / 1_000_000
+    }
+}
@@ -0,0 +1,250 @@
+//
+//  DecoderTiming.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// A type that calculates the timings of an AVR board's DCC decoder, in timer ticks.
+///
+/// `DecoderTiming` is initialized with the clock frequency of the board and the prescale of its
+/// timers, and converts the decoder ranges, and RailCom cutout, of `SignalTiming` into lengths in
+/// ticks of the timer, along with the table used by the firmware to classify period lengths.
+///
+/// Lower bounds of the decoder windows are rounded up, and upper bounds rounded down, so that the
+/// windows are never wider than specified. Both bounds of the RailCom cutout are rounded up, so
+/// that it never starts or ends before the specified times.
+///
+/// `header` gives the timings as the contents of a C header.
+///
+/// - Note: Generates `AVR/dcc_timing.h`, with `make timing`.
+public struct DecoderTiming {
+    /// Class of a period length in the classification table.
+    ///
+    /// - Note: Matches `enum dcc_class` in `AVR/dcc_decoder.c`.
+    public enum PeriodClass : Int {
+        case zero
+        case one
+        case invalid
+        case check
+
+        /// Name of the class in the firmware.
+        public var name: String {
+            switch self {
+            case .zero: return "DCC_CLASS_ZERO"
+            case .one: return "DCC_CLASS_ONE"
+            case .invalid: return "DCC_CLASS_INVALID"
+            case .check: return "DCC_CLASS_CHECK"
+            }
+        }
+    }
+
+    /// Timer prescales supported by the AVR, with the clock select bits for each.
+    static let clockSelectBits: [Int: [Int]] = [
+        1: [0],
+        8: [1],
+        64: [1, 0],
+        256: [2],
+        1024: [2, 0],
+    ]
+
+    /// Maximum number of entries in the classification table.
+    public static let maximumClassTableSize = 64
+
+    /// Frequency of the board's clock in Hz.
+    public let clockFrequency: Int
+
+    /// Prescale of the board's timers.
+    public let prescale: Int
+
+    /// Timings of the firmware as built by default, with a 16MHz clock and prescale of 8; see
+    /// `AVR/Makefile`.
+    public static let standard = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+
+    /// Length in µs of a tick of the timer.
+    public let tickLength: Double
+
+    /// Minimum length in ticks of the high and low parts of a one bit.
+    public let oneBitMinimum: Int
+
+    /// Maximum length in ticks of the high and low parts of a one bit.
+    public let oneBitMaximum: Int
+
+    /// Minimum length in ticks of the high and low parts of a zero bit.
+    public let zeroBitMinimum: Int
+
+    /// Permitted difference in ticks between the high and low parts of a one bit.
+    public let oneBitDelta: Int
+
+    /// Length in ticks after an edge at which the signal is considered lost, the maximum length of
+    /// the high and low parts of a zero bit.
+    public let signalTimeout: Int
+
+    /// Length in ticks from the end of the Packet End Bit to the start of the RailCom cutout.
+    public let railComStart: Int
+
+    /// Length in ticks from the end of the Packet End Bit to the end of the RailCom cutout.
+    public let railComEnd: Int
+
+    /// Period in µs between overflows of the 16-bit timer.
+    public let overflowPeriod: Int
+
+    /// Bits that a period length is shifted right by to index the classification table.
+    public let classShift: Int
+
+    /// Classification table; lengths beyond the end of the table are always zero bits.
+    public let classTable: [PeriodClass]
+
+    public enum Error : Swift.Error {
+        /// Thrown by DecoderTiming.init when it cannot produce usable timings from the given
+        /// `clockFrequency` and `prescale`.
+        case conformanceError(message: String)
+    }
+
+    public init(clockFrequency: Int, prescale: Int) throws {
+        guard DecoderTiming.clockSelectBits[prescale] != nil else {
+            throw Error.conformanceError(message: "Prescale \(prescale) is not supported by the timers")
+        }
+
+        self.clockFrequency = clockFrequency
+        self.prescale = prescale
+        tickLength = Double(prescale) * 1_000_000 / Double(clockFrequency)
+
+        func ticks(_ duration: Float, _ rule: FloatingPointRoundingRule) -> Int {
+            Int((Double(duration) * Double(clockFrequency) / Double(prescale * 1_000_000)).rounded(rule))
+        }
+
+        oneBitMinimum = ticks(SignalTiming.decoderOneBitRange.lowerBound, .up)
+        oneBitMaximum = ticks(SignalTiming.decoderOneBitRange.upperBound, .down)
+        zeroBitMinimum = ticks(SignalTiming.decoderZeroBitRange.lowerBound, .up)
+        oneBitDelta = ticks(SignalTiming.decoderOneBitDelta, .down)
+        signalTimeout = ticks(SignalTiming.decoderZeroBitRange.upperBound, .down)
+        railComStart = ticks(SignalTiming.railComDelayRange.lowerBound, .up)
+        railComEnd = ticks(SignalTiming.railComRange.lowerBound, .up)
+        overflowPeriod = Int((Double(65536 * prescale) * 1_000_000 / Double(clockFrequency)).rounded())
+
+        // The decoder can't tell apart periods that are within the same tick, and the
+        // firmware keeps all lengths within 16-bit timer values and the one-bit delta in a byte.
+        if oneBitMinimum >= oneBitMaximum || oneBitMaximum >= zeroBitMinimum {
+            throw Error.conformanceError(message: "Tick of \(tickLength)µs is too long to distinguish one bits")
+        } else if signalTimeout > UInt16.max {
+            throw Error.conformanceError(message: "Loss of signal timeout would be \(signalTimeout) ticks which is beyond the 16-bit timer")
+        } else if oneBitDelta > UInt8.max {
+            throw Error.conformanceError(message: "Difference of one bit parts would be \(oneBitDelta) ticks which is beyond a byte")
+        }
+
+        // Use the finest buckets for which the table still reaches the minimum zero bit, so
+        // that as few as possible contain a window boundary and need checking exactly.
+        var classShift = 0
+        while DecoderTiming.maximumClassTableSize << classShift < zeroBitMinimum {
+            classShift += 1
+        }
+        self.classShift = classShift
+
+        let classTableSize = (zeroBitMinimum + (1 << classShift) - 1) >> classShift
+        var classTable: [PeriodClass] = []
+        for index in 0..<classTableSize {
+            let first = index << classShift
+            let last = first + (1 << classShift) - 1
+
+            let periodClass = DecoderTiming.classify(first, oneBitMinimum, oneBitMaximum, zeroBitMinimum)
+            if DecoderTiming.classify(last, oneBitMinimum, oneBitMaximum, zeroBitMinimum) != periodClass {
+                classTable.append(.check)
+            } else {
+                classTable.append(periodClass)
+            }
+        }
+        self.classTable = classTable
+    }
+
+    /// Classify a period length by comparison.
+    ///
+    /// - Note: Matches `dcc_classify_exact` in `AVR/dcc_decoder.c`.
+    static func classify(_ length: Int, _ oneBitMinimum: Int, _ oneBitMaximum: Int, _ zeroBitMinimum: Int) -> PeriodClass {
+        if length >= zeroBitMinimum {
+            return .zero
+        } else if length >= oneBitMinimum && length <= oneBitMaximum {
+            return .one
+        } else {
+            return .invalid
+        }
+    }
+
+    /// Clock select bits for the timer with the given `number`.
+    func clockSelect(timer number: Int) -> String {
+        DecoderTiming.clockSelectBits[prescale]!.map { "_BV(CS\(number)\($0))" }.joined(separator: " | ")
+    }
+
+    /// Contents of a C header file defining the timings.
+    public var header: String {
+        let oneBitRange = SignalTiming.decoderOneBitRange
+        let zeroBitRange = SignalTiming.decoderZeroBitRange
+
+        var classTableLines: [String] = []
+        for index in stride(from: 0, to: classTable.count, by: 4) {
+            let names = classTable[index..<min(index + 4, classTable.count)].map { $0.name }
+            classTableLines.append("    " + names.joined(separator: ", ") + ", \\")
+        }
+
+        return """
+            //
+            //  dcc_timing.h
+            //  SignalBox
+            //
+            //  Generated by `make timing` from `DecoderTiming` in the DCC module, do not edit.
+            //
+
+            #ifndef SIGNALBOX_DCC_TIMING_H
+            #define SIGNALBOX_DCC_TIMING_H
+
+            // DCC Timing
+            // ----------
+            // Lengths used by the DCC decoder, loss of signal timer, and RailCom cutout,
+            // in ticks of TIMER1 for a \(clockFrequency)Hz clock with a prescale of \(prescale).
+            //
+            // Lower bounds of the decoder windows are rounded up, and upper bounds
+            // rounded down, so that they are never wider than specified; both bounds of
+            // the RailCom cutout are rounded up. The upper bound of a zero-bit is handled
+            // by the loss of signal timer, rather than the decoder.
+
+            #if defined(F_CPU) && F_CPU != \(clockFrequency)UL
+            #error "dcc_timing.h was generated for a different F_CPU, run `make timing`"
+            #endif
+
+            // Prescale, and clock select bits, for TIMER1 and for TIMER0 when used with
+            // the same tick.
+            #define DCC_TIMER_PRESCALE  \(prescale)
+            #define DCC_TIMER0_CS       (\(clockSelect(timer: 0)))
+            #define DCC_TIMER1_CS       (\(clockSelect(timer: 1)))
+
+            // Convert a constant length in µs to ticks, rounding up.
+            #define DCC_TICKS(us)  (((us) * \(clockFrequency)ULL + \(prescale * 1_000_000 - 1)) / \(prescale * 1_000_000))
+
+            // Period in µs between overflows of TIMER1, every 65,536 ticks.
+            #define DCC_OVERFLOW_US  \(overflowPeriod)
+
+            // One-bit periods of \(Int(oneBitRange.lowerBound))-\(Int(oneBitRange.upperBound))µs, whose halves may differ by at most \(Int(SignalTiming.decoderOneBitDelta))µs, and
+            // zero-bit periods of \(Int(zeroBitRange.lowerBound))-\(Int(zeroBitRange.upperBound))µs.
+            #define DCC_ONE_MIN         \(oneBitMinimum)
+            #define DCC_ONE_MAX         \(oneBitMaximum)
+            #define DCC_ONE_DELTA       \(oneBitDelta)
+            #define DCC_ZERO_MIN        \(zeroBitMinimum)
+            #define DCC_SIGNAL_TIMEOUT  \(signalTimeout)
+
+            // RailCom cutout from \(Int(SignalTiming.railComDelayRange.lowerBound))µs to \(Int(SignalTiming.railComRange.lowerBound))µs after the end of the packet end bit.
+            #define DCC_RAILCOM_START   \(railComStart)
+            #define DCC_RAILCOM_END     \(railComEnd)
+
+            // Period classification table, indexed by the period length shifted right
+            // by DCC_CLASS_SHIFT; see dcc_decoder.c.
+            #define DCC_CLASS_SHIFT       \(classShift)
+            #define DCC_CLASS_TABLE_SIZE  \(classTable.count)
+            #define DCC_CLASS_TABLE { \\
+            \(classTableLines.joined(separator: "\n"))
+            }
+
+            #endif  // SIGNALBOX_DCC_TIMING_H
+
+            """
+    }
+}
@@ -0,0 +1,207 @@
+//
+//  LatencyProbe.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Packet used to measure the latency of the signal, identified by a sequence number.
+///
+/// Probe packets use the reserved address of the idle packet, with the sequence number in place of
+/// its zero data byte, so are ignored by decoders.
+///
+/// - Note: Matches `probe_check` in `AVR/booster.c`.
+public struct ProbePacket : Packet, Equatable {
+    /// Sequence number of the probe, never zero.
+    public var sequence: UInt8
+
+    public init(sequence: UInt8) {
+        precondition(sequence != 0, "sequence must not be zero")
+        self.sequence = sequence
+    }
+
+    public var bytes: [UInt8] { [0xff, sequence] }
+}
+
+/// Latency and jitter of probe packets, in microseconds.
+public struct LatencyStatistics : Equatable {
+    /// Number of probes measured.
+    public var count: Int
+
+    /// Number of probes emitted that were never reported by the booster.
+    public var lost: Int
+
+    public var minimum: Double
+    public var median: Double
+    public var percentile90: Double
+    public var percentile99: Double
+    public var maximum: Double
+
+    public var standardDeviation: Double
+
+    /// Jitter, as the spread from the minimum latency to the 99th percentile.
+    public var jitter: Double { percentile99 - minimum }
+}
+
+/// Measurement of the latency from emitting probe packets to their decoding by a booster built with
+/// `LATENCY_PROBE`.
+///
+/// The emitter records the time it queued each probe, and the reader of the booster's telemetry the
+/// time it received the matching `.probe` record, both in nanoseconds of the same monotonic clock
+/// such as `DispatchTime.now().uptimeNanoseconds`:
+///
+///     var probe = LatencyProbe()
+///     let packet = probe.nextPacket(at: DispatchTime.now().uptimeNanoseconds)
+///
+///     if case .probe(let sequence, let timestamp) = record {
+///         probe.received(sequence: sequence, timestamp: timestamp, at: DispatchTime.now().uptimeNanoseconds)
+///     }
+///
+/// Each record carries the time the booster decoded the probe on its own clock, which is mapped to
+/// the Pi's through the lower envelope of the delays between decoding and receiving the records, a
+/// line through the shortest delay in each half of the measurements that also corrects for drift
+/// between the two. Latencies therefore include the shortest delay of the telemetry itself; the
+/// jitter is unaffected.
+///
+/// Emissions and records may be recorded in either order.
+public struct LatencyProbe {
+    struct Sample {
+        /// Time in nanoseconds the probe was emitted.
+        var emitted: UInt64
+
+        /// Timestamp of the booster when it decoded the probe, in ticks, extended beyond 32 bits.
+        var decoded: UInt64
+
+        /// Time in nanoseconds the record was received.
+        var received: UInt64
+    }
+
+    /// Length in nanoseconds of a tick of the booster's timer.
+    public let tickDuration: Double
+
+    /// Number of probes emitted that were never reported by the booster.
+    public private(set) var lost = 0
+
+    /// Sequence number of the probe returned by `nextPacket(at:)`.
+    var nextSequence: UInt8 = 1
+
+    /// Emission times of probes not yet reported, by sequence number.
+    var emissions: [UInt8: UInt64] = [:]
+
+    /// Extended timestamps and received times of records for probes not yet emitted.
+    var reports: [UInt8: (decoded: UInt64, received: UInt64)] = [:]
+
+    /// Last extended timestamp of the booster.
+    var lastTimestamp: UInt64?
+
+    /// Measurements since each start of the booster, which restarts its timer.
+    var epochs: [[Sample]] = [[]]
+
+    /// Initialize for a booster with the given clock frequency in Hz and timer prescale.
+    public init(clockFrequency: Int = 16_000_000, prescale: Int = 8) {
+        tickDuration = Double(prescale) * 1_000_000_000 / Double(clockFrequency)
+    }
+
+    /// Returns the next probe packet, and records it as emitted at `time`.
+    ///
+    /// Sequence numbers run from 1 to 255 and then wrap.
+    public mutating func nextPacket(at time: UInt64) -> ProbePacket {
+        let packet = ProbePacket(sequence: nextSequence)
+        nextSequence = nextSequence == .max ? 1 : nextSequence + 1
+
+        emitted(packet, at: time)
+        return packet
+    }
+
+    /// Record that `packet` was emitted at `time`.
+    ///
+    /// An earlier probe with the same sequence number that was never reported is counted as lost.
+    public mutating func emitted(_ packet: ProbePacket, at time: UInt64) {
+        if emissions.updateValue(time, forKey: packet.sequence) != nil {
+            lost += 1
+        }
+
+        // Records received before this emission are for an earlier probe.
+        if let report = reports.removeValue(forKey: packet.sequence), report.received >= time {
+            emissions[packet.sequence] = nil
+            epochs[epochs.index(before: epochs.endIndex)].append(
+                Sample(emitted: time, decoded: report.decoded, received: report.received))
+        }
+    }
+
+    /// Record a `.probe` telemetry record received at `time`.
+    ///
+    /// - Parameters:
+    ///   - sequence: sequence number of the probe.
+    ///   - timestamp: timestamp of the booster when it decoded the probe.
+    ///   - time: time the record was received.
+    public mutating func received(sequence: UInt8, timestamp: UInt32, at time: UInt64) {
+        let decoded = lastTimestamp.map { $0 + UInt64(timestamp &- UInt32(truncatingIfNeeded: $0)) }
+            ?? UInt64(timestamp)
+        lastTimestamp = decoded
+
+        if let emitted = emissions[sequence], emitted <= time {
+            emissions[sequence] = nil
+            epochs[epochs.index(before: epochs.endIndex)].append(
+                Sample(emitted: emitted, decoded: decoded, received: time))
+        } else {
+            reports[sequence] = (decoded: decoded, received: time)
+        }
+    }
+
+    /// Record that the booster restarted, and its timer with it.
+    public mutating func restart() {
+        lastTimestamp = nil
+        reports.removeAll()
+        if !epochs[epochs.index(before: epochs.endIndex)].isEmpty {
+            epochs.append([])
+        }
+    }
+
+    /// Latencies in microseconds of the probes measured, in the order they were decoded.
+    public var latencies: [Double] {
+        epochs.flatMap { samples -> [Double] in
+            guard !samples.isEmpty else { return [] }
+
+            // Delay from decoding to receiving each record, which is the telemetry delay plus the
+            // offset between the clocks at that time.
+            let decoded = samples.map { Double($0.decoded) * tickDuration }
+            let delays = zip(samples, decoded).map { Double($0.received) - $1 }
+
+            var drift = 0.0
+            if samples.count >= 4 {
+                let half = samples.count / 2
+                let first = delays[..<half].indices.min { delays[$0] < delays[$1] }!
+                let second = delays[half...].indices.min { delays[$0] < delays[$1] }!
+                if decoded[second] > decoded[first] {
+                    drift = (delays[second] - delays[first]) / (decoded[second] - decoded[first])
+                }
+            }
+            let offset = zip(decoded, delays).map { $1 - drift * $0 }.min()!
+
+            return zip(samples, decoded).map { sample, decoded in
+                (decoded + drift * decoded + offset - Double(sample.emitted)) / 1000
+            }
+        }
+    }
+
+    /// Statistics of the latencies measured, or `nil` if none have been.
+    public var statistics: LatencyStatistics? {
+        let latencies = self.latencies.sorted()
+        guard !latencies.isEmpty else { return nil }
+
+        func percentile(_ fraction: Double) -> Double {
+            let rank = Int((fraction * Double(latencies.count)).rounded(.up))
+            return latencies[max(rank - 1, 0)]
+        }
+
+        let mean = latencies.reduce(0, +) / Double(latencies.count)
+        let variance = latencies.reduce(0, { $0 + ($1 - mean) * ($1 - mean) }) / Double(latencies.count)
+
+        return LatencyStatistics(
+            count: latencies.count, lost: lost,
+            minimum: latencies.first!, median: percentile(0.5), percentile90: percentile(0.9),
+            percentile99: percentile(0.99), maximum: latencies.last!,
+            standardDeviation: variance.squareRoot())
+    }
+}
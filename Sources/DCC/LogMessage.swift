@@ -0,0 +1,237 @@
+//
+//  LogMessage.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Log message sent by an AVR board.
+///
+/// Boards send only the identifier of the message and the raw values of its arguments, the format
+/// string is used to expand the message back into text.
+///
+/// Lengths are given in the board's timer ticks, `DecoderTiming.tickLength` long.
+///
+/// - Note: Matches `LOG_MESSAGES` in `AVR/log.h`.
+public enum LogMessage : UInt8, CaseIterable {
+    /// Period was not a valid length for a one-bit or zero-bit.
+    case badLength = 0x01
+
+    /// Periods of a bit were not the same kind.
+    case badMatch = 0x02
+
+    /// Periods of a one-bit differed by more than the permitted amount.
+    case badDelta = 0x03
+
+    /// Packet was longer than the maximum permitted.
+    case tooLong = 0x04
+
+    /// Error detection byte did not match, arguments are the packet bytes.
+    case errorDetection = 0x05
+
+    /// Edges were lost by the board, argument is its running count of overruns.
+    case overrun = 0x06
+
+    /// Noise spikes merged by a detector's glitch filter, argument is its running count.
+    case glitches = 0x07
+
+    /// Booster tripped on a short, argument is the current sample in 8-bit ADC counts, 128 is 3A.
+    case hardOverload = 0x10
+
+    /// Booster tripped on a sustained overload, argument is the filtered current in 8-bit ADC counts.
+    case slowOverload = 0x11
+
+    /// Booster skipped a cutout scheduled too late, argument is the ticks since the packet end bit.
+    case cutoutLate = 0x12
+
+    /// Booster's measured delay in starting the cutout, argument is the average in ticks.
+    case railComDelay = 0x13
+
+    /// Booster decoding in its ISR rejected periods, argument is its running count of errors.
+    case decodeErrors = 0x14
+
+    /// Booster decoding in its ISR lost packets, argument is its running count of overruns.
+    case packetOverrun = 0x15
+
+    /// Booster rejected a command, arguments are the command type and setting identifier.
+    case badCommand = 0x16
+
+    /// Booster saved its settings to the EEPROM.
+    case settingsSaved = 0x17
+
+    /// Booster restored its default settings.
+    case settingsDefault = 0x18
+
+    /// Format string of the message.
+    public var format: String {
+        switch self {
+        case .badLength: return "BAD LEN %u"
+        case .badMatch: return "BAD MATCH %c%c"
+        case .badDelta: return "BAD DELTA %u %u"
+        case .tooLong: return "TOO LONG"
+        case .errorDetection: return "ERR %hhx %hhx %hhx %hhx %hhx %hhx"
+        case .overrun: return "OVERRUN %hhu"
+        case .glitches: return "GLITCHES %u"
+        case .hardOverload: return "HARD OVERLOAD %u"
+        case .slowOverload: return "SLOW OVERLOAD %u"
+        case .cutoutLate: return "CUTOUT LATE %u"
+        case .railComDelay: return "RAILCOM DELAY %u"
+        case .decodeErrors: return "DECODE ERRORS %hhu"
+        case .packetOverrun: return "PACKET OVERRUN %hhu"
+        case .badCommand: return "BAD COMMAND %hhx %hhx"
+        case .settingsSaved: return "SETTINGS SAVED"
+        case .settingsDefault: return "SETTINGS DEFAULT"
+        }
+    }
+}
+
+/// Conversion within a log message format string.
+enum LogConversion {
+    /// Text between conversions.
+    case literal(String)
+
+    /// `%u`: 16-bit unsigned integer.
+    case unsigned16
+
+    /// `%hhu`: 8-bit unsigned integer.
+    case unsigned8
+
+    /// `%hhx`: 8-bit unsigned integer, in hexadecimal.
+    case hex8
+
+    /// `%c`: 8-bit character.
+    case character
+
+    /// Size of the argument in bytes.
+    var size: Int {
+        switch self {
+        case .literal: return 0
+        case .unsigned16: return 2
+        case .unsigned8, .hex8, .character: return 1
+        }
+    }
+
+    /// Returns the literals and conversions in `format`.
+    static func parse(_ format: String) -> [LogConversion] {
+        var conversions: [LogConversion] = []
+        var literal = ""
+        var specifier: String? = nil
+
+        for character in format {
+            guard var partial = specifier else {
+                if character == "%" {
+                    specifier = ""
+                } else {
+                    literal.append(character)
+                }
+                continue
+            }
+
+            partial.append(character)
+            let conversion: LogConversion
+            switch partial {
+            case "%":
+                literal.append("%")
+                specifier = nil
+                continue
+            case "u": conversion = .unsigned16
+            case "hhu": conversion = .unsigned8
+            case "hhx": conversion = .hex8
+            case "c": conversion = .character
+            case "h", "hh":
+                specifier = partial
+                continue
+            default:
+                preconditionFailure("Unsupported conversion %\(partial) in log message format")
+            }
+
+            if !literal.isEmpty {
+                conversions.append(.literal(literal))
+                literal = ""
+            }
+            conversions.append(conversion)
+            specifier = nil
+        }
+
+        if !literal.isEmpty {
+            conversions.append(.literal(literal))
+        }
+
+        return conversions
+    }
+}
+
+/// Log message record sent by an AVR board.
+public struct LogRecord : Equatable, CustomStringConvertible {
+    /// Message sent.
+    public var message: LogMessage
+
+    /// Values of the arguments, in the order of the conversions in the format string.
+    ///
+    /// There may be fewer arguments than conversions, in which case the message is truncated
+    /// before the first missing argument.
+    public var arguments: [Int]
+
+    public init(message: LogMessage, arguments: [Int] = []) {
+        self.message = message
+        self.arguments = arguments
+    }
+
+    /// Initialize from the payload of a log record.
+    ///
+    /// - Parameters:
+    ///   - payload: message identifier byte, followed by the raw arguments.
+    ///
+    /// Returns `nil` if the message is not recognized, or the arguments do not match its format.
+    init?(payload: [UInt8]) {
+        guard let message = payload.first.flatMap(LogMessage.init(rawValue:)) else { return nil }
+
+        var arguments: [Int] = []
+        var offset = payload.startIndex + 1
+        for conversion in LogConversion.parse(message.format) where conversion.size > 0 {
+            if offset == payload.endIndex { break }
+            guard offset + conversion.size <= payload.endIndex else { return nil }
+
+            arguments.append(conversion.size == 2 ? uint16(payload, at: offset) : Int(payload[offset]))
+            offset += conversion.size
+        }
+
+        guard offset == payload.endIndex else { return nil }
+
+        self.init(message: message, arguments: arguments)
+    }
+
+    /// Message expanded using its format string.
+    public var description: String {
+        var description = ""
+        var literal = ""
+        var arguments = self.arguments.makeIterator()
+        for conversion in LogConversion.parse(message.format) {
+            let argument: Int
+            switch conversion {
+            case .literal(let text):
+                literal = text
+                continue
+            default:
+                guard let next = arguments.next() else { return description }
+                argument = next
+            }
+
+            description.append(literal)
+            literal = ""
+
+            switch conversion {
+            case .literal:
+                break
+            case .unsigned16, .unsigned8:
+                description.append(String(argument))
+            case .hex8:
+                description.append(String(argument, radix: 16))
+            case .character:
+                description.append(Character(Unicode.Scalar(UInt8(truncatingIfNeeded: argument))))
+            }
+        }
+
+        return description + literal
+    }
+}
@@ -30,6 +30,37 @@ extension Packet {
     
 }
 
+/// Packet of arbitrary bytes.
+///
+/// Used for packets that have been received, for example through telemetry from one of the AVR
+/// boards, where the instructions within are not interpreted.
+public struct RawPacket : Packet, Equatable {
+
+    public var bytes: [UInt8]
+
+    public init(bytes: [UInt8]) {
+        self.bytes = bytes
+    }
+
+    /// Initialize from received bytes that include the final error detection byte.
+    ///
+    /// The error detection byte is verified and removed.
+    ///
+    /// - Parameters:
+    ///   - bytesWithErrorDetection: packet bytes, including the error detection byte.
+    ///
+    /// Returns `nil` if there are no bytes, or the error detection byte does not match.
+    public init?<C : Collection>(bytesWithErrorDetection: C) where C.Element == UInt8 {
+        guard let errorDetectionByte = bytesWithErrorDetection.last else { return nil }
+
+        let bytes = Array(bytesWithErrorDetection.dropLast())
+        guard bytes.reduce(0, { $0 ^ $1 }) == errorDetectionByte else { return nil }
+
+        self.bytes = bytes
+    }
+
+}
+
 public struct Preamble : Packable {
     
     // FIXME: This is just a thought experiment, it might not be the best way
@@ -0,0 +1,86 @@
+//
+//  PacketCapture.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Valid packet captured by a detector built with `DCC_CAPTURE`, with its timing.
+///
+/// Lengths and the timestamp are in ticks of the detector's timer, `DecoderTiming.tickLength`
+/// long.
+///
+/// - Note: Matches `TELEMETRY_CAPTURE` in `AVR/telemetry.h`.
+public struct PacketCapture : Equatable {
+    /// Timestamp of the edge that completed the packet, wrapping at 32 bits.
+    public var timestamp: UInt32
+
+    /// Number of one-bits in the preamble of the packet.
+    public var preambleCount: Int
+
+    /// Shortest period length from the start of the preamble, always the half of a one-bit.
+    public var minimumLength: Int
+
+    /// Longest period length from the start of the preamble, always the half of a zero-bit.
+    public var maximumLength: Int
+
+    /// Packet received.
+    public var packet: RawPacket
+
+    public init(timestamp: UInt32, preambleCount: Int, minimumLength: Int, maximumLength: Int, packet: RawPacket) {
+        self.timestamp = timestamp
+        self.preambleCount = preambleCount
+        self.minimumLength = minimumLength
+        self.maximumLength = maximumLength
+        self.packet = packet
+    }
+
+    /// Initialize from the payload of a capture telemetry record.
+    ///
+    /// - Parameters:
+    ///   - payload: 32-bit little-endian timestamp, preamble count byte, 16-bit little-endian
+    ///     shortest and longest lengths, and packet bytes including the error detection byte.
+    ///
+    /// Returns `nil` if the payload is malformed.
+    init?(payload: [UInt8]) {
+        guard payload.count > 9,
+            let packet = RawPacket(bytesWithErrorDetection: payload.dropFirst(9))
+            else { return nil }
+
+        timestamp = UInt32(uint16(payload, at: 0)) | UInt32(uint16(payload, at: 2)) << 16
+        preambleCount = Int(payload[4])
+        minimumLength = uint16(payload, at: 5)
+        maximumLength = uint16(payload, at: 7)
+        self.packet = packet
+    }
+
+    /// Bits of the packet as received, from the start of the preamble to the packet end bit.
+    public var bits: [Bool] {
+        var bits = Array(repeating: true, count: preambleCount)
+
+        let errorDetectionByte = packet.bytes.reduce(0, { $0 ^ $1 })
+        for byte in packet.bytes + [errorDetectionByte] {
+            bits.append(false)
+            bits.append(contentsOf: (0..<8).reversed().map { byte & (1 << $0) != 0 })
+        }
+        bits.append(true)
+
+        return bits
+    }
+
+    /// Lines of a trace for the replay benchmark, `AVR/bench/replay.c`.
+    ///
+    /// The original period lengths are not captured, so each bit is given as two periods of
+    /// `minimumLength` for a one-bit and `maximumLength` for a zero-bit, replaying the packet at the
+    /// extremes of its timing. The periods are preceded by a comment with the timestamp and
+    /// bytes of the packet.
+    public var traceLines: [String] {
+        let comment = "# \(timestamp) " + packet.bytes.map(\.hexString).joined(separator: " ")
+        let lengths = bits.flatMap { bit -> [String] in
+            let length = String(bit ? minimumLength : maximumLength)
+            return [length, length]
+        }
+
+        return [comment] + lengths
+    }
+}
@@ -0,0 +1,116 @@
+//
+//  RailCom.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Counts of RailCom bytes received by a detector since startup, and of errors.
+///
+/// - Note: Matches `struct railcom_stats` in `AVR/railcom.h`.
+public struct RailComStatistics : Equatable {
+    /// Valid bytes received, including those discarded due to other errors.
+    public var received: Int
+
+    /// Bytes without a valid stop bit.
+    public var framingErrors: Int
+
+    /// Bytes lost because the detector's receive buffer was full.
+    public var overruns: Int
+
+    /// Bytes that were not valid 4/8 codes, or were a third byte in channel 1.
+    public var invalid: Int
+
+    public init(received: Int, framingErrors: Int, overruns: Int, invalid: Int) {
+        self.received = received
+        self.framingErrors = framingErrors
+        self.overruns = overruns
+        self.invalid = invalid
+    }
+}
+
+/// Datagram decoded from a RailCom response by a detector.
+public struct RailComDatagram : Equatable {
+    /// Contents of a datagram.
+    public enum Content : Equatable {
+        /// Decoder acknowledged the packet.
+        case ack
+
+        /// Decoder did not acknowledge the packet.
+        case nack
+
+        /// Decoder is busy.
+        case busy
+
+        /// Data bits following a 4-bit identifier.
+        case data(id: Int, value: Int)
+    }
+
+    /// Channel the datagram was received in, 1 or 2.
+    public var channel: Int
+
+    /// Address of the packet that preceded the cutout, if it was for a multi-function decoder.
+    public var address: Address?
+
+    /// Contents of the datagram.
+    public var content: Content
+
+    public init(channel: Int, address: Address?, content: Content) {
+        self.channel = channel
+        self.address = address
+        self.content = content
+    }
+
+    /// Identifiers for the non-data values.
+    ///
+    /// - Note: Matches `RAILCOM_ACK`, etc. in `AVR/railcom.h`.
+    enum Indication : UInt8 {
+        case ack = 0x40
+        case nack = 0x41
+        case busy = 0x42
+    }
+
+    /// Initialize from the payload of a RailCom datagram record.
+    ///
+    /// - Parameters:
+    ///   - payload: channel byte, 16-bit little-endian packet address, identifier byte, and data bits
+    ///     little-endian.
+    ///
+    /// Returns `nil` if the payload is malformed.
+    init?(payload: [UInt8]) {
+        guard payload.count >= 4 else { return nil }
+        let channel = Int(payload[0])
+        let address = Self.address(uint16(payload, at: 1))
+        let id = payload[3]
+        let data = payload.dropFirst(4)
+
+        if let indication = Indication(rawValue: id) {
+            guard data.isEmpty else { return nil }
+            switch indication {
+            case .ack: self.init(channel: channel, address: address, content: .ack)
+            case .nack: self.init(channel: channel, address: address, content: .nack)
+            case .busy: self.init(channel: channel, address: address, content: .busy)
+            }
+        } else {
+            guard id < 16, data.count <= 4 else { return nil }
+            let value = data.reversed().reduce(0) { $0 << 8 | Int($1) }
+            self.init(channel: channel, address: address, content: .data(id: Int(id), value: value))
+        }
+    }
+
+    /// Returns the address for a packet address value.
+    ///
+    /// - Note: Matches `dcc_packet_address()` in `AVR/dcc_decoder.c`.
+    static func address(_ value: Int) -> Address? {
+        switch value {
+        case 0:
+            return .broadcast
+        case 1..<0x80:
+            return .primary(value)
+        case 0xc000..<0xe800:
+            return .extended(value & 0x3fff)
+        default:
+            return nil
+        }
+    }
+}
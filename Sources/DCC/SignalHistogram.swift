@@ -0,0 +1,141 @@
+//
+//  SignalHistogram.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Histogram of values counted by an AVR board's DCC decoder.
+public struct HistogramBuckets : Equatable {
+    /// Value counted by the first bucket.
+    public var start: Float
+
+    /// Width of each bucket.
+    public var width: Float
+
+    /// Counts of each bucket, the last bucket also counts all greater values.
+    public var counts: [Int]
+
+    /// Total of all counts.
+    public var total: Int {
+        counts.reduce(0, +)
+    }
+
+    /// Returns the value counted by the bucket at `index`.
+    public func value(at index: Int) -> Float {
+        start + Float(index) * width
+    }
+
+    /// Returns the fraction of counts in buckets whose value is within `range`, or `nil` if there
+    /// are no counts.
+    ///
+    /// The last bucket, which also counts all greater values, is included when `range` contains
+    /// its value.
+    public func fraction(within range: ClosedRange<Float>) -> Float? {
+        guard total > 0 else { return nil }
+
+        let within = counts.indices.filter { range.contains(value(at: $0)) }.map { counts[$0] }
+        return Float(within.reduce(0, +)) / Float(total)
+    }
+}
+
+/// Signal histograms sent by an AVR board's DCC decoder.
+///
+/// Boards send the histograms as a series of telemetry records, each with the counts of some of
+/// the buckets and all with the same sequence number; `add(sequence:offset:counts:)` collects
+/// them, starting afresh when the sequence number changes. Counts are since the previous
+/// snapshot.
+///
+/// Buckets are a tick of the board's timer wide, and the number of them depends on its timing, so
+/// the histogram is initialized with the board's `DecoderTiming`. Lengths are in µs, so can be
+/// compared directly with the ranges in `SignalTiming`:
+///
+///     if let fraction = histogram.oneBit.fraction(within: SignalTiming.oneBitRange) {
+///         print("\(fraction * 100)% of one bits in range")
+///     }
+///
+/// - Note: Matches `DCC_HISTOGRAM_*` in `AVR/dcc_decoder.h`.
+public struct SignalHistogram : Equatable {
+    /// Number of buckets in the zero-bit and preamble histograms; the others depend on the timing.
+    static let zeroBitCount = 48
+    static let preambleCount = 32
+
+    /// Offsets and sizes of each histogram within the board's buckets.
+    let oneBitBuckets: Range<Int>
+    let zeroBitBuckets: Range<Int>
+    let oneBitDeltaBuckets: Range<Int>
+    let preambleBuckets: Range<Int>
+
+    /// Lengths in µs of the first one-bit and zero-bit buckets, and the width of every bucket.
+    let oneBitStart: Float
+    let zeroBitStart: Float
+    let tickLength: Float
+
+    /// Sequence number of the snapshot.
+    public private(set) var sequence: Int? = nil
+
+    /// Counts of all buckets.
+    var counts: [Int]
+
+    /// Buckets whose counts have been received for the snapshot.
+    var received = Set<Int>()
+
+    /// Initialize an empty histogram for a board with the given `timing`.
+    public init(timing: DecoderTiming = .standard) {
+        oneBitBuckets = 0..<(timing.oneBitMaximum - timing.oneBitMinimum + 1)
+        zeroBitBuckets = oneBitBuckets.upperBound..<(oneBitBuckets.upperBound + Self.zeroBitCount)
+        oneBitDeltaBuckets = zeroBitBuckets.upperBound..<(zeroBitBuckets.upperBound + timing.oneBitDelta + 2)
+        preambleBuckets = oneBitDeltaBuckets.upperBound..<(oneBitDeltaBuckets.upperBound + Self.preambleCount)
+
+        tickLength = Float(timing.tickLength)
+        oneBitStart = Float(timing.oneBitMinimum) * tickLength
+        zeroBitStart = Float(timing.zeroBitMinimum) * tickLength
+
+        counts = Array(repeating: 0, count: preambleBuckets.upperBound)
+    }
+
+    /// Whether counts for all buckets have been received.
+    public var isComplete: Bool {
+        received.count == counts.count
+    }
+
+    /// Add counts received in a histogram record.
+    ///
+    /// - Parameters:
+    ///   - sequence: snapshot sequence number.
+    ///   - offset: index of the first bucket.
+    ///   - counts: counts from that bucket.
+    public mutating func add(sequence: Int, offset: Int, counts: [Int]) {
+        if sequence != self.sequence {
+            counts = Array(repeating: 0, count: counts.count)
+            received.removeAll()
+            self.sequence = sequence
+        }
+
+        for (index, count) in zip(offset..., counts) where self.counts.indices.contains(index) {
+            self.counts[index] = count
+            received.insert(index)
+        }
+    }
+
+    /// Lengths in µs of one-bit periods, in buckets of a tick from the minimum one-bit.
+    public var oneBit: HistogramBuckets {
+        HistogramBuckets(start: oneBitStart, width: tickLength, counts: Array(counts[oneBitBuckets]))
+    }
+
+    /// Lengths in µs of zero-bit periods, in buckets of a tick from the minimum zero-bit.
+    public var zeroBit: HistogramBuckets {
+        HistogramBuckets(start: zeroBitStart, width: tickLength, counts: Array(counts[zeroBitBuckets]))
+    }
+
+    /// Differences in µs between the periods of a one-bit, in buckets of a tick from 0µs; the last
+    /// bucket counts differences beyond the permitted maximum.
+    public var oneBitDelta: HistogramBuckets {
+        HistogramBuckets(start: 0, width: tickLength, counts: Array(counts[oneBitDeltaBuckets]))
+    }
+
+    /// Counts of one bits in each preamble, from 10.
+    public var preamble: HistogramBuckets {
+        HistogramBuckets(start: 10, width: 1, counts: Array(counts[preambleBuckets]))
+    }
+}
@@ -48,7 +48,28 @@ public struct SignalTiming {
     ///
     ///   Since our transmission parts are always equal in length, this is half of the latter value.
     public static let zeroBitRange: ClosedRange<Float> = 95...6000
-    
+
+    /// Permitted duration in microseconds of the high and low parts of a one bit received by a
+    /// decoder.
+    ///
+    /// - Note:
+    ///   NMRA S-9.1 defines this as the range of durations that decoders must accept.
+    public static let decoderOneBitRange: ClosedRange<Float> = 52...64
+
+    /// Permitted difference in microseconds between the high and low parts of a one bit received
+    /// by a decoder.
+    ///
+    /// - Note:
+    ///   NMRA S-9.1 permits decoders to reject one bits whose parts differ by more than this.
+    public static let decoderOneBitDelta: Float = 6
+
+    /// Permitted duration in microseconds of the high and low parts of a zero bit received by a
+    /// decoder.
+    ///
+    /// - Note:
+    ///   NMRA S-9.1 defines this as the range of durations that decoders must accept.
+    public static let decoderZeroBitRange: ClosedRange<Float> = 90...10000
+
     /// Permitted duration in microseconds before the start of the RailCom cutout.
     ///
     /// No nominal duration is defined by the standard, so the lower bound is the target we use when
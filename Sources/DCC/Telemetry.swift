@@ -0,0 +1,323 @@
+//
+//  Telemetry.swift
+//  DCC
+//
+//  Created by agent on 10/14/26.
+//
+
+/// Condition of a booster's H-Bridge outputs.
+///
+/// When empty the booster is outputting the DCC signal normally, otherwise the outputs are off for
+/// the reasons given.
+///
+/// - Note: Matches `enum condition` in `AVR/booster.c`.
+public struct BoosterCondition : OptionSet {
+    public let rawValue: UInt8
+
+    public init(rawValue: UInt8) {
+        self.rawValue = rawValue
+    }
+
+    /// RailCom cutout is in progress.
+    public static let cutout = BoosterCondition(rawValue: 1 << 1)
+
+    /// No DCC signal is being received.
+    public static let noSignal = BoosterCondition(rawValue: 1 << 2)
+
+    /// H-Bridge has reported that it is overheating.
+    public static let overheat = BoosterCondition(rawValue: 1 << 3)
+
+    /// Current drawn from the H-Bridge is over the permitted limit.
+    public static let overload = BoosterCondition(rawValue: 1 << 4)
+}
+
+/// State of a booster's recovery from an overload.
+///
+/// - Note: Matches `enum recovery_state` in `AVR/booster.c`.
+public enum OverloadRecovery : UInt8 {
+    /// No overload, or recovery completed.
+    case normal = 0
+
+    /// Outputs are off, waiting before a retry.
+    case off = 1
+
+    /// Outputs have been retried, and must stay on to complete recovery.
+    case retry = 2
+
+    /// Retries failed and the outputs are latched off until reset by `BoosterCommand.reset`, or the
+    /// booster restarting.
+    case lockout = 3
+}
+
+/// Record received through the telemetry of an AVR board.
+public enum TelemetryRecord : Equatable {
+    /// Board firmware has started.
+    case start
+
+    /// Log message.
+    case log(LogRecord)
+
+    /// Bytes dropped by the board's UART, as running counts for each lane.
+    case dropped(highPriority: Int, bestEffort: Int)
+
+    /// Time the board's main loop was awake for each edge, as the maximum and average in CPU cycles
+    /// since the last record, which stop at 65,535.
+    case awake(maximum: Int, average: Int)
+
+    /// Valid packet decoded from the DCC signal.
+    case packet(RawPacket)
+
+    /// Valid packet decoded from the DCC signal `count` more times since its last `packet` or
+    /// `repeats` record.
+    case repeats(RawPacket, count: Int)
+
+    /// Part of a snapshot of the decoder's signal histograms, for `SignalHistogram`.
+    case histogram(sequence: Int, offset: Int, counts: [Int])
+
+    /// Valid packet captured with its timing, in place of `packet` and `repeats` records.
+    case capture(PacketCapture)
+
+    /// Centres of the one-bit and zero-bit periods learned by a decoder built with `DCC_ADAPTIVE`,
+    /// in timer ticks; when `isLocked` its windows are narrowed around them.
+    case adaptiveTiming(isLocked: Bool, oneBit: Double, zeroBit: Double)
+
+    /// Booster condition changed.
+    case condition(BoosterCondition)
+
+    /// Booster overload recovery changed state, `failures` is the number of consecutive failures.
+    case overload(OverloadRecovery, failures: Int)
+
+    /// Booster setting value, in response to a `BoosterCommand`.
+    case setting(BoosterSetting, value: Int)
+
+    /// Probe packet decoded by a booster built with `LATENCY_PROBE`, with the timestamp of the
+    /// edge that completed it in timer ticks, wrapping at 32 bits; see `LatencyProbe`.
+    case probe(sequence: UInt8, timestamp: UInt32)
+
+    /// Service mode acknowledgement window closed on a booster built with `SERVICE_MODE_ACK`;
+    /// when `detected`, `delay` is the time in µs from the last service mode packet to the rise in
+    /// current, and `rise` its size in mA.
+    case serviceModeAck(detected: Bool, delay: Int, rise: Int)
+
+    /// Record of the fault journal of a booster, in response to `BoosterCommand.journal`.
+    case journal(BoosterJournalRecord)
+
+    /// End of the fault journal of a booster, after its last `journal` record.
+    case journalEnd
+
+    /// RailCom bytes received during a cutout that could not be decoded.
+    case railCom([UInt8])
+
+    /// RailCom datagram decoded from a response.
+    case railComDatagram(RailComDatagram)
+
+    /// RailCom bytes received in a zone of a multi-zone detector that could not be decoded.
+    case zoneRailCom(zone: Int, [UInt8])
+
+    /// RailCom datagram decoded from a response in a zone of a multi-zone detector.
+    case zoneRailComDatagram(zone: Int, RailComDatagram)
+
+    /// Occupancy of the zones of a multi-zone detector changed, `zones` are those now occupied.
+    case occupancy(zones: [Int])
+
+    /// Counts of RailCom bytes received by a detector, in `zone` for a multi-zone detector.
+    case railComStatistics(zone: Int?, RailComStatistics)
+
+    /// Record that could not be parsed.
+    case unknown(type: UInt8, payload: [UInt8])
+}
+
+extension TelemetryRecord {
+    /// Record type bytes.
+    ///
+    /// - Note: Matches `enum telemetry_type` in `AVR/telemetry.h`.
+    enum RecordType : UInt8 {
+        case start = 0x01
+        case log = 0x02
+        case dropped = 0x03
+        case awake = 0x04
+        case packet = 0x10
+        case repeats = 0x11
+        case histogram = 0x12
+        case capture = 0x13
+        case adaptiveTiming = 0x14
+        case condition = 0x20
+        case overload = 0x21
+        case setting = 0x22
+        case probe = 0x23
+        case serviceModeAck = 0x24
+        case journal = 0x25
+        case railCom = 0x30
+        case railComDatagram = 0x31
+        case zoneRailCom = 0x32
+        case zoneRailComDatagram = 0x33
+        case occupancy = 0x34
+        case railComStatistics = 0x35
+    }
+
+    /// Initialize from the unstuffed contents of a telemetry frame.
+    ///
+    /// - Parameters:
+    ///   - data: record type byte, followed by the payload.
+    ///
+    /// Returns `nil` if `data` is empty; records that cannot be parsed are returned as `.unknown`.
+    public init?(data: [UInt8]) {
+        guard let type = data.first else { return nil }
+        let payload = Array(data.dropFirst())
+
+        self = Self.parse(type: type, payload: payload) ?? .unknown(type: type, payload: payload)
+    }
+
+    /// Returns the parsed record, or `nil` if the record is not recognized or malformed.
+    static func parse(type: UInt8, payload: [UInt8]) -> TelemetryRecord? {
+        guard let recordType = RecordType(rawValue: type) else { return nil }
+
+        switch recordType {
+        case .start:
+            return .start
+        case .log:
+            return LogRecord(payload: payload).map(TelemetryRecord.log)
+        case .dropped:
+            guard payload.count == 4 else { return nil }
+            return .dropped(highPriority: uint16(payload, at: 0), bestEffort: uint16(payload, at: 2))
+        case .awake:
+            guard payload.count == 4 else { return nil }
+            return .awake(maximum: uint16(payload, at: 0), average: uint16(payload, at: 2))
+        case .packet:
+            return RawPacket(bytesWithErrorDetection: payload).map(TelemetryRecord.packet)
+        case .repeats:
+            guard payload.count > 2,
+                let packet = RawPacket(bytesWithErrorDetection: Array(payload.dropFirst(2)))
+                else { return nil }
+            return .repeats(packet, count: uint16(payload, at: 0))
+        case .histogram:
+            guard payload.count >= 2, payload.count % 2 == 0 else { return nil }
+            let counts = stride(from: 2, to: payload.count, by: 2).map { uint16(payload, at: $0) }
+            return .histogram(sequence: Int(payload[0]), offset: Int(payload[1]), counts: counts)
+        case .capture:
+            return PacketCapture(payload: payload).map(TelemetryRecord.capture)
+        case .adaptiveTiming:
+            // Centres have 4 bits of fraction, `DCC_ADAPTIVE_SHIFT`.
+            guard payload.count == 5, payload[0] <= 1 else { return nil }
+            return .adaptiveTiming(isLocked: payload[0] != 0,
+                                   oneBit: Double(uint16(payload, at: 1)) / 16,
+                                   zeroBit: Double(uint16(payload, at: 3)) / 16)
+        case .condition:
+            guard payload.count == 1 else { return nil }
+            return .condition(BoosterCondition(rawValue: payload[0]))
+        case .overload:
+            guard payload.count == 2, let state = OverloadRecovery(rawValue: payload[0]) else { return nil }
+            return .overload(state, failures: Int(payload[1]))
+        case .setting:
+            guard payload.count == 3, let setting = BoosterSetting(rawValue: payload[0]) else { return nil }
+            return .setting(setting, value: uint16(payload, at: 1))
+        case .probe:
+            guard payload.count == 5, payload[0] != 0 else { return nil }
+            let timestamp = UInt32(uint16(payload, at: 1)) | UInt32(uint16(payload, at: 3)) << 16
+            return .probe(sequence: payload[0], timestamp: timestamp)
+        case .serviceModeAck:
+            guard payload.count == 5, payload[0] <= 1 else { return nil }
+            return .serviceModeAck(detected: payload[0] != 0, delay: uint16(payload, at: 1), rise: uint16(payload, at: 3))
+        case .journal:
+            guard !payload.isEmpty else { return .journalEnd }
+            return BoosterJournalRecord(payload: payload).map(TelemetryRecord.journal)
+        case .railCom:
+            return .railCom(payload)
+        case .railComDatagram:
+            return RailComDatagram(payload: payload).map(TelemetryRecord.railComDatagram)
+        case .zoneRailCom:
+            guard let zone = payload.first else { return nil }
+            return .zoneRailCom(zone: Int(zone), Array(payload.dropFirst()))
+        case .zoneRailComDatagram:
+            guard let zone = payload.first,
+                let datagram = RailComDatagram(payload: Array(payload.dropFirst()))
+                else { return nil }
+            return .zoneRailComDatagram(zone: Int(zone), datagram)
+        case .occupancy:
+            guard payload.count == 1 else { return nil }
+            return .occupancy(zones: (0..<8).filter { payload[0] & (1 << $0) != 0 })
+        case .railComStatistics:
+            guard payload.count == 9 else { return nil }
+            let statistics = RailComStatistics(
+                received: uint16(payload, at: 1), framingErrors: uint16(payload, at: 3),
+                overruns: uint16(payload, at: 5), invalid: uint16(payload, at: 7))
+            return .railComStatistics(zone: payload[0] == 0xff ? nil : Int(payload[0]), statistics)
+        }
+    }
+}
+
+/// Returns the 16-bit little-endian value in `bytes` at `offset`.
+func uint16(_ bytes: [UInt8], at offset: Int) -> Int {
+    Int(bytes[offset]) | Int(bytes[offset + 1]) << 8
+}
+
+/// Decoder for the telemetry records sent by the AVR boards.
+///
+/// Each record is framed using Consistent Overhead Byte Stuffing (COBS) and terminated with a
+/// zero byte. Bytes received can be passed to `decode(_:)` in chunks of any size, with partial
+/// frames retained until completed by a later call:
+///
+///     var decoder = TelemetryDecoder()
+///     for record in decoder.decode(bytes) {
+///         if case .packet(let packet) = record {
+///             print(packet.bytes)
+///         }
+///     }
+///
+/// The first frame received is likely to be partial if the board was already running, frames that
+/// are malformed are discarded.
+///
+/// - Note: Matches `AVR/telemetry.c`.
+public struct TelemetryDecoder {
+    /// Bytes received of the current frame.
+    private var frame: [UInt8] = []
+
+    public init() {
+    }
+
+    /// Decode records from received bytes.
+    ///
+    /// - Parameters:
+    ///   - bytes: bytes received.
+    ///
+    /// - Returns: records completed by `bytes`.
+    public mutating func decode<S : Sequence>(_ bytes: S) -> [TelemetryRecord] where S.Element == UInt8 {
+        var records: [TelemetryRecord] = []
+        for byte in bytes {
+            guard byte == 0 else {
+                frame.append(byte)
+                continue
+            }
+
+            if let data = Self.unstuff(frame),
+                let record = TelemetryRecord(data: data)
+            {
+                records.append(record)
+            }
+            frame.removeAll(keepingCapacity: true)
+        }
+
+        return records
+    }
+
+    /// Returns the contents of a COBS `frame`, without its terminating zero, or `nil` if malformed.
+    static func unstuff(_ frame: [UInt8]) -> [UInt8]? {
+        var data: [UInt8] = []
+        var index = frame.startIndex
+        while index < frame.endIndex {
+            let code = Int(frame[index])
+            let next = index + code
+            guard code > 0, next <= frame.endIndex else { return nil }
+
+            data.append(contentsOf: frame[(index + 1)..<next])
+            index = next
+
+            // Each code, except the maximum, replaced a zero; but the final one was the terminator.
+            if code < 0xff && index < frame.endIndex {
+                data.append(0)
+            }
+        }
+
+        return data
+    }
+}
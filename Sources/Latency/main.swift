@@ -0,0 +1,105 @@
+//
+//  main.swift
+//  Latency
+//
+//  Created by agent on 10/14/26.
+//
+
+import Foundation
+
+import DCC
+
+// Measures the latency from emitting probe packets to their decoding by a booster built with
+// `LATENCY_PROBE`, and the jitter in it, for tuning the depth of the emitter's queues; see
+// `LatencyProbe` in the DCC module.
+//
+// The emitter appends a line to the file given as the first argument for each probe it queues, with
+// the sequence number and the time in nanoseconds from `DispatchTime.now().uptimeNanoseconds`:
+//
+//     42 1234567890123
+//
+// Telemetry is read from the file given as the second argument, or standard input, so the serial
+// port should be configured first:
+//
+//     stty -F /dev/ttyAMA0 raw 250000
+//     Latency probes.log /dev/ttyAMA0
+//
+// The statistics are printed after every 100 probe records.
+
+let reportInterval = 100
+
+guard CommandLine.arguments.count > 1 else {
+    FileHandle.standardError.write("Usage: Latency EMISSIONS [TELEMETRY]\n".data(using: .utf8)!)
+    exit(1)
+}
+
+guard let emissions = FileHandle(forReadingAtPath: CommandLine.arguments[1]) else {
+    FileHandle.standardError.write("Unable to open \(CommandLine.arguments[1])\n".data(using: .utf8)!)
+    exit(1)
+}
+
+let input: FileHandle
+if CommandLine.arguments.count > 2 {
+    guard let handle = FileHandle(forReadingAtPath: CommandLine.arguments[2]) else {
+        FileHandle.standardError.write("Unable to open \(CommandLine.arguments[2])\n".data(using: .utf8)!)
+        exit(1)
+    }
+    input = handle
+} else {
+    input = FileHandle.standardInput
+}
+
+var probe = LatencyProbe()
+
+/// Records the emissions appended to the log since the last call; a partial last line is kept in
+/// `emissionsLine` for the next.
+var emissionsLine = ""
+func readEmissions() {
+    guard let text = String(data: emissions.availableData, encoding: .utf8) else { return }
+
+    var lines = (emissionsLine + text).split(separator: "\n", omittingEmptySubsequences: false)
+    emissionsLine = String(lines.removeLast())
+
+    for line in lines {
+        let fields = line.split(separator: " ")
+        guard fields.count == 2,
+            let sequence = UInt8(fields[0]), sequence != 0,
+            let time = UInt64(fields[1])
+            else { continue }
+
+        probe.emitted(ProbePacket(sequence: sequence), at: time)
+    }
+}
+
+func format(_ value: Double) -> String {
+    String(format: "%.1f", value)
+}
+
+var decoder = TelemetryDecoder()
+var records = 0
+while true {
+    let data = input.availableData
+    guard !data.isEmpty else { break }
+    let time = DispatchTime.now().uptimeNanoseconds
+
+    readEmissions()
+    for record in decoder.decode(data) {
+        switch record {
+        case .start:
+            print("Booster started")
+            probe.restart()
+        case .probe(let sequence, let timestamp):
+            probe.received(sequence: sequence, timestamp: timestamp, at: time)
+
+            records += 1
+            guard records % reportInterval == 0, let statistics = probe.statistics else { break }
+            print("PROBES \(statistics.count) lost \(statistics.lost)"
+                + " latency \(format(statistics.minimum))/\(format(statistics.median))"
+                + "/\(format(statistics.percentile90))/\(format(statistics.percentile99))"
+                + "/\(format(statistics.maximum))µs jitter \(format(statistics.jitter))µs"
+                + " stddev \(format(statistics.standardDeviation))µs")
+        default:
+            break
+        }
+    }
+}
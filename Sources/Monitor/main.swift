@@ -0,0 +1,178 @@
+//
+//  main.swift
+//  Monitor
+//
+//  Created by agent on 10/14/26.
+//
+
+import Foundation
+
+import DCC
+import RaspberryPi
+import Util
+
+// Reads telemetry from an AVR board and prints the records as text, expanding log messages using
+// their format strings. Telemetry is read from the file given as the argument, or standard input,
+// so the serial port should be configured first:
+//
+//     stty -F /dev/ttyAMA0 raw 250000
+//     Monitor /dev/ttyAMA0
+//
+// Boards built with `TELEMETRY_SPI` are instead polled over SPI0 on the given chip selects, and
+// each record is prefixed with the chip select of the board it came from:
+//
+//     Monitor --spi 0 1
+
+/// Telemetry decoding state of a board.
+struct Board {
+    var decoder = TelemetryDecoder()
+    var histogram = SignalHistogram()
+}
+
+/// Returns the fields of a RailCom datagram as text.
+func describe(_ datagram: RailComDatagram) -> String {
+    let address = datagram.address.map { "\($0)" } ?? "-"
+    switch datagram.content {
+    case .ack: return "\(datagram.channel) \(address) ACK"
+    case .nack: return "\(datagram.channel) \(address) NACK"
+    case .busy: return "\(datagram.channel) \(address) BUSY"
+    case .data(let id, let value): return "\(datagram.channel) \(address) \(id) \(value.hexString)"
+    }
+}
+
+/// Returns a telemetry record as text, or `nil` for a histogram record that doesn't complete a
+/// snapshot.
+func describe(_ record: TelemetryRecord, histogram: inout SignalHistogram) -> String? {
+    switch record {
+    case .start:
+        return "Running"
+    case .log(let log):
+        return "\(log)"
+    case .dropped(let highPriority, let bestEffort):
+        return "DROPPED \(highPriority) \(bestEffort)"
+    case .awake(let maximum, let average):
+        return "AWAKE \(maximum) \(average)"
+    case .packet(let packet):
+        return packet.bytes.map(\.binaryString).joined(separator: " ") + " OK"
+    case .repeats(let packet, let count):
+        return packet.bytes.map(\.binaryString).joined(separator: " ") + " x\(count)"
+    case .histogram(let sequence, let offset, let counts):
+        histogram.add(sequence: sequence, offset: offset, counts: counts)
+        guard histogram.isComplete else { return nil }
+
+        let oneBit = histogram.oneBit.fraction(within: SignalTiming.oneBitRange)
+        let zeroBit = histogram.zeroBit.fraction(within: SignalTiming.zeroBitRange)
+        return "HISTOGRAM \(oneBit.map { String($0) } ?? "-") \(zeroBit.map { String($0) } ?? "-")"
+    case .capture(let capture):
+        return "\(capture.timestamp) " + capture.packet.bytes.map(\.binaryString).joined(separator: " ")
+            + " p\(capture.preambleCount) \(capture.minimumLength)-\(capture.maximumLength)"
+    case .adaptiveTiming(let isLocked, let oneBit, let zeroBit):
+        return "TIMING \(isLocked ? "locked" : "learning") \(oneBit) \(zeroBit)"
+    case .condition(let condition):
+        return "CONDITION \(String(condition.rawValue, radix: 2))"
+    case .overload(let state, let failures):
+        return "OVERLOAD \(state) \(failures)"
+    case .setting(let setting, let value):
+        return "SETTING \(setting) \(value)"
+    case .probe(let sequence, let timestamp):
+        return "PROBE \(sequence) \(timestamp)"
+    case .serviceModeAck(let detected, let delay, let rise):
+        return detected ? "ACK \(delay)µs \(rise)mA" : "NO ACK"
+    case .journal(let record):
+        let uptime = String(format: "%.3f", record.uptime())
+        switch record.content {
+        case .start(let resetFlags):
+            return "JOURNAL \(record.sequence) \(uptime)s START \(resetFlags.hexString)"
+        case .condition(let condition, let peakCurrent, let dropped):
+            return "JOURNAL \(record.sequence) \(uptime)s CONDITION \(String(condition.rawValue, radix: 2))"
+                + " peak \(peakCurrent)" + (dropped > 0 ? " dropped \(dropped)" : "")
+        case .errors(let badLength, let badMatch, let badDelta, let errorDetection):
+            return "JOURNAL \(record.sequence) \(uptime)s ERRORS len \(badLength) match \(badMatch)"
+                + " delta \(badDelta) err \(errorDetection)"
+        }
+    case .journalEnd:
+        return "JOURNAL END"
+    case .railCom(let bytes):
+        return "RAILCOM " + bytes.map(\.hexString).joined(separator: " ")
+    case .railComDatagram(let datagram):
+        return "RAILCOM \(describe(datagram))"
+    case .zoneRailCom(let zone, let bytes):
+        return "RAILCOM z\(zone) " + bytes.map(\.hexString).joined(separator: " ")
+    case .zoneRailComDatagram(let zone, let datagram):
+        return "RAILCOM z\(zone) \(describe(datagram))"
+    case .occupancy(let zones):
+        return "OCCUPANCY " + (zones.isEmpty ? "-" : zones.map { "z\($0)" }.joined(separator: " "))
+    case .railComStatistics(let zone, let statistics):
+        return "RAILCOM \(zone.map { "z\($0)" } ?? "-") received \(statistics.received)"
+            + " framing \(statistics.framingErrors) overruns \(statistics.overruns)"
+            + " invalid \(statistics.invalid)"
+    case .unknown(let type, let payload):
+        return "UNKNOWN \(type.hexString) " + payload.map(\.hexString).joined(separator: " ")
+    }
+}
+
+/// Decodes `bytes` received from `board` and prints the records, each with `prefix`.
+func show<C : Collection>(_ bytes: C, from board: inout Board, prefix: String = "") where C.Element == UInt8 {
+    for record in board.decoder.decode(bytes) {
+        if let line = describe(record, histogram: &board.histogram) {
+            print(prefix + line)
+        }
+    }
+}
+
+if CommandLine.arguments.count > 1 && CommandLine.arguments[1] == "--spi" {
+    let chipSelects = CommandLine.arguments.dropFirst(2).compactMap { Int($0) }
+    guard !chipSelects.isEmpty, chipSelects.allSatisfy({ $0 >= 0 && $0 < 2 }) else {
+        print("Usage: Monitor --spi CHIP-SELECT...")
+        exit(2)
+    }
+
+    // Set the SPI0 pins to alternate function 0.
+    let gpio = try! GPIO()
+    for pin in 7...11 {
+        gpio[pin].function = .alternateFunction0
+    }
+
+    // Poll at 1.95MHz, leaving time between bytes for the AVR's ISR to load the next; it's late
+    // while the AVR is in a longer ISR, and the frame being sent is then discarded.
+    let spi = try! SPI()
+    spi.clockDivider = 128
+    spi.byteInterval = 8_000
+
+    var boards = Array(repeating: Board(), count: chipSelects.count)
+    while true {
+        var idle = true
+        for (index, chipSelect) in chipSelects.enumerated() {
+            let bytes = spi.read(count: 64, chipSelect: chipSelect)
+            if bytes.contains(where: { $0 != 0 }) {
+                idle = false
+            }
+
+            show(bytes, from: &boards[index], prefix: "cs\(chipSelect) ")
+        }
+
+        // Boards send zeros when they have nothing to send.
+        if idle {
+            usleep(1_000)
+        }
+    }
+}
+
+let input: FileHandle
+if CommandLine.arguments.count > 1 {
+    guard let handle = FileHandle(forReadingAtPath: CommandLine.arguments[1]) else {
+        print("Unable to open \(CommandLine.arguments[1])")
+        exit(1)
+    }
+    input = handle
+} else {
+    input = FileHandle.standardInput
+}
+
+var board = Board()
+while true {
+    let data = input.availableData
+    guard !data.isEmpty else { break }
+
+    show(data, from: &board)
+}
@@ -0,0 +1,199 @@
+//
+//  SPI.swift
+//  RaspberryPi
+//
+//  Created by agent on 10/14/26.
+//
+
+import Dispatch
+
+import Util
+
+/// Serial Peripheral Interface master.
+///
+/// Instances of `SPI` are used to read and manipulate the SPI0 master of the Raspberry Pi, and
+/// perform polled transfers with the devices on its bus. All instances manipulate the same
+/// hardware, and will differ only in the address of their mapped memory pointer.
+///
+/// Each transfer is made with the device on one of the chip selects, so multiple devices can be
+/// polled in turn over the same bus:
+///
+///     let spi = try SPI()
+///     spi.clockDivider = 128
+///     spi.byteInterval = 8_000
+///     for chipSelect in 0...1 {
+///         let bytes = spi.read(count: 64, chipSelect: chipSelect)
+///     }
+///
+/// The pins must first be set to alternate function 0: GPIO8 and GPIO7 are chip selects 0 and 1,
+/// GPIO9 is MISO, GPIO10 is MOSI, and GPIO11 is SCLK. Chip select 2 is not available on the header.
+public final class SPI : MappedPeripheral {
+
+    /// Offset of the SPI registers from the peripherals base address.
+    ///
+    /// - Note: BCM2835 ARM Peripherals 10.5
+    public static let offset: UInt32 = 0x204000
+
+    /// SPI registers block.
+    ///
+    /// - Note: BCM2835 ARM Peripherals 10.5
+    public struct Registers {
+        public var controlStatus: SPIControlStatus
+        public var fifo: UInt32
+        public var clockDivider: UInt32
+        public var dataLength: UInt32
+        public var lossiOutputHoldDelay: UInt32
+        public var dmaControls: UInt32
+
+        internal init() {
+            controlStatus = SPIControlStatus()
+            fifo = 0
+            clockDivider = 0
+            dataLength = 0
+            lossiOutputHoldDelay = 0
+            dmaControls = 0
+        }
+    }
+
+    /// Pointer to the mapped SPI registers.
+    public var registers: UnsafeMutablePointer<Registers>
+
+    /// Unmap `registers` on deinitialization.
+    private var unmapOnDeinit: Bool
+
+    /// Number of chip selects defined by the Raspberry Pi.
+    public static let chipSelectCount = 3
+
+    /// Time in nanoseconds to leave after asserting the chip select, and between the bytes of a
+    /// transfer.
+    ///
+    /// Devices such as the AVR boards can only enable their output in software once selected, and
+    /// load the next byte to send once the byte before it has been received, and need time to do
+    /// so.
+    public var byteInterval: UInt64 = 0
+
+    public init() throws {
+        let memoryDevice = try MemoryDevice()
+
+        registers = try memoryDevice.map(address: SPI.address)
+        unmapOnDeinit = true
+    }
+
+    // For testing.
+    internal init(registers: UnsafeMutablePointer<Registers>) {
+        unmapOnDeinit = false
+        self.registers = registers
+    }
+
+    deinit {
+        guard unmapOnDeinit else { return }
+        do {
+            try MemoryDevice.unmap(registers)
+        } catch {
+            print("Error on SPI deinitialization: \(error)")
+        }
+    }
+
+    /// Clock divider.
+    ///
+    /// SCLK is the core clock, 250MHz on most models, divided by this value, which is rounded down
+    /// to an even number; zero is a divider of 65,536.
+    public var clockDivider: Int {
+        get { return Int(registers.pointee.clockDivider & UInt32.mask(bits: 16)) }
+        set {
+            assert(newValue >= 0 && newValue < (1 << 16), "divider out of range")
+            registers.pointee.clockDivider = UInt32(newValue)
+        }
+    }
+
+    /// Chip select asserted during transfers.
+    public var chipSelect: Int {
+        get { return registers.pointee.controlStatus.chipSelect }
+        set {
+            assert(newValue >= 0 && newValue < SPI.chipSelectCount, "chip select out of range")
+            registers.pointee.controlStatus.chipSelect = newValue
+        }
+    }
+
+    /// Transfer is active, and the chip select asserted.
+    public var isTransferActive: Bool {
+        get { return registers.pointee.controlStatus.contains(.transferActive) }
+        set {
+            if newValue {
+                registers.pointee.controlStatus.insert(.transferActive)
+            } else {
+                registers.pointee.controlStatus.remove(.transferActive)
+            }
+        }
+    }
+
+    /// Transfer is complete, with no more bytes in the transmit FIFO.
+    public var isTransferDone: Bool {
+        get { return registers.pointee.controlStatus.contains(.transferDone) }
+    }
+
+    // MARK: Transfers
+
+    /// Transfer bytes with a device.
+    ///
+    /// The chip select is asserted for the whole transfer, and each byte is sent and received
+    /// before the next, with `byteInterval` before each.
+    ///
+    /// - Parameters:
+    ///   - bytes: bytes to send.
+    ///   - chipSelect: chip select of the device.
+    ///
+    /// - Returns: bytes received, one for each sent.
+    public func transfer(_ bytes: [UInt8], chipSelect: Int) -> [UInt8] {
+        assert(chipSelect >= 0 && chipSelect < SPI.chipSelectCount, "chip select out of range")
+
+        var controlStatus = registers.pointee.controlStatus
+        controlStatus.chipSelect = chipSelect
+        controlStatus.insert([ .clearTransmitFifo, .clearReceiveFifo, .transferActive ])
+        registers.pointee.controlStatus = controlStatus
+
+        var received: [UInt8] = []
+        received.reserveCapacity(bytes.count)
+        for byte in bytes {
+            if byteInterval > 0 {
+                let deadline = DispatchTime.now().uptimeNanoseconds + byteInterval
+                while DispatchTime.now().uptimeNanoseconds < deadline {}
+            }
+
+            registers.pointee.fifo = UInt32(byte)
+            while !isTransferDone {}
+
+            received.append(UInt8(truncatingIfNeeded: registers.pointee.fifo))
+        }
+
+        isTransferActive = false
+        return received
+    }
+
+    /// Read bytes from a device, sending zeros.
+    ///
+    /// - Parameters:
+    ///   - count: number of bytes to read.
+    ///   - chipSelect: chip select of the device.
+    ///
+    /// - Returns: bytes received.
+    public func read(count: Int, chipSelect: Int) -> [UInt8] {
+        return transfer(Array(repeating: 0, count: count), chipSelect: chipSelect)
+    }
+
+}
+
+// MARK: Debugging
+
+extension SPI : CustomDebugStringConvertible {
+
+    public var debugDescription: String {
+        var parts: [String] = []
+
+        parts.append("\(type(of: self)) controlStatus: \(registers.pointee.controlStatus)")
+        parts.append("clockDivider: \(clockDivider)")
+
+        return "<" + parts.joined(separator: ", ") + ">"
+    }
+
+}
@@ -0,0 +1,99 @@
+//
+//  SPIControlStatus.swift
+//  RaspberryPi
+//
+//  Created by agent on 10/14/26.
+//
+
+import Util
+
+/// SPI control and status register.
+///
+/// Provides a type conforming to `OptionSet` that allows direct manipulation of the SPI control and
+/// status register as a set of enumerated constants.
+///
+///     var controlStatus: SPIControlStatus = [ .clearTransmitFifo, .clearReceiveFifo, .transferActive ]
+///     spi.registers.pointee.controlStatus = controlStatus
+///
+public struct SPIControlStatus : OptionSet, Equatable, Hashable {
+
+    public let rawValue: UInt32
+
+    public init(rawValue: UInt32) {
+        self.rawValue = rawValue
+    }
+
+    public static let longDataWordDMA         = SPIControlStatus(rawValue: 1 << 25)
+    public static let dmaLength               = SPIControlStatus(rawValue: 1 << 24)
+    public static let chipSelect2ActiveHigh   = SPIControlStatus(rawValue: 1 << 23)
+    public static let chipSelect1ActiveHigh   = SPIControlStatus(rawValue: 1 << 22)
+    public static let chipSelect0ActiveHigh   = SPIControlStatus(rawValue: 1 << 21)
+    public static let receiveFifoFull         = SPIControlStatus(rawValue: 1 << 20)
+    public static let receiveFifoNeedsReading = SPIControlStatus(rawValue: 1 << 19)
+    public static let transmitFifoHasSpace    = SPIControlStatus(rawValue: 1 << 18)
+    public static let receiveFifoHasData      = SPIControlStatus(rawValue: 1 << 17)
+    public static let transferDone            = SPIControlStatus(rawValue: 1 << 16)
+    public static let readEnable              = SPIControlStatus(rawValue: 1 << 12)
+    public static let autoDeassertChipSelect  = SPIControlStatus(rawValue: 1 << 11)
+    public static let interruptOnReceive      = SPIControlStatus(rawValue: 1 << 10)
+    public static let interruptOnDone         = SPIControlStatus(rawValue: 1 << 9)
+    public static let dmaEnabled              = SPIControlStatus(rawValue: 1 << 8)
+    public static let transferActive          = SPIControlStatus(rawValue: 1 << 7)
+    public static let chipSelectActiveHigh    = SPIControlStatus(rawValue: 1 << 6)
+    public static let clearReceiveFifo        = SPIControlStatus(rawValue: 1 << 5)
+    public static let clearTransmitFifo       = SPIControlStatus(rawValue: 1 << 4)
+    public static let clockPolarity           = SPIControlStatus(rawValue: 1 << 3)
+    public static let clockPhase              = SPIControlStatus(rawValue: 1 << 2)
+
+    public static func chipSelect(_ chipSelect: Int) -> SPIControlStatus {
+        assert(chipSelect >= 0 && chipSelect < (1 << 2), "chip select out of range")
+        return SPIControlStatus(rawValue: UInt32(chipSelect))
+    }
+
+    /// Chip select.
+    ///
+    /// This is an internal method, access is provided through `SPI`.
+    internal var chipSelect: Int {
+        get {
+            return Int(rawValue & UInt32.mask(bits: 2))
+        }
+        set {
+            assert(newValue >= 0 && newValue < (1 << 2), "chip select out of range")
+            self = SPIControlStatus(rawValue: rawValue & UInt32.mask(except: 2) | UInt32(newValue))
+        }
+    }
+
+}
+
+// MARK: Debugging
+
+extension SPIControlStatus : CustomDebugStringConvertible {
+
+    public var debugDescription: String {
+        var parts: [String] = []
+
+        if contains(.longDataWordDMA) { parts.append(".longDataWordDMA") }
+        if contains(.dmaLength) { parts.append(".dmaLength") }
+        if contains(.chipSelect2ActiveHigh) { parts.append(".chipSelect2ActiveHigh") }
+        if contains(.chipSelect1ActiveHigh) { parts.append(".chipSelect1ActiveHigh") }
+        if contains(.chipSelect0ActiveHigh) { parts.append(".chipSelect0ActiveHigh") }
+        if contains(.receiveFifoFull) { parts.append(".receiveFifoFull") }
+        if contains(.receiveFifoNeedsReading) { parts.append(".receiveFifoNeedsReading") }
+        if contains(.transmitFifoHasSpace) { parts.append(".transmitFifoHasSpace") }
+        if contains(.receiveFifoHasData) { parts.append(".receiveFifoHasData") }
+        if contains(.transferDone) { parts.append(".transferDone") }
+        if contains(.readEnable) { parts.append(".readEnable") }
+        if contains(.autoDeassertChipSelect) { parts.append(".autoDeassertChipSelect") }
+        if contains(.interruptOnReceive) { parts.append(".interruptOnReceive") }
+        if contains(.interruptOnDone) { parts.append(".interruptOnDone") }
+        if contains(.dmaEnabled) { parts.append(".dmaEnabled") }
+        if contains(.transferActive) { parts.append(".transferActive") }
+        if contains(.chipSelectActiveHigh) { parts.append(".chipSelectActiveHigh") }
+        if contains(.clockPolarity) { parts.append(".clockPolarity") }
+        if contains(.clockPhase) { parts.append(".clockPhase") }
+        parts.append(".chipSelect(\(chipSelect))")
+
+        return "[" + parts.joined(separator: ", ") + "]"
+    }
+
+}
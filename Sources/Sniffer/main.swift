@@ -0,0 +1,52 @@
+//
+//  main.swift
+//  Sniffer
+//
+//  Created by agent on 10/14/26.
+//
+
+import Foundation
+
+import DCC
+
+// Reads telemetry from a detector built with `DCC_CAPTURE` and writes the captured packets as a
+// trace for the replay benchmark, `AVR/bench/replay.c`. Telemetry is read from the file given as
+// the argument, or standard input, so the serial port should be configured first:
+//
+//     stty -F /dev/ttyAMA0 raw 250000
+//     Sniffer /dev/ttyAMA0 > capture.trace
+//
+// Records other than captures are ignored, except that restarts of the detector and bytes dropped
+// by its UART are noted in comments, since packets will be missing from the trace around them.
+
+let input: FileHandle
+if CommandLine.arguments.count > 1 {
+    guard let handle = FileHandle(forReadingAtPath: CommandLine.arguments[1]) else {
+        FileHandle.standardError.write("Unable to open \(CommandLine.arguments[1])\n".data(using: .utf8)!)
+        exit(1)
+    }
+    input = handle
+} else {
+    input = FileHandle.standardInput
+}
+
+print("# Packets captured by a detector, replayed at the extremes of their timing.")
+
+var decoder = TelemetryDecoder()
+while true {
+    let data = input.availableData
+    guard !data.isEmpty else { break }
+
+    for record in decoder.decode(data) {
+        switch record {
+        case .start:
+            print("# Detector started")
+        case .dropped(let highPriority, let bestEffort):
+            print("# Dropped \(highPriority) \(bestEffort)")
+        case .capture(let capture):
+            print(capture.traceLines.joined(separator: "\n"))
+        default:
+            break
+        }
+    }
+}
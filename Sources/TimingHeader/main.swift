@@ -0,0 +1,34 @@
+//
+//  main.swift
+//  TimingHeader
+//
+//  Created by agent on 10/14/26.
+//
+
+import Foundation
+
+import DCC
+
+// Prints the DCC timing header for an AVR board, given its clock frequency in Hz and the prescale
+// of its timers; this is run by `make timing` to regenerate `AVR/dcc_timing.h`:
+//
+//     TimingHeader 16000000 8 > AVR/dcc_timing.h
+
+guard CommandLine.arguments.count == 3,
+    let clockFrequency = Int(CommandLine.arguments[1]),
+    let prescale = Int(CommandLine.arguments[2]) else
+{
+    FileHandle.standardError.write("Usage: TimingHeader CLOCK-FREQUENCY PRESCALE\n".data(using: .utf8)!)
+    exit(2)
+}
+
+do {
+    let timing = try DecoderTiming(clockFrequency: clockFrequency, prescale: prescale)
+    print(timing.header, terminator: "")
+} catch DecoderTiming.Error.conformanceError(let message) {
+    FileHandle.standardError.write("\(message)\n".data(using: .utf8)!)
+    exit(1)
+} catch {
+    FileHandle.standardError.write("\(error)\n".data(using: .utf8)!)
+    exit(1)
+}
@@ -0,0 +1,50 @@
+//
+//  BoosterCommandTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+import DCC
+
+class BoosterCommandTests : XCTestCase {
+
+    /// Test that a get command has the setting identifier.
+    func testGet() {
+        XCTAssertEqual(BoosterCommand.get(.hardOverload).bytes, [0x01, 0x01])
+    }
+
+    /// Test that a set command has the setting identifier and little-endian value.
+    func testSet() {
+        XCTAssertEqual(BoosterCommand.set(.recoveryProbationTime, value: 2000).bytes, [0x02, 0x11, 0xd0, 0x07])
+    }
+
+    /// Test that save and defaults commands have no payload.
+    func testSaveAndDefaults() {
+        XCTAssertEqual(BoosterCommand.save.bytes, [0x03])
+        XCTAssertEqual(BoosterCommand.defaults.bytes, [0x04])
+    }
+
+    /// Test that a journal command has no payload.
+    func testJournal() {
+        XCTAssertEqual(BoosterCommand.journal.bytes, [0x05])
+    }
+
+    /// Test that a reset command has no payload.
+    func testReset() {
+        XCTAssertEqual(BoosterCommand.reset.bytes, [0x06])
+    }
+
+    /// Test that a frame without zeros has a code byte and terminator.
+    func testFrame() {
+        XCTAssertEqual(BoosterCommand.get(.railComStart).frame, [0x03, 0x01, 0x20, 0x00])
+    }
+
+    /// Test that zeros within a command are replaced in the frame.
+    func testFrameWithZeros() {
+        XCTAssertEqual(BoosterCommand.set(.hardOverload, value: 0x80).frame, [0x04, 0x02, 0x01, 0x80, 0x01, 0x00])
+    }
+
+}
@@ -0,0 +1,121 @@
+//
+//  DecoderTimingTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+import DCC
+
+class DecoderTimingTests : XCTestCase {
+
+    // MARK: 16MHz tests
+
+    /// Test that with a 16MHz clock and prescale of 8, the windows are in 0.5µs ticks.
+    func testSixteenMegahertzWindows() {
+        let timing = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+        XCTAssertEqual(timing.oneBitMinimum, 104)
+        XCTAssertEqual(timing.oneBitMaximum, 128)
+        XCTAssertEqual(timing.zeroBitMinimum, 180)
+        XCTAssertEqual(timing.oneBitDelta, 12)
+        XCTAssertEqual(timing.signalTimeout, 20000)
+    }
+
+    /// Test that with a 16MHz clock and prescale of 8, the RailCom cutout is in 0.5µs ticks.
+    func testSixteenMegahertzRailCom() {
+        let timing = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+        XCTAssertEqual(timing.railComStart, 52)
+        XCTAssertEqual(timing.railComEnd, 908)
+    }
+
+    /// Test that with a 16MHz clock and prescale of 8, each tick is 0.5µs.
+    func testSixteenMegahertzTickLength() {
+        let timing = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+        XCTAssertEqual(timing.tickLength, 0.5)
+    }
+
+    /// Test that with a 16MHz clock and prescale of 8, the timer overflows every 32,768µs.
+    func testSixteenMegahertzOverflow() {
+        let timing = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+        XCTAssertEqual(timing.overflowPeriod, 32768)
+    }
+
+    /// Test that with a 16MHz clock and prescale of 8, the classification table is of 2µs buckets
+    /// up to the minimum zero bit, with only the bucket containing the maximum one bit checked.
+    func testSixteenMegahertzClassTable() {
+        let timing = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+        XCTAssertEqual(timing.classShift, 2)
+        XCTAssertEqual(timing.classTable.count, 45)
+        XCTAssertEqual(timing.classTable[0..<26].filter { $0 != .invalid }, [])
+        XCTAssertEqual(timing.classTable[26..<32].filter { $0 != .one }, [])
+        XCTAssertEqual(timing.classTable[32], .check)
+        XCTAssertEqual(timing.classTable[33...].filter { $0 != .invalid }, [])
+    }
+
+
+    // MARK: 20MHz tests
+
+    /// Test that with a 20MHz clock and prescale of 8, the windows are rounded inwards.
+    func testTwentyMegahertzWindows() {
+        let timing = try! DecoderTiming(clockFrequency: 20_000_000, prescale: 8)
+        XCTAssertEqual(timing.oneBitMinimum, 130)
+        XCTAssertEqual(timing.oneBitMaximum, 160)
+        XCTAssertEqual(timing.zeroBitMinimum, 225)
+        XCTAssertEqual(timing.oneBitDelta, 15)
+        XCTAssertEqual(timing.signalTimeout, 25000)
+    }
+
+    /// Test that with a 20MHz clock and prescale of 8, each tick is 0.4µs.
+    func testTwentyMegahertzTickLength() {
+        let timing = try! DecoderTiming(clockFrequency: 20_000_000, prescale: 8)
+        XCTAssertEqual(timing.tickLength, 0.4, accuracy: 0.0001)
+    }
+
+    /// Test that with a 20MHz clock and prescale of 8, the classification table still reaches the
+    /// minimum zero bit, checking the buckets that contain a boundary.
+    func testTwentyMegahertzClassTable() {
+        let timing = try! DecoderTiming(clockFrequency: 20_000_000, prescale: 8)
+        XCTAssertEqual(timing.classShift, 2)
+        XCTAssertEqual(timing.classTable.count, 57)
+        XCTAssertEqual(timing.classTable[32], .check)
+        XCTAssertEqual(timing.classTable[40], .check)
+        XCTAssertEqual(timing.classTable[56], .check)
+    }
+
+
+    // MARK: Conformance tests
+
+    /// Test that a prescale not supported by the timers throws an error.
+    func testUnsupportedPrescale() {
+        XCTAssertThrowsError(try DecoderTiming(clockFrequency: 16_000_000, prescale: 16))
+    }
+
+    /// Test that a tick too short for the loss of signal timeout to fit in the timer throws an
+    /// error.
+    func testTimeoutOverflow() {
+        XCTAssertThrowsError(try DecoderTiming(clockFrequency: 16_000_000, prescale: 1))
+    }
+
+    /// Test that a tick too long to distinguish one bits throws an error.
+    func testTickTooLong() {
+        XCTAssertThrowsError(try DecoderTiming(clockFrequency: 1_000_000, prescale: 1024))
+    }
+
+
+    // MARK: Header tests
+
+    /// Test that the header defines the timings.
+    func testHeader() {
+        let timing = try! DecoderTiming(clockFrequency: 16_000_000, prescale: 8)
+        let lines = timing.header.split(separator: "\n")
+
+        XCTAssertTrue(lines.contains("#if defined(F_CPU) && F_CPU != 16000000UL"))
+        XCTAssertTrue(lines.contains("#define DCC_TIMER1_CS       (_BV(CS11))"))
+        XCTAssertTrue(lines.contains("#define DCC_ONE_MIN         104"))
+        XCTAssertTrue(lines.contains("#define DCC_SIGNAL_TIMEOUT  20000"))
+        XCTAssertTrue(lines.contains("#define DCC_CLASS_TABLE_SIZE  45"))
+    }
+
+}
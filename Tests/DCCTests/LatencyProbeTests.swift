@@ -0,0 +1,139 @@
+//
+//  LatencyProbeTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+import DCC
+
+class LatencyProbeTests : XCTestCase {
+
+    /// Emission time of the first probe, in nanoseconds.
+    let start: UInt64 = 1_000_000_000
+
+    /// Record probes emitted every 100ms with the given latencies, whose records are received after
+    /// the given delays, and the booster timestamp for each decode.
+    func measure(_ probe: inout LatencyProbe, latencies: [UInt64], delays: [UInt64], timestamp: (UInt64) -> UInt64) {
+        for (latency, delay) in zip(latencies, delays) {
+            let emitted = start + UInt64(probe.latencies.count) * 100_000_000
+            let packet = probe.nextPacket(at: emitted)
+
+            let decoded = emitted + latency
+            probe.received(sequence: packet.sequence, timestamp: UInt32(truncatingIfNeeded: timestamp(decoded)), at: decoded + delay)
+        }
+    }
+
+    /// Test that a probe packet uses the idle address with the sequence number.
+    func testProbePacket() {
+        let packet = ProbePacket(sequence: 42)
+
+        XCTAssertEqual(packet.bytes, [0xff, 42])
+    }
+
+    /// Test that the sequence numbers of probes wrap from 255 to 1, skipping zero.
+    func testSequenceWraps() {
+        var probe = LatencyProbe()
+        let sequences = (0..<256).map { probe.nextPacket(at: UInt64($0)).sequence }
+
+        XCTAssertEqual(sequences.first, 1)
+        XCTAssertEqual(sequences[254], 255)
+        XCTAssertEqual(sequences.last, 1)
+    }
+
+    /// Test that the latencies include the shortest delay of the telemetry, but not the variation in it.
+    func testLatencies() {
+        var probe = LatencyProbe()
+        measure(&probe,
+                latencies: [2_000_000, 2_500_000, 3_000_000, 2_000_000, 2_500_000, 3_000_000, 2_000_000, 2_500_000],
+                delays: [1_000_000, 1_300_000, 1_000_000, 1_300_000, 1_000_000, 1_300_000, 1_000_000, 1_300_000],
+                timestamp: { ($0 - self.start) / 500 + 1234 })
+
+        XCTAssertEqual(probe.latencies, [3000, 3500, 4000, 3000, 3500, 4000, 3000, 3500])
+    }
+
+    /// Test that drift between the booster and Pi clocks is corrected.
+    func testDrift() {
+        var probe = LatencyProbe()
+        measure(&probe,
+                latencies: [2_000_000, 2_500_000, 3_000_000, 2_000_000, 2_500_000, 3_000_000, 2_000_000, 2_500_000],
+                delays: [1_000_000, 1_300_000, 1_000_000, 1_300_000, 1_000_000, 1_300_000, 1_000_000, 1_300_000],
+                timestamp: { ($0 - self.start) / 500 * 1001 / 1000 })
+
+        let expected: [Double] = [3000, 3500, 4000, 3000, 3500, 4000, 3000, 3500]
+        for (latency, expected) in zip(probe.latencies, expected) {
+            XCTAssertEqual(latency, expected, accuracy: 0.001)
+        }
+    }
+
+    /// Test that booster timestamps are extended across the 32-bit wrap.
+    func testTimestampWrap() {
+        var probe = LatencyProbe()
+        measure(&probe,
+                latencies: [2_000_000, 2_000_000, 2_000_000, 2_000_000],
+                delays: [1_000_000, 1_000_000, 1_000_000, 1_000_000],
+                timestamp: { ($0 - self.start) / 500 + UInt64(UInt32.max) - 300_000 })
+
+        XCTAssertEqual(probe.latencies, [3000, 3000, 3000, 3000])
+    }
+
+    /// Test that a record received before its emission is recorded is matched.
+    func testRecordBeforeEmission() {
+        var probe = LatencyProbe()
+        probe.received(sequence: 7, timestamp: 1000, at: start + 3_000_000)
+        probe.emitted(ProbePacket(sequence: 7), at: start)
+
+        XCTAssertEqual(probe.latencies, [3000])
+    }
+
+    /// Test that a probe emitted again before being reported counts the first as lost.
+    func testLost() {
+        var probe = LatencyProbe()
+        probe.emitted(ProbePacket(sequence: 7), at: start)
+        probe.emitted(ProbePacket(sequence: 7), at: start + 100_000_000)
+        probe.received(sequence: 7, timestamp: 1000, at: start + 103_000_000)
+
+        XCTAssertEqual(probe.lost, 1)
+        XCTAssertEqual(probe.latencies, [3000])
+    }
+
+    /// Test that the clocks are mapped separately after the booster restarts.
+    func testRestart() {
+        var probe = LatencyProbe()
+        probe.received(sequence: 1, timestamp: 50_000, at: start + 3_000_000)
+        probe.emitted(ProbePacket(sequence: 1), at: start)
+        probe.restart()
+        probe.received(sequence: 2, timestamp: 10, at: start + 104_000_000)
+        probe.emitted(ProbePacket(sequence: 2), at: start + 100_000_000)
+
+        XCTAssertEqual(probe.latencies, [3000, 4000])
+    }
+
+    /// Test the statistics of the latencies.
+    func testStatistics() {
+        var probe = LatencyProbe()
+        measure(&probe,
+                latencies: [2_000_000, 2_500_000, 3_000_000, 2_000_000, 2_500_000, 3_000_000, 2_000_000, 2_500_000],
+                delays: [1_000_000, 1_300_000, 1_000_000, 1_300_000, 1_000_000, 1_300_000, 1_000_000, 1_300_000],
+                timestamp: { ($0 - self.start) / 500 })
+
+        let statistics = probe.statistics
+        XCTAssertEqual(statistics?.count, 8)
+        XCTAssertEqual(statistics?.lost, 0)
+        XCTAssertEqual(statistics?.minimum, 3000)
+        XCTAssertEqual(statistics?.median, 3500)
+        XCTAssertEqual(statistics?.percentile90, 4000)
+        XCTAssertEqual(statistics?.maximum, 4000)
+        XCTAssertEqual(statistics?.jitter, 1000)
+    }
+
+    /// Test that there are no statistics without measurements.
+    func testNoStatistics() {
+        let probe = LatencyProbe()
+
+        XCTAssertNil(probe.statistics)
+    }
+
+}
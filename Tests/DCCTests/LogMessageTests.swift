@@ -0,0 +1,104 @@
+//
+//  LogMessageTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+@testable import DCC
+
+class LogMessageTests : XCTestCase {
+
+    // MARK: Parsing
+
+    /// Test that a 16-bit argument is parsed little-endian.
+    func testUnsigned16() {
+        let record = LogRecord(payload: [0x01, 0x96, 0x01])
+
+        XCTAssertEqual(record, LogRecord(message: .badLength, arguments: [406]))
+    }
+
+    /// Test that 8-bit arguments are parsed.
+    func testUnsigned8() {
+        let record = LogRecord(payload: [0x02, 0x48, 0x4c])
+
+        XCTAssertEqual(record, LogRecord(message: .badMatch, arguments: [0x48, 0x4c]))
+    }
+
+    /// Test that a message without arguments is parsed.
+    func testNoArguments() {
+        let record = LogRecord(payload: [0x04])
+
+        XCTAssertEqual(record, LogRecord(message: .tooLong))
+    }
+
+    /// Test that fewer arguments than conversions are permitted.
+    func testFewerArguments() {
+        let record = LogRecord(payload: [0x05, 0x03, 0x3f, 0x3c])
+
+        XCTAssertEqual(record, LogRecord(message: .errorDetection, arguments: [0x03, 0x3f, 0x3c]))
+    }
+
+    /// Test that more arguments than conversions are rejected.
+    func testExtraArguments() {
+        let record = LogRecord(payload: [0x06, 0x03, 0x01])
+
+        XCTAssertNil(record)
+    }
+
+    /// Test that an empty payload is rejected.
+    func testEmptyPayload() {
+        let record = LogRecord(payload: [])
+
+        XCTAssertNil(record)
+    }
+
+
+    // MARK: Formatting
+
+    /// Test that every message format uses only supported conversions.
+    func testFormats() {
+        for message in LogMessage.allCases {
+            XCTAssertFalse(LogConversion.parse(message.format).isEmpty)
+        }
+    }
+
+    /// Test that unsigned arguments are expanded in decimal.
+    func testDescriptionUnsigned() {
+        let record = LogRecord(message: .badDelta, arguments: [106, 126])
+
+        XCTAssertEqual(record.description, "BAD DELTA 106 126")
+    }
+
+    /// Test that character arguments are expanded.
+    func testDescriptionCharacter() {
+        let record = LogRecord(message: .badMatch, arguments: [0x48, 0x4c])
+
+        XCTAssertEqual(record.description, "BAD MATCH HL")
+    }
+
+    /// Test that a message without arguments is expanded.
+    func testDescriptionNoArguments() {
+        let record = LogRecord(message: .tooLong)
+
+        XCTAssertEqual(record.description, "TOO LONG")
+    }
+
+    /// Test that a message is truncated before the first missing argument.
+    func testDescriptionTruncated() {
+        let record = LogRecord(message: .errorDetection, arguments: [0x03, 0x3f, 0x3c])
+
+        XCTAssertEqual(record.description, "ERR 3 3f 3c")
+    }
+
+    /// Test that percent signs are expanded.
+    func testParsePercent() {
+        let conversions = LogConversion.parse("100%% %hhu")
+
+        XCTAssertEqual(conversions.count, 2)
+        XCTAssertEqual(conversions.map(\.size), [0, 1])
+    }
+
+}
@@ -0,0 +1,38 @@
+//
+//  PacketCaptureTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+import DCC
+
+class PacketCaptureTests : XCTestCase {
+
+    /// Test that the bits include the preamble, byte start bits, error detection byte, and end bit.
+    func testBits() {
+        let capture = PacketCapture(timestamp: 0, preambleCount: 3, minimumLength: 112, maximumLength: 208, packet: RawPacket(bytes: [0b10100101]))
+
+        XCTAssertEqual(capture.bits, [
+            true, true, true,
+            false, true, false, true, false, false, true, false, true,
+            false, true, false, true, false, false, true, false, true,
+            true,
+        ])
+    }
+
+    /// Test that the trace gives two periods for each bit, after a comment.
+    func testTraceLines() {
+        let capture = PacketCapture(timestamp: 1234, preambleCount: 1, minimumLength: 112, maximumLength: 208, packet: RawPacket(bytes: [0xff]))
+        let lines = capture.traceLines
+
+        XCTAssertEqual(lines.first, "# 1234 0xff")
+        XCTAssertEqual(lines.count, 1 + 2 * 20)
+        XCTAssertEqual(Array(lines[1...6]), ["112", "112", "208", "208", "112", "112"])
+        XCTAssertEqual(Array(lines[21...24]), ["208", "208", "208", "208"])
+        XCTAssertEqual(Array(lines.suffix(2)), ["112", "112"])
+    }
+
+}
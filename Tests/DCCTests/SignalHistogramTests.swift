@@ -0,0 +1,89 @@
+//
+//  SignalHistogramTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+import DCC
+
+class SignalHistogramTests : XCTestCase {
+
+    /// Test that a new histogram is empty and incomplete.
+    func testEmpty() {
+        let histogram = SignalHistogram()
+
+        XCTAssertNil(histogram.sequence)
+        XCTAssertFalse(histogram.isComplete)
+        XCTAssertEqual(histogram.oneBit.total, 0)
+        XCTAssertNil(histogram.oneBit.fraction(within: SignalTiming.oneBitRange))
+    }
+
+    /// Test that counts are placed into the histogram they belong to.
+    func testCounts() {
+        var histogram = SignalHistogram()
+        histogram.add(sequence: 1, offset: 12, counts: [100])
+        histogram.add(sequence: 1, offset: 25, counts: [0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 50])
+
+        XCTAssertEqual(histogram.oneBit.counts[12], 100)
+        XCTAssertEqual(histogram.oneBit.value(at: 12), 58)
+        XCTAssertEqual(histogram.zeroBit.counts[10], 50)
+        XCTAssertEqual(histogram.zeroBit.value(at: 10), 95)
+    }
+
+    /// Test that the buckets are sized from the timing of the board.
+    func testTiming() {
+        var histogram = SignalHistogram(timing: try! DecoderTiming(clockFrequency: 20_000_000, prescale: 8))
+        histogram.add(sequence: 1, offset: 31, counts: [50])
+
+        XCTAssertEqual(histogram.oneBit.counts.count, 31)
+        XCTAssertEqual(histogram.oneBit.value(at: 10), 56, accuracy: 0.001)
+        XCTAssertEqual(histogram.zeroBit.counts[0], 50)
+        XCTAssertEqual(histogram.zeroBit.value(at: 0), 90, accuracy: 0.001)
+        XCTAssertEqual(histogram.oneBitDelta.counts.count, 17)
+    }
+
+    /// Test that the histogram is complete once all buckets are received.
+    func testComplete() {
+        var histogram = SignalHistogram()
+        for offset in stride(from: 0, to: 119, by: 16) {
+            histogram.add(sequence: 3, offset: offset, counts: Array(repeating: 1, count: min(16, 119 - offset)))
+        }
+
+        XCTAssertTrue(histogram.isComplete)
+        XCTAssertEqual(histogram.sequence, 3)
+    }
+
+    /// Test that a new sequence number discards the counts of the previous snapshot.
+    func testNewSequence() {
+        var histogram = SignalHistogram()
+        histogram.add(sequence: 1, offset: 0, counts: [5])
+        histogram.add(sequence: 2, offset: 1, counts: [7])
+
+        XCTAssertEqual(histogram.sequence, 2)
+        XCTAssertEqual(histogram.oneBit.counts[0], 0)
+        XCTAssertEqual(histogram.oneBit.counts[1], 7)
+    }
+
+    /// Test that counts beyond the last bucket are ignored.
+    func testBeyondLastBucket() {
+        var histogram = SignalHistogram()
+        histogram.add(sequence: 1, offset: 118, counts: [1, 2])
+
+        XCTAssertEqual(histogram.preamble.counts.last, 1)
+    }
+
+    /// Test that the fraction within a range only includes buckets whose value is within it.
+    func testFraction() {
+        var histogram = SignalHistogram()
+        // 53µs, 58µs, and 62µs.
+        histogram.add(sequence: 1, offset: 2, counts: [1])
+        histogram.add(sequence: 1, offset: 12, counts: [2])
+        histogram.add(sequence: 1, offset: 20, counts: [1])
+
+        XCTAssertEqual(histogram.oneBit.fraction(within: SignalTiming.oneBitRange), 0.5)
+    }
+
+}
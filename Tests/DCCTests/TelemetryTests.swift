@@ -0,0 +1,382 @@
+//
+//  TelemetryTests.swift
+//  DCCTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+import DCC
+
+class TelemetryTests : XCTestCase {
+
+    // MARK: Framing
+
+    /// Test that a record with no zeros is decoded.
+    func testRecord() {
+        var decoder = TelemetryDecoder()
+        let records = decoder.decode([0x02, 0x01, 0x00])
+
+        XCTAssertEqual(records, [.start])
+    }
+
+    /// Test that zeros within a record are restored.
+    func testRecordWithZeros() {
+        var decoder = TelemetryDecoder()
+        let records = decoder.decode([0x02, 0x10, 0x01, 0x01, 0x00])
+
+        XCTAssertEqual(records, [.packet(RawPacket(bytes: [0x00]))])
+    }
+
+    /// Test that multiple records are decoded from the same bytes.
+    func testMultipleRecords() {
+        var decoder = TelemetryDecoder()
+        let records = decoder.decode([0x02, 0x01, 0x00, 0x03, 0x20, 0x04, 0x00])
+
+        XCTAssertEqual(records, [.start, .condition(.noSignal)])
+    }
+
+    /// Test that a record split across calls is decoded when complete.
+    func testSplitRecord() {
+        var decoder = TelemetryDecoder()
+        XCTAssertEqual(decoder.decode([0x05, 0x10, 0x03]), [])
+        XCTAssertEqual(decoder.decode([0x3f, 0x3c, 0x00]), [.packet(RawPacket(bytes: [0x03, 0x3f]))])
+    }
+
+    /// Test that a malformed frame is discarded, and decoding resumes with the next.
+    func testMalformedFrame() {
+        var decoder = TelemetryDecoder()
+        let records = decoder.decode([0x05, 0x10, 0x00, 0x02, 0x01, 0x00])
+
+        XCTAssertEqual(records, [.start])
+    }
+
+    /// Test that an empty frame is discarded.
+    func testEmptyFrame() {
+        var decoder = TelemetryDecoder()
+        let records = decoder.decode([0x00, 0x02, 0x01, 0x00])
+
+        XCTAssertEqual(records, [.start])
+    }
+
+    /// Test that an unrecognized record type is returned as unknown.
+    func testUnknownRecord() {
+        var decoder = TelemetryDecoder()
+        let records = decoder.decode([0x03, 0xee, 0x42, 0x00])
+
+        XCTAssertEqual(records, [.unknown(type: 0xee, payload: [0x42])])
+    }
+
+
+    // MARK: Records
+
+    /// Test that a packet record has the error detection byte removed.
+    func testPacket() {
+        let record = TelemetryRecord(data: [0x10, 0xff, 0x00, 0xff])
+
+        XCTAssertEqual(record, .packet(RawPacket(bytes: [0xff, 0x00])))
+    }
+
+    /// Test that a packet record with a mismatched error detection byte is returned as unknown.
+    func testPacketErrorDetectionMismatch() {
+        let record = TelemetryRecord(data: [0x10, 0xff, 0x00, 0xfe])
+
+        XCTAssertEqual(record, .unknown(type: 0x10, payload: [0xff, 0x00, 0xfe]))
+    }
+
+    /// Test that a repeats record is decoded with the little-endian count and the packet.
+    func testRepeats() {
+        let record = TelemetryRecord(data: [0x11, 0x2c, 0x01, 0xff, 0x00, 0xff])
+
+        XCTAssertEqual(record, .repeats(RawPacket(bytes: [0xff, 0x00]), count: 300))
+    }
+
+    /// Test that a repeats record with a mismatched error detection byte is returned as unknown.
+    func testRepeatsErrorDetectionMismatch() {
+        let record = TelemetryRecord(data: [0x11, 0x01, 0x00, 0xff, 0x00, 0xfe])
+
+        XCTAssertEqual(record, .unknown(type: 0x11, payload: [0x01, 0x00, 0xff, 0x00, 0xfe]))
+    }
+
+    /// Test that a histogram record is decoded with the sequence, offset, and little-endian counts.
+    func testHistogram() {
+        let record = TelemetryRecord(data: [0x12, 0x07, 0x10, 0x2c, 0x01, 0x00, 0x00, 0x05, 0x00])
+
+        XCTAssertEqual(record, .histogram(sequence: 7, offset: 16, counts: [300, 0, 5]))
+    }
+
+    /// Test that a histogram record with an odd length is returned as unknown.
+    func testHistogramOddLength() {
+        let record = TelemetryRecord(data: [0x12, 0x07, 0x10, 0x2c])
+
+        XCTAssertEqual(record, .unknown(type: 0x12, payload: [0x07, 0x10, 0x2c]))
+    }
+
+    /// Test that a capture record is decoded with its little-endian timestamp and lengths.
+    func testCapture() {
+        let record = TelemetryRecord(data: [0x13, 0x78, 0x56, 0x34, 0x12, 0x10, 0x70, 0x00, 0xd0, 0x00, 0x03, 0x3f, 0x3c])
+
+        XCTAssertEqual(record, .capture(PacketCapture(timestamp: 0x12345678, preambleCount: 16, minimumLength: 112, maximumLength: 208, packet: RawPacket(bytes: [0x03, 0x3f]))))
+    }
+
+    /// Test that a capture record with a mismatched error detection byte is returned as unknown.
+    func testCaptureErrorDetectionMismatch() {
+        let record = TelemetryRecord(data: [0x13, 0x78, 0x56, 0x34, 0x12, 0x10, 0x70, 0x00, 0xd0, 0x00, 0x03, 0x3f, 0x00])
+
+        XCTAssertEqual(record, .unknown(type: 0x13, payload: [0x78, 0x56, 0x34, 0x12, 0x10, 0x70, 0x00, 0xd0, 0x00, 0x03, 0x3f, 0x00]))
+    }
+
+    /// Test that a timing record is decoded with the fractional little-endian centres.
+    func testAdaptiveTiming() {
+        let record = TelemetryRecord(data: [0x14, 0x01, 0x48, 0x07, 0x88, 0x0c])
+
+        XCTAssertEqual(record, .adaptiveTiming(isLocked: true, oneBit: 116.5, zeroBit: 200.5))
+    }
+
+    /// Test that a timing record with a short payload is unknown.
+    func testAdaptiveTimingShort() {
+        let record = TelemetryRecord(data: [0x14, 0x01, 0x48, 0x07])
+
+        XCTAssertEqual(record, .unknown(type: 0x14, payload: [0x01, 0x48, 0x07]))
+    }
+
+    /// Test that a dropped record is decoded with both little-endian counts.
+    func testDropped() {
+        let record = TelemetryRecord(data: [0x03, 0x02, 0x00, 0x2c, 0x01])
+
+        XCTAssertEqual(record, .dropped(highPriority: 2, bestEffort: 300))
+    }
+
+    /// Test that an awake record is decoded with the little-endian maximum and average.
+    func testAwake() {
+        let record = TelemetryRecord(data: [0x04, 0x2c, 0x01, 0x40, 0x00])
+
+        XCTAssertEqual(record, .awake(maximum: 300, average: 64))
+    }
+
+    /// Test that an awake record with a short payload is unknown.
+    func testAwakeShort() {
+        let record = TelemetryRecord(data: [0x04, 0x2c, 0x01])
+
+        XCTAssertEqual(record, .unknown(type: 0x04, payload: [0x2c, 0x01]))
+    }
+
+    /// Test that a condition record is decoded into the option set.
+    func testCondition() {
+        let record = TelemetryRecord(data: [0x20, 0x18])
+
+        XCTAssertEqual(record, .condition([.overheat, .overload]))
+    }
+
+    /// Test that a setting record is decoded with the little-endian value.
+    func testSetting() {
+        let record = TelemetryRecord(data: [0x22, 0x10, 0xfa, 0x00])
+
+        XCTAssertEqual(record, .setting(.recoveryOffTime, value: 250))
+    }
+
+    /// Test that a setting record with an unknown identifier is returned as unknown.
+    func testSettingUnknown() {
+        let record = TelemetryRecord(data: [0x22, 0xee, 0xfa, 0x00])
+
+        XCTAssertEqual(record, .unknown(type: 0x22, payload: [0xee, 0xfa, 0x00]))
+    }
+
+    /// Test that a probe record is decoded with its sequence number and little-endian timestamp.
+    func testProbe() {
+        let record = TelemetryRecord(data: [0x23, 0x2a, 0x78, 0x56, 0x34, 0x12])
+
+        XCTAssertEqual(record, .probe(sequence: 42, timestamp: 0x12345678))
+    }
+
+    /// Test that a probe record with a zero sequence number is returned as unknown.
+    func testProbeZeroSequence() {
+        let record = TelemetryRecord(data: [0x23, 0x00, 0x78, 0x56, 0x34, 0x12])
+
+        XCTAssertEqual(record, .unknown(type: 0x23, payload: [0x00, 0x78, 0x56, 0x34, 0x12]))
+    }
+
+    /// Test that an ack record is decoded with the little-endian delay and rise.
+    func testServiceModeAck() {
+        let record = TelemetryRecord(data: [0x24, 0x01, 0xc4, 0x09, 0x4b, 0x00])
+
+        XCTAssertEqual(record, .serviceModeAck(detected: true, delay: 2500, rise: 75))
+    }
+
+    /// Test that an ack record for a window closed without an acknowledgement is decoded.
+    func testServiceModeNoAck() {
+        let record = TelemetryRecord(data: [0x24, 0x00, 0x00, 0x00, 0x00, 0x00])
+
+        XCTAssertEqual(record, .serviceModeAck(detected: false, delay: 0, rise: 0))
+    }
+
+    /// Test that a journal record of a condition change is decoded with its sequence and ticks.
+    func testJournalCondition() {
+        let record = TelemetryRecord(data: [0x25, 0x34, 0x12, 0x02, 0x78, 0x56, 0x34, 0x12, 0x10, 0x85, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00])
+
+        XCTAssertEqual(record, .journal(BoosterJournalRecord(sequence: 0x1234, ticks: 0x12345678, content: .condition(.overload, peakCurrent: 133, dropped: 0))))
+    }
+
+    /// Test that a journal record of a checkpoint is decoded with the little-endian error counts.
+    func testJournalErrors() {
+        let record = TelemetryRecord(data: [0x25, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x2c, 0x01, 0x02, 0x00, 0x00, 0x00, 0xff, 0xff])
+
+        XCTAssertEqual(record, .journal(BoosterJournalRecord(sequence: 1, ticks: 256, content: .errors(badLength: 300, badMatch: 2, badDelta: 0, errorDetection: 65535))))
+    }
+
+    /// Test that a journal record of an unknown type is returned as unknown.
+    func testJournalUnknownType() {
+        let record = TelemetryRecord(data: [0x25, 0x01, 0x00, 0x09, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00])
+
+        XCTAssertEqual(record, .unknown(type: 0x25, payload: [0x01, 0x00, 0x09, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00]))
+    }
+
+    /// Test that a journal record without a payload marks the end of the journal.
+    func testJournalEnd() {
+        let record = TelemetryRecord(data: [0x25])
+
+        XCTAssertEqual(record, .journalEnd)
+    }
+
+    /// Test that the uptime of a journal record is in seconds.
+    func testJournalUptime() {
+        let record = BoosterJournalRecord(sequence: 1, ticks: 1000, content: .start(resetFlags: 0x01))
+
+        XCTAssertEqual(record.uptime(), 32.768, accuracy: 0.0001)
+    }
+
+    /// Test that an overload record is decoded.
+    func testOverload() {
+        let record = TelemetryRecord(data: [0x21, 0x01, 0x02])
+
+        XCTAssertEqual(record, .overload(.off, failures: 2))
+    }
+
+    /// Test that an overload record with an unknown state is returned as unknown.
+    func testOverloadUnknownState() {
+        let record = TelemetryRecord(data: [0x21, 0x09, 0x00])
+
+        XCTAssertEqual(record, .unknown(type: 0x21, payload: [0x09, 0x00]))
+    }
+
+    /// Test that a log record is decoded with little-endian arguments.
+    func testLog() {
+        let record = TelemetryRecord(data: [0x02, 0x03, 0x6a, 0x00, 0x7e, 0x00])
+
+        XCTAssertEqual(record, .log(LogRecord(message: .badDelta, arguments: [106, 126])))
+    }
+
+    /// Test that a log record with a partial argument is returned as unknown.
+    func testLogPartialArgument() {
+        let record = TelemetryRecord(data: [0x02, 0x03, 0x6a, 0x00, 0x7e])
+
+        XCTAssertEqual(record, .unknown(type: 0x02, payload: [0x03, 0x6a, 0x00, 0x7e]))
+    }
+
+    /// Test that a log record with an unrecognized message is returned as unknown.
+    func testLogUnknownMessage() {
+        let record = TelemetryRecord(data: [0x02, 0xee])
+
+        XCTAssertEqual(record, .unknown(type: 0x02, payload: [0xee]))
+    }
+
+    /// Test that a RailCom record contains the raw bytes.
+    func testRailCom() {
+        let record = TelemetryRecord(data: [0x30, 0xa3, 0xac])
+
+        XCTAssertEqual(record, .railCom([0xa3, 0xac]))
+    }
+
+    /// Test that a RailCom datagram record is decoded with a little-endian value.
+    func testRailComDatagram() {
+        let record = TelemetryRecord(data: [0x31, 0x02, 0x03, 0x00, 0x08, 0x78, 0x56, 0x34, 0x12])
+
+        XCTAssertEqual(record, .railComDatagram(RailComDatagram(channel: 2, address: .primary(3), content: .data(id: 8, value: 0x12345678))))
+    }
+
+    /// Test that a RailCom ACK record is decoded.
+    func testRailComAck() {
+        let record = TelemetryRecord(data: [0x31, 0x02, 0x03, 0x00, 0x40])
+
+        XCTAssertEqual(record, .railComDatagram(RailComDatagram(channel: 2, address: .primary(3), content: .ack)))
+    }
+
+    /// Test that a RailCom datagram record for an extended address is decoded.
+    func testRailComDatagramExtendedAddress() {
+        let record = TelemetryRecord(data: [0x31, 0x02, 0xd2, 0xc4, 0x00, 0x2a])
+
+        XCTAssertEqual(record, .railComDatagram(RailComDatagram(channel: 2, address: .extended(1234), content: .data(id: 0, value: 42))))
+    }
+
+    /// Test that a RailCom datagram record following a packet without an address is decoded.
+    func testRailComDatagramNoAddress() {
+        let record = TelemetryRecord(data: [0x31, 0x01, 0xff, 0xff, 0x01, 0x03])
+
+        XCTAssertEqual(record, .railComDatagram(RailComDatagram(channel: 1, address: nil, content: .data(id: 1, value: 3))))
+    }
+
+    /// Test that a RailCom datagram record with an invalid identifier is returned as unknown.
+    func testRailComDatagramInvalidIdentifier() {
+        let record = TelemetryRecord(data: [0x31, 0x01, 0xff, 0xff, 0x20, 0x03])
+
+        XCTAssertEqual(record, .unknown(type: 0x31, payload: [0x01, 0xff, 0xff, 0x20, 0x03]))
+    }
+
+    /// Test that a zone RailCom record contains the zone and raw bytes.
+    func testZoneRailCom() {
+        let record = TelemetryRecord(data: [0x32, 0x03, 0xa3, 0xac])
+
+        XCTAssertEqual(record, .zoneRailCom(zone: 3, [0xa3, 0xac]))
+    }
+
+    /// Test that a zone RailCom datagram record is decoded with the zone.
+    func testZoneRailComDatagram() {
+        let record = TelemetryRecord(data: [0x33, 0x01, 0x02, 0x03, 0x00, 0x40])
+
+        XCTAssertEqual(record, .zoneRailComDatagram(zone: 1, RailComDatagram(channel: 2, address: .primary(3), content: .ack)))
+    }
+
+    /// Test that a zone RailCom datagram record without a datagram is returned as unknown.
+    func testZoneRailComDatagramTooShort() {
+        let record = TelemetryRecord(data: [0x33, 0x01])
+
+        XCTAssertEqual(record, .unknown(type: 0x33, payload: [0x01]))
+    }
+
+    /// Test that an occupancy record is decoded to the occupied zones.
+    func testOccupancy() {
+        let record = TelemetryRecord(data: [0x34, 0x05])
+
+        XCTAssertEqual(record, .occupancy(zones: [0, 2]))
+    }
+
+    /// Test that an occupancy record with no zones occupied is decoded.
+    func testOccupancyVacant() {
+        let record = TelemetryRecord(data: [0x34, 0x00])
+
+        XCTAssertEqual(record, .occupancy(zones: []))
+    }
+
+    /// Test that a RailCom statistics record is decoded with its zone.
+    func testRailComStatistics() {
+        let record = TelemetryRecord(data: [0x35, 0x02, 0x34, 0x12, 0x03, 0x00, 0x01, 0x00, 0x00, 0x01])
+
+        XCTAssertEqual(record, .railComStatistics(zone: 2, RailComStatistics(received: 0x1234, framingErrors: 3, overruns: 1, invalid: 0x100)))
+    }
+
+    /// Test that a RailCom statistics record from a detector without multiple zones has no zone.
+    func testRailComStatisticsNoZone() {
+        let record = TelemetryRecord(data: [0x35, 0xff, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00])
+
+        XCTAssertEqual(record, .railComStatistics(zone: nil, RailComStatistics(received: 16, framingErrors: 0, overruns: 0, invalid: 0)))
+    }
+
+    /// Test that a RailCom statistics record with a truncated payload is unknown.
+    func testRailComStatisticsTooShort() {
+        let record = TelemetryRecord(data: [0x35, 0xff, 0x10, 0x00])
+
+        XCTAssertEqual(record, .unknown(type: 0x35, payload: [0xff, 0x10, 0x00]))
+    }
+
+}
@@ -0,0 +1,128 @@
+//
+//  SPITests.swift
+//  RaspberryPiTests
+//
+//  Created by agent on 10/14/26.
+//
+
+import XCTest
+
+@testable import RaspberryPi
+
+class SPILayoutTests : XCTestCase {
+
+    // MARK: Layout
+
+    /// Test that the layout of the Registers struct matches hardware.
+    func testRegistersLayout() {
+        XCTAssertEqual(MemoryLayout<SPI.Registers>.size, 0x18)
+        XCTAssertEqual(MemoryLayout<SPIControlStatus>.size, 0x04)
+
+        #if swift(>=4.1.5)
+        XCTAssertEqual(MemoryLayout.offset(of: \SPI.Registers.controlStatus), 0x00)
+        XCTAssertEqual(MemoryLayout.offset(of: \SPI.Registers.fifo), 0x04)
+        XCTAssertEqual(MemoryLayout.offset(of: \SPI.Registers.clockDivider), 0x08)
+        XCTAssertEqual(MemoryLayout.offset(of: \SPI.Registers.dataLength), 0x0c)
+        XCTAssertEqual(MemoryLayout.offset(of: \SPI.Registers.lossiOutputHoldDelay), 0x10)
+        XCTAssertEqual(MemoryLayout.offset(of: \SPI.Registers.dmaControls), 0x14)
+        #endif
+    }
+
+}
+
+class SPITests : XCTestCase {
+
+    var registers = SPI.Registers()
+    var spi: SPI!
+
+    override func setUp() {
+        registers = SPI.Registers()
+        spi = SPI(registers: &registers)
+    }
+
+    override func tearDown() {
+        spi = nil
+    }
+
+
+    // MARK: clockDivider
+
+    /// Test that we can get the clock divider from the register.
+    func testGetClockDivider() {
+        registers.clockDivider = 128
+
+        XCTAssertEqual(spi.clockDivider, 128)
+    }
+
+    /// Test that setting the clock divider writes the register.
+    func testSetClockDivider() {
+        spi.clockDivider = 250
+
+        XCTAssertEqual(registers.clockDivider, 250)
+    }
+
+
+    // MARK: chipSelect
+
+    /// Test that we can get the chip select from the register.
+    func testGetChipSelect() {
+        registers.controlStatus = [ .transferActive, .chipSelect(2) ]
+
+        XCTAssertEqual(spi.chipSelect, 2)
+    }
+
+    /// Test that setting the chip select leaves the other bits alone.
+    func testSetChipSelect() {
+        registers.controlStatus = [ .transferActive, .chipSelect(2) ]
+
+        spi.chipSelect = 1
+
+        XCTAssertEqual(registers.controlStatus, [ .transferActive, .chipSelect(1) ])
+    }
+
+
+    // MARK: isTransferActive
+
+    /// Test that setting the transfer active sets the bit.
+    func testSetTransferActive() {
+        spi.isTransferActive = true
+
+        XCTAssertEqual(registers.controlStatus, [ .transferActive ])
+    }
+
+    /// Test that clearing the transfer active clears the bit.
+    func testClearTransferActive() {
+        registers.controlStatus = [ .transferActive, .chipSelect(1) ]
+
+        spi.isTransferActive = false
+
+        XCTAssertEqual(registers.controlStatus, [ .chipSelect(1) ])
+    }
+
+
+    // MARK: Transfers
+
+    /// Test that a transfer returns a byte received for each sent, and ends inactive on the
+    /// requested chip select.
+    func testTransfer() {
+        registers.controlStatus = [ .transferDone ]
+        registers.fifo = 0xa5
+
+        let received = spi.transfer([0x01, 0x02], chipSelect: 1)
+
+        XCTAssertEqual(received, [0xa5, 0xa5])
+        XCTAssertEqual(spi.chipSelect, 1)
+        XCTAssertFalse(spi.isTransferActive)
+    }
+
+    /// Test that reading sends zeros.
+    func testRead() {
+        registers.controlStatus = [ .transferDone ]
+
+        let received = spi.read(count: 3, chipSelect: 0)
+
+        XCTAssertEqual(received, [0x00, 0x00, 0x00])
+        XCTAssertEqual(registers.fifo, 0x00)
+    }
+
+}